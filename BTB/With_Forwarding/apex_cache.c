@@ -0,0 +1,652 @@
+/*
+ * apex_cache.c
+ * Contains functions to model the APEX cache hierarchy
+ *
+ * Write-back caches allocate on a write miss and write dirty victims to the
+ * next level, write-through caches do not allocate and pass every write on.
+ * Victim writebacks are assumed to drain in the background and add no
+ * latency to the access that caused them.
+ *
+ * With MSHRs the data cache does not block. A miss holds the pipeline only
+ * for the hit time and the line arrives in the background, later misses to
+ * the same line merge into its MSHR instead of going out again. The tags are
+ * filled when the miss starts, so a line is only usable once no MSHR for it
+ * is still in flight. A store without allocation needs no MSHR.
+ *
+ * The stride prefetcher follows the data accesses of each instruction and,
+ * once one repeats its stride, fills the lines a few strides ahead of it.
+ * A prefetched line carries the cycle it arrives like an instruction line,
+ * a demand access that finds it still in flight waits for the rest of it.
+ *
+ * The last level goes to main memory, see apex_dram.c.
+ *
+ * The instruction cache is looked up once per line fetch moves to. A line
+ * on its way in, from a miss or from the next-line prefetcher, carries the
+ * cycle it arrives, and fetch waits until then.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+/* RRIP uses 2 bit prediction values, new blocks are predicted a long re-reference */
+#define RRPV_MAX 3
+#define RRPV_INSERT (RRPV_MAX - 1)
+
+/* Stride repeats the prefetcher counts up to, it prefetches from the first one */
+#define STRIDE_CONFIDENCE_MAX 3
+
+static int cache_access(APEX_Cache *cache, int address, int is_write);
+
+/* Latency of an access that missed in cache and went to the level behind it */
+static int
+next_level_access(APEX_Cache *cache, int address, int is_write)
+{
+    if (cache->next)
+    {
+        return cache_access(cache->next, address, is_write);
+    }
+    return APEX_dram_access(cache->memory, address, is_write);
+}
+
+static void
+touch_block(APEX_Cache *cache, APEX_CacheBlock *block)
+{
+    block->last_use = cache->accesses;
+    block->rrpv = 0;
+}
+
+/* Picks the way of a full or partially full set the next fill goes to */
+static int
+choose_victim(APEX_Cache *cache, APEX_CacheBlock *set)
+{
+    int assoc = cache->config.assoc;
+    int victim = 0;
+
+    for (int way = 0; way < assoc; way++)
+    {
+        if (!set[way].valid)
+        {
+            return way;
+        }
+    }
+
+    switch (cache->config.policy)
+    {
+    case CACHE_POLICY_RANDOM:
+    {
+        cache->random_state = cache->random_state * 1103515245u + 12345u;
+        return (cache->random_state >> 16) % assoc;
+    }
+    case CACHE_POLICY_RRIP:
+    {
+        /* Age the whole set until some block is predicted distant */
+        while (TRUE)
+        {
+            for (int way = 0; way < assoc; way++)
+            {
+                if (set[way].rrpv >= RRPV_MAX)
+                {
+                    return way;
+                }
+            }
+            for (int way = 0; way < assoc; way++)
+            {
+                set[way].rrpv++;
+            }
+        }
+    }
+    }
+
+    for (int way = 1; way < assoc; way++)
+    {
+        if (set[way].last_use < set[victim].last_use)
+        {
+            victim = way;
+        }
+    }
+    return victim;
+}
+
+/* Returns the block holding line, NULL on a miss */
+static APEX_CacheBlock *
+find_block(APEX_Cache *cache, unsigned int line)
+{
+    APEX_CacheBlock *set = &cache->blocks[(line % cache->sets) * cache->config.assoc];
+    int tag = line / cache->sets;
+
+    for (int way = 0; way < cache->config.assoc; way++)
+    {
+        if (set[way].valid && set[way].tag == tag)
+        {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+/* Places line in its set, writing back a dirty victim first */
+static APEX_CacheBlock *
+fill_block(APEX_Cache *cache, unsigned int line, int dirty)
+{
+    APEX_CacheBlock *set = &cache->blocks[(line % cache->sets) * cache->config.assoc];
+    APEX_CacheBlock *block = &set[choose_victim(cache, set)];
+
+    if (block->valid)
+    {
+        cache->evictions++;
+        if (block->dirty)
+        {
+            unsigned int victim_line = (unsigned int)block->tag * cache->sets + (line % cache->sets);
+
+            cache->writebacks++;
+            next_level_access(cache, victim_line * cache->config.line_size, TRUE);
+        }
+    }
+    block->valid = TRUE;
+    block->dirty = dirty;
+    block->tag = line / cache->sets;
+    block->last_use = cache->accesses;
+    block->rrpv = RRPV_INSERT;
+    block->prefetched = FALSE;
+    block->ready_cycle = 0;
+    return block;
+}
+
+/*
+ * Looks up address in one level, filling and evicting as needed
+ *
+ * Returns the cycles until the data is available, including the levels
+ * behind this one on a miss.
+ */
+static int
+cache_access(APEX_Cache *cache, int address, int is_write)
+{
+    unsigned int line = (unsigned int)address / cache->config.line_size;
+    APEX_CacheBlock *block = find_block(cache, line);
+    int latency = cache->config.latency;
+
+    cache->accesses++;
+    if (is_write)
+    {
+        cache->writes++;
+    }
+    else
+    {
+        cache->reads++;
+    }
+
+    if (block)
+    {
+        touch_block(cache, block);
+        if (is_write && !cache->config.write_back)
+        {
+            return latency + next_level_access(cache, address, TRUE);
+        }
+        block->dirty |= is_write;
+        return latency;
+    }
+
+    if (is_write)
+    {
+        cache->write_misses++;
+        if (!cache->config.write_back)
+        {
+            return latency + next_level_access(cache, address, TRUE);
+        }
+    }
+    else
+    {
+        cache->read_misses++;
+    }
+
+    latency += next_level_access(cache, line * cache->config.line_size, FALSE);
+    fill_block(cache, line, is_write);
+    return latency;
+}
+
+/*
+ * Brings line into cache ahead of demand unless it is already there, the
+ * line is ready once the level behind has delivered it
+ */
+static void
+prefetch_line(APEX_Cache *cache, unsigned int line, long long now)
+{
+    APEX_CacheBlock *block;
+    int latency;
+
+    if (find_block(cache, line))
+    {
+        return;
+    }
+
+    cache->prefetches++;
+    latency = next_level_access(cache, line * cache->config.line_size, FALSE);
+    block = fill_block(cache, line, FALSE);
+    block->prefetched = TRUE;
+    block->ready_cycle = now + latency;
+}
+
+/*
+ * Sizes one level from its configuration, a level of size 0 or smaller than
+ * one set is left without blocks and not used
+ *
+ * Returns FALSE only if the blocks cannot be allocated.
+ */
+static int
+cache_init(APEX_Cache *cache, const char *name, const APEX_CacheConfig *config, APEX_Dram *memory)
+{
+    memset(cache, 0, sizeof(APEX_Cache));
+    cache->name = name;
+    cache->config = *config;
+    cache->memory = memory;
+    cache->random_state = 1;
+    if (config->size == 0)
+    {
+        return TRUE;
+    }
+
+    cache->sets = config->size / (config->assoc * config->line_size);
+    if (cache->sets == 0)
+    {
+        fprintf(stderr, "APEX_Cache: %s of %d bytes is smaller than one set, disabling it\n",
+                name, config->size);
+        return TRUE;
+    }
+
+    cache->blocks = calloc(cache->sets * config->assoc, sizeof(APEX_CacheBlock));
+    if (!cache->blocks)
+    {
+        fprintf(stderr, "APEX_Cache: Unable to allocate %s\n", name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Builds the hierarchy from the configuration, both L1 caches backed by the
+ * optional L2 backed by memory
+ *
+ * Returns FALSE if a configured cache cannot be allocated.
+ */
+int
+APEX_caches_init(APEX_CacheHierarchy *caches, const APEX_Config *config)
+{
+    memset(caches, 0, sizeof(APEX_CacheHierarchy));
+    APEX_dram_init(&caches->dram, config);
+    if (!cache_init(&caches->l1d, "l1d", &config->l1d, &caches->dram) ||
+        !cache_init(&caches->l1i, "l1i", &config->l1i, &caches->dram) ||
+        !cache_init(&caches->l2, "l2", &config->l2, &caches->dram))
+    {
+        APEX_caches_free(caches);
+        return FALSE;
+    }
+
+    caches->enabled = (caches->l1d.blocks != NULL);
+    caches->mshrs = config->l1d_mshrs;
+    caches->stride_prefetch = config->l1d_prefetch;
+    caches->prefetch_degree = config->prefetch_degree;
+    caches->prefetch_distance = config->prefetch_distance;
+    caches->icache_enabled = (caches->l1i.blocks != NULL);
+    caches->next_line_prefetch = config->l1i_prefetch;
+    caches->fetch_line = -1;
+    if (caches->l2.blocks)
+    {
+        caches->l1d.next = &caches->l2;
+        caches->l1i.next = &caches->l2;
+    }
+    return TRUE;
+}
+
+/* Returns the MSHR still fetching line in cycle now, NULL if there is none */
+static APEX_Mshr *
+find_mshr(APEX_CacheHierarchy *caches, unsigned int line, long long now)
+{
+    for (int i = 0; i < caches->mshrs; i++)
+    {
+        if (caches->mshr[i].ready_cycle > now && caches->mshr[i].line == line)
+        {
+            return &caches->mshr[i];
+        }
+    }
+    return NULL;
+}
+
+/* Returns the MSHR that is free first, the one whose line arrives earliest */
+static APEX_Mshr *
+earliest_mshr(APEX_CacheHierarchy *caches)
+{
+    APEX_Mshr *mshr = &caches->mshr[0];
+
+    for (int i = 1; i < caches->mshrs; i++)
+    {
+        if (caches->mshr[i].ready_cycle < mshr->ready_cycle)
+        {
+            mshr = &caches->mshr[i];
+        }
+    }
+    return mshr;
+}
+
+/*
+ * Returns the cycle line arrives in l1d, 0 if it is not there or not on its
+ * way from the prefetcher. The first demand access to a prefetched line
+ * counts it as useful, and as late if it has not arrived yet.
+ */
+static long long
+demand_line_arrival(APEX_CacheHierarchy *caches, unsigned int line, long long now)
+{
+    APEX_CacheBlock *block = find_block(&caches->l1d, line);
+
+    if (!block)
+    {
+        return 0;
+    }
+    if (block->prefetched)
+    {
+        caches->l1d.useful_prefetches++;
+        block->prefetched = FALSE;
+        if (block->ready_cycle > now)
+        {
+            caches->late_prefetches++;
+        }
+    }
+    return block->ready_cycle;
+}
+
+/*
+ * Records an access of the instruction at pc and prefetches ahead of it
+ * once its stride has repeated
+ *
+ * Strides shorter than a line prefetch consecutive lines from the one
+ * prefetch_distance strides ahead, longer ones one line per stride.
+ */
+static void
+train_stride_prefetcher(APEX_CacheHierarchy *caches, int pc, int address, long long now)
+{
+    APEX_Cache *l1d = &caches->l1d;
+    APEX_StrideEntry *entry = &caches->stride_table[((unsigned int)pc / 4) % STRIDE_TABLE_SIZE];
+    int line_size = l1d->config.line_size;
+    int stride;
+
+    if (!entry->valid || entry->pc != pc)
+    {
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->last_address = address;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+
+    stride = address - entry->last_address;
+    entry->last_address = address;
+    if (stride != entry->stride)
+    {
+        entry->stride = stride;
+        entry->confidence = 0;
+        return;
+    }
+    if (entry->confidence < STRIDE_CONFIDENCE_MAX)
+    {
+        entry->confidence++;
+    }
+
+    /* A direct mapped single set cache would evict the line just accessed */
+    if (!stride || (l1d->sets == 1 && l1d->config.assoc == 1))
+    {
+        return;
+    }
+    for (int k = 0; k < caches->prefetch_degree; k++)
+    {
+        long long target = address + (long long)stride * caches->prefetch_distance;
+
+        if (abs(stride) < line_size)
+        {
+            target += (long long)(stride > 0 ? k : -k) * line_size;
+        }
+        else
+        {
+            target += (long long)stride * k;
+        }
+        if (target < 0)
+        {
+            break;
+        }
+        prefetch_line(l1d, (unsigned int)(target / line_size), now);
+    }
+}
+
+/* The data cache access of APEX_dcache_access, without training the prefetcher */
+static int
+l1d_access(APEX_CacheHierarchy *caches, int address, int is_write, long long now,
+           long long *ready_cycle)
+{
+    APEX_Cache *l1d = &caches->l1d;
+    unsigned int line = (unsigned int)address / l1d->config.line_size;
+    int hit_latency = l1d->config.latency;
+    long long arrival = demand_line_arrival(caches, line, now);
+    APEX_Mshr *mshr;
+    long long start;
+    int latency;
+
+    if (!caches->mshrs)
+    {
+        latency = cache_access(l1d, address, is_write);
+        if (now + latency < arrival)
+        {
+            latency = (int)(arrival - now);
+        }
+        *ready_cycle = now + latency - 1;
+        return latency;
+    }
+
+    mshr = find_mshr(caches, line, now);
+    if (mshr)
+    {
+        caches->mshr_merges++;
+        cache_access(l1d, address, is_write);
+        *ready_cycle = mshr->ready_cycle;
+        return hit_latency;
+    }
+
+    if (find_block(l1d, line) || (is_write && !l1d->config.write_back))
+    {
+        cache_access(l1d, address, is_write);
+        *ready_cycle = now + hit_latency - 1;
+        if (*ready_cycle < arrival - 1)
+        {
+            *ready_cycle = arrival - 1;
+        }
+        return hit_latency;
+    }
+
+    /* A miss with every MSHR busy starts once the earliest one is free */
+    start = now;
+    mshr = earliest_mshr(caches);
+    if (mshr->ready_cycle > now)
+    {
+        start = mshr->ready_cycle;
+        caches->mshr_full_cycles += start - now;
+    }
+
+    latency = cache_access(l1d, address, is_write);
+    mshr->line = line;
+    mshr->ready_cycle = start + latency - 1;
+    *ready_cycle = mshr->ready_cycle;
+    return (int)(start - now) + hit_latency;
+}
+
+/*
+ * Accesses address for a load (is_write FALSE) or store of the instruction
+ * at pc starting in cycle now, pc is -1 for an access of no single
+ * instruction, which the prefetcher does not learn from
+ *
+ * Returns the cycles the stage making the access is held, 1 if the hierarchy
+ * is disabled. ready_cycle is set to the last cycle before the data can be
+ * used. A blocking cache holds the stage until then, a non-blocking one only
+ * for the hit time and for waiting on a free MSHR.
+ */
+int
+APEX_dcache_access(APEX_CacheHierarchy *caches, int pc, int address, int is_write, long long now,
+                   long long *ready_cycle)
+{
+    int latency;
+
+    if (!caches->enabled)
+    {
+        *ready_cycle = now;
+        return 1;
+    }
+
+    caches->dram.now = now;
+    latency = l1d_access(caches, address, is_write, now, ready_cycle);
+    if (caches->stride_prefetch && pc >= 0)
+    {
+        train_stride_prefetcher(caches, pc, address, now);
+    }
+    return latency;
+}
+
+/*
+ * Returns TRUE if the instruction at pc can be fetched in cycle now
+ *
+ * Moving to a new line looks it up, a miss starts the fill and FALSE is
+ * returned until the line has arrived, fetch just asks again every cycle.
+ * Instructions in the line fetch is already on are read without a lookup.
+ */
+int
+APEX_icache_fetch(APEX_CacheHierarchy *caches, int pc, long long now)
+{
+    APEX_Cache *l1i = &caches->l1i;
+    int line = (unsigned int)pc / l1i->config.line_size;
+    APEX_CacheBlock *block;
+
+    if (!caches->icache_enabled)
+    {
+        return TRUE;
+    }
+    caches->dram.now = now;
+
+    block = find_block(l1i, line);
+    if (line != caches->fetch_line || !block)
+    {
+        int latency = cache_access(l1i, pc, FALSE);
+
+        block = find_block(l1i, line);
+        if (block->prefetched)
+        {
+            l1i->useful_prefetches++;
+            block->prefetched = FALSE;
+        }
+        /* A hit on a line still in flight waits for the rest of its fill */
+        if (block->ready_cycle < now + latency - 1)
+        {
+            block->ready_cycle = now + latency - 1;
+        }
+        caches->fetch_line = line;
+
+        /* A direct mapped single set cache would evict the line fetch waits on */
+        if (caches->next_line_prefetch && (l1i->sets > 1 || l1i->config.assoc > 1))
+        {
+            prefetch_line(l1i, line + 1, now);
+        }
+    }
+    return block->ready_cycle <= now;
+}
+
+/*
+ * Prefetches the l1i line holding pc on behalf of the fetch target queue
+ *
+ * Blocks are queued before fetch reaches them, so their lines can be on the
+ * way in by the time fetch looks them up.
+ */
+void
+APEX_icache_prefetch(APEX_CacheHierarchy *caches, int pc, long long now)
+{
+    APEX_Cache *l1i = &caches->l1i;
+    int line = (unsigned int)pc / l1i->config.line_size;
+
+    if (!caches->icache_enabled || line == caches->fetch_line)
+    {
+        return;
+    }
+    caches->dram.now = now;
+
+    /* Same guard as the next-line prefetch, the line fetch waits on must stay */
+    if (l1i->sets > 1 || l1i->config.assoc > 1)
+    {
+        prefetch_line(l1i, line, now);
+    }
+}
+
+static void
+cache_put_stats(APEX_StatsWriter *writer, const APEX_Cache *cache, long long insn_completed)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), "cache.%s.reads", cache->name);
+    APEX_stats_put(writer, name, cache->reads);
+    snprintf(name, sizeof(name), "cache.%s.read_misses", cache->name);
+    APEX_stats_put(writer, name, cache->read_misses);
+    snprintf(name, sizeof(name), "cache.%s.writes", cache->name);
+    APEX_stats_put(writer, name, cache->writes);
+    snprintf(name, sizeof(name), "cache.%s.write_misses", cache->name);
+    APEX_stats_put(writer, name, cache->write_misses);
+    snprintf(name, sizeof(name), "cache.%s.evictions", cache->name);
+    APEX_stats_put(writer, name, cache->evictions);
+    snprintf(name, sizeof(name), "cache.%s.writebacks", cache->name);
+    APEX_stats_put(writer, name, cache->writebacks);
+    snprintf(name, sizeof(name), "cache.%s.prefetches", cache->name);
+    APEX_stats_put(writer, name, cache->prefetches);
+    snprintf(name, sizeof(name), "cache.%s.useful_prefetches", cache->name);
+    APEX_stats_put(writer, name, cache->useful_prefetches);
+    /* Counters are integers, so misses per kilo-instruction are kept to three decimals */
+    snprintf(name, sizeof(name), "cache.%s.mpki_x1000", cache->name);
+    APEX_stats_put(writer, name, insn_completed ?
+                   (cache->read_misses + cache->write_misses) * 1000000 / insn_completed : 0);
+}
+
+/* Writes the counters of every cache in use */
+void
+APEX_caches_put_stats(APEX_StatsWriter *writer, const APEX_CacheHierarchy *caches,
+                      long long insn_completed)
+{
+    if (caches->enabled)
+    {
+        cache_put_stats(writer, &caches->l1d, insn_completed);
+        APEX_stats_put(writer, "cache.l1d.mshr_merges", caches->mshr_merges);
+        APEX_stats_put(writer, "cache.l1d.mshr_full_cycles", caches->mshr_full_cycles);
+        APEX_stats_put(writer, "cache.l1d.late_prefetches", caches->late_prefetches);
+        /* Useful prefetches per thousand issued, and per thousand lines demand needed */
+        APEX_stats_put(writer, "cache.l1d.prefetch_accuracy_x1000", caches->l1d.prefetches ?
+                       caches->l1d.useful_prefetches * 1000 / caches->l1d.prefetches : 0);
+        APEX_stats_put(writer, "cache.l1d.prefetch_coverage_x1000",
+                       caches->l1d.useful_prefetches + caches->l1d.read_misses + caches->l1d.write_misses ?
+                       caches->l1d.useful_prefetches * 1000 /
+                           (caches->l1d.useful_prefetches + caches->l1d.read_misses + caches->l1d.write_misses) : 0);
+    }
+    if (caches->icache_enabled)
+    {
+        cache_put_stats(writer, &caches->l1i, insn_completed);
+    }
+    if (caches->l2.blocks && (caches->enabled || caches->icache_enabled))
+    {
+        cache_put_stats(writer, &caches->l2, insn_completed);
+    }
+    if (caches->enabled || caches->icache_enabled)
+    {
+        APEX_dram_put_stats(writer, &caches->dram);
+    }
+}
+
+void
+APEX_caches_free(APEX_CacheHierarchy *caches)
+{
+    free(caches->l1d.blocks);
+    free(caches->l1i.blocks);
+    free(caches->l2.blocks);
+    memset(caches, 0, sizeof(APEX_CacheHierarchy));
+}
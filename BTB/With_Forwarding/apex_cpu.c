@@ -164,17 +164,36 @@ APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
 
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->fetch.has_insn)
     {
         /* This fetches new branch target instruction from next cycle */
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.stall_cycles[STALL_BRANCH_REDIRECT]++;
 
             /* Skip this cycle*/
             return;
         }
 
+        /* Wait for the line holding pc to arrive in the instruction cache */
+        if (!APEX_icache_fetch(&cpu->caches, cpu->pc, cpu->clock))
+        {
+            /* Unless it is held, decode has passed its instruction on and gets a bubble */
+            if (!cpu->stall)
+            {
+                cpu->decode.has_insn = FALSE;
+            }
+            cpu->stats.stall_cycles[STALL_ICACHE]++;
+            return;
+        }
+
         /* Store current PC in fetch latch */
         cpu->fetch.pc = cpu->pc;
 
@@ -189,12 +208,22 @@ APEX_fetch(APEX_CPU *cpu)
         cpu->fetch.imm = current_ins->imm;
         if (!cpu->stall)
         {
+            APEX_bpred_predict(&cpu->bpred, cpu->fetch.pc, &cpu->fetch.bp_info);
+            int jump_target = APEX_bpred_predict_jump(&cpu->bpred, cpu->fetch.pc, cpu->fetch.opcode, cpu->fetch.rd,
+                                                      cpu->fetch.rs1, cpu->fetch.imm, &cpu->fetch.bp_info);
             int target_btb_index = is_btb_hit(cpu);
-            if (cpu->fetch.btb_hit)
+            cpu->stats.bp_lookups++;
+            if (jump_target >= 0)
+            {
+                cpu->pc = jump_target;
+            }
+            else if (cpu->fetch.btb_hit)
             {
+                cpu->stats.bp_hits++;
                 int prediction_output = predict_branch(cpu);
                 if (prediction_output)
                 {
+                    cpu->stats.bp_predicted_taken++;
                     cpu->pc = btb[target_btb_index].target_address;
                 }
                 else
@@ -225,6 +254,76 @@ APEX_fetch(APEX_CPU *cpu)
     }
 }
 
+/* Returns TRUE if register is loaded by a missed load whose data has not arrived */
+static int
+load_pending(const APEX_CPU *cpu, int reg)
+{
+    return cpu->load_ready_cycle[reg] > cpu->clock;
+}
+
+/*
+ * Returns TRUE if the instruction in execute reads a register a missed load
+ * has not filled yet
+ */
+static int
+waits_on_load(const APEX_CPU *cpu)
+{
+    switch (cpu->execute.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        return load_pending(cpu, cpu->execute.rs1) || load_pending(cpu, cpu->execute.rs2);
+    }
+
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_CML:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JUMP:
+    case OPCODE_JALR:
+    {
+        return load_pending(cpu, cpu->execute.rs1);
+    }
+    }
+    return FALSE;
+}
+
+/* Returns TRUE if opcode writes its rd register */
+static int
+writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JALR:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
@@ -233,6 +332,12 @@ APEX_fetch(APEX_CPU *cpu)
 static void
 APEX_decode(APEX_CPU *cpu)
 {
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->decode.has_insn)
     {
         /* Read operands from register file based on the instruction type */
@@ -243,6 +348,7 @@ APEX_decode(APEX_CPU *cpu)
         case OPCODE_OR:
         case OPCODE_XOR:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_SUB:
         case OPCODE_ADD:
         case OPCODE_STORE:
@@ -326,6 +432,10 @@ APEX_decode(APEX_CPU *cpu)
             cpu->execute = cpu->decode;
             cpu->dirty = FALSE;
         }
+        else
+        {
+            cpu->stats.stall_cycles[STALL_DATA_HAZARD]++;
+        }
         if (ENABLE_DEBUG_MESSAGES)
         {
             print_stage_content("Decode/RF", &cpu->decode);
@@ -334,6 +444,12 @@ APEX_decode(APEX_CPU *cpu)
 }
 int check_for_LOADP_STOREP_stall(APEX_CPU *cpu)
 {
+    /* The execute latch keeps its last instruction across a bubble, it is only
+       still in flight if it has just moved on to memory */
+    if (!cpu->memory.has_insn || cpu->memory.pc != cpu->execute.pc)
+    {
+        return FALSE;
+    }
     if (!cpu->dirty)
     {
         if (cpu->execute.opcode == OPCODE_LOADP)
@@ -368,6 +484,7 @@ void data_forwarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_STORE:
     case OPCODE_STOREP:
     case OPCODE_CMP:
@@ -465,6 +582,7 @@ int check_rs2(int opcode)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
@@ -561,6 +679,7 @@ void score_boarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
@@ -711,6 +830,25 @@ void score_boarding(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
+    /* The access in memory has not finished, keep this instruction */
+    if (cpu->mem_cycles_left)
+    {
+        return;
+    }
+
+    /* Memory gets bubbles until the data of a missed load a source needs is in */
+    cpu->load_use_hold = cpu->execute.has_insn && waits_on_load(cpu);
+    if (cpu->load_use_hold)
+    {
+        cpu->stats.stall_cycles[STALL_MEMORY]++;
+        return;
+    }
+    if (cpu->execute.has_insn && writes_rd(cpu->execute.opcode))
+    {
+        /* A later write replaces whatever an older missed load brings into rd */
+        cpu->load_ready_cycle[cpu->execute.rd] = 0;
+    }
+
     if (cpu->execute.has_insn)
     {
         cpu->execute.no_forward = FALSE;
@@ -747,6 +885,38 @@ APEX_execute(APEX_CPU *cpu)
             break;
         }
 
+        case OPCODE_DIV:
+        {
+            /* The divider is not pipelined, the DIV stays in execute, and
+             * holds the front end, until its last cycle */
+            if (!cpu->div_cycles_left)
+            {
+                cpu->div_cycles_left = APEX_div_latency(&cpu->config, cpu->execute.rs1_value, cpu->execute.rs2_value);
+                cpu->stats.div_ops++;
+                if (cpu->div_cycles_left < cpu->config.div_latency)
+                {
+                    cpu->stats.div_early_outs++;
+                }
+            }
+            cpu->stats.div_busy_cycles++;
+            cpu->div_cycles_left--;
+            if (cpu->div_cycles_left)
+            {
+                cpu->stats.stall_cycles[STALL_STRUCTURAL]++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Execute", &cpu->execute);
+                }
+                return;
+            }
+            cpu->execute.result_buffer = APEX_div_result(cpu->execute.rs1_value, cpu->execute.rs2_value);
+
+            /* Set the zero flag based on the result buffer */
+            set_condition_codes(cpu);
+            data_forwarding(cpu);
+            break;
+        }
+
         case OPCODE_LOAD:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
@@ -775,25 +945,36 @@ APEX_execute(APEX_CPU *cpu)
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
             cpu->execute.result_buffer = cpu->execute.pc + 4;
-            cpu->pc = cpu->execute.memory_address;
-            cpu->fetch_from_next_cycle = TRUE;
-            cpu->decode.has_insn = FALSE;
-            cpu->fetch.has_insn = TRUE;
+            if (!APEX_bpred_resolve_jump(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info,
+                                         cpu->execute.memory_address))
+            {
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
+                cpu->pc = cpu->execute.memory_address;
+                cpu->fetch_from_next_cycle = TRUE;
+                cpu->decode.has_insn = FALSE;
+                cpu->fetch.has_insn = TRUE;
+            }
             data_forwarding(cpu);
             break;
         }
         case OPCODE_JUMP:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-            cpu->pc = cpu->execute.memory_address;
-            cpu->fetch_from_next_cycle = TRUE;
-            cpu->decode.has_insn = FALSE;
-            cpu->fetch.has_insn = TRUE;
+            if (!APEX_bpred_resolve_jump(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info,
+                                         cpu->execute.memory_address))
+            {
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
+                cpu->pc = cpu->execute.memory_address;
+                cpu->fetch_from_next_cycle = TRUE;
+                cpu->decode.has_insn = FALSE;
+                cpu->fetch.has_insn = TRUE;
+            }
             break;
         }
 
         case OPCODE_BZ:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->zero_flag == TRUE)
             {
@@ -808,6 +989,7 @@ APEX_execute(APEX_CPU *cpu)
 
         case OPCODE_BNZ:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->zero_flag == FALSE)
             {
@@ -821,6 +1003,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BP:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->poisitve_flag == TRUE)
             {
@@ -834,6 +1017,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNP:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->poisitve_flag == FALSE)
             {
@@ -847,6 +1031,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BN:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->negative_flag == TRUE)
             {
@@ -856,6 +1041,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNN:
         {
+            cpu->stats.branches++;
             cpu->execute.no_forward = TRUE;
             if (cpu->negative_flag == FALSE)
             {
@@ -970,9 +1156,14 @@ APEX_execute(APEX_CPU *cpu)
 }
 void branch_updation(APEX_CPU *cpu, char actual_decision)
 {
+    if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+    {
+        APEX_bpred_update(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info, actual_decision == 'T');
+    }
     btb[cpu->execute.btb_probe_index].target_address = cpu->execute.pc + cpu->execute.imm;
     if (actual_decision == 'T')
     {
+        cpu->stats.branches_taken++;
         if (cpu->execute.btb_hit)
         {
             if (!cpu->execute.predicted_decision)
@@ -980,6 +1171,8 @@ void branch_updation(APEX_CPU *cpu, char actual_decision)
                 update_btb_entry(cpu, 'T');
                 cpu->pc = cpu->execute.pc + cpu->execute.imm;
                 cpu->fetch_from_next_cycle = TRUE;
+                cpu->stats.bp_mispredicts++;
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
                 cpu->decode.has_insn = FALSE;
                 cpu->fetch.has_insn = TRUE;
             }
@@ -993,6 +1186,8 @@ void branch_updation(APEX_CPU *cpu, char actual_decision)
             update_btb_entry(cpu, 'T');
             cpu->pc = cpu->execute.pc + cpu->execute.imm;
             cpu->fetch_from_next_cycle = TRUE;
+            cpu->stats.bp_mispredicts++;
+            APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
             cpu->decode.has_insn = FALSE;
             cpu->fetch.has_insn = TRUE;
         }
@@ -1006,6 +1201,8 @@ void branch_updation(APEX_CPU *cpu, char actual_decision)
                 update_btb_entry(cpu, 'N');
                 cpu->pc = cpu->execute.pc + 4;
                 cpu->fetch_from_next_cycle = TRUE;
+                cpu->stats.bp_mispredicts++;
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
                 cpu->decode.has_insn = FALSE;
                 cpu->fetch.has_insn = TRUE;
             }
@@ -1024,6 +1221,9 @@ void branch_instruction(APEX_CPU *cpu)
     /* Since we are using reverse callbacks for pipeline stages,
      * this will prevent the new instruction from being fetched in the current cycle*/
     cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.branches_taken++;
+    cpu->stats.bp_mispredicts++;
+    APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
 
     /* Flush previous stages */
     cpu->decode.has_insn = FALSE;
@@ -1053,6 +1253,42 @@ void set_condition_codes(APEX_CPU *cpu)
     }
 }
 
+/*
+ * Looks the access of the instruction in memory up in the data caches on its
+ * first cycle and counts down the cycles it takes
+ *
+ * Returns TRUE once the access is done, or if the instruction has none.
+ */
+static int
+data_access_done(APEX_CPU *cpu)
+{
+    switch (cpu->memory.opcode)
+    {
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        if (!cpu->mem_cycles_left)
+        {
+            int is_write = (cpu->memory.opcode == OPCODE_STORE || cpu->memory.opcode == OPCODE_STOREP);
+            long long ready_cycle;
+
+            cpu->mem_cycles_left = APEX_dcache_access(&cpu->caches, cpu->memory.pc, cpu->memory.memory_address,
+                                                      is_write, cpu->clock, &ready_cycle);
+            cpu->stats.stall_cycles[STALL_MEMORY] += cpu->mem_cycles_left - 1;
+            if (!is_write)
+            {
+                cpu->load_ready_cycle[cpu->memory.rd] = (int)ready_cycle;
+            }
+        }
+        cpu->mem_cycles_left--;
+        return !cpu->mem_cycles_left;
+    }
+    }
+    return TRUE;
+}
+
 /*
  * Memory Stage of APEX Pipeline
  *
@@ -1063,6 +1299,15 @@ APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        if (!data_access_done(cpu))
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Memory", &cpu->memory);
+            }
+            return;
+        }
+
         cpu->no_forward = FALSE;
         cpu->memory_update_rs1 = FALSE;
         cpu->memory_update_rs2 = FALSE;
@@ -1081,6 +1326,7 @@ APEX_memory(APEX_CPU *cpu)
         case OPCODE_JALR:
         case OPCODE_MOVC:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         {
             data_forwarding(cpu);
             /* No work for ADD */
@@ -1091,6 +1337,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Read from data memory */
             cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+            cpu->stats.mem_reads++;
             data_forwarding(cpu);
             break;
         }
@@ -1098,6 +1345,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Read from data memory */
             cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+            cpu->stats.mem_reads++;
             data_forwarding(cpu);
             if (cpu->stall)
             {
@@ -1110,12 +1358,14 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             break;
         }
         case OPCODE_STOREP:
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             data_forwarding(cpu);
             if (cpu->stall)
             {
@@ -1152,6 +1402,7 @@ APEX_writeback(APEX_CPU *cpu)
         {
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         case OPCODE_AND:
@@ -1206,6 +1457,7 @@ APEX_writeback(APEX_CPU *cpu)
             cpu->status = TRUE;
         }
         cpu->insn_completed++;
+        cpu->stats.retired[cpu->writeback.opcode]++;
         cpu->writeback.has_insn = FALSE;
 
         if (ENABLE_DEBUG_MESSAGES)
@@ -1239,6 +1491,12 @@ int predict_branch(APEX_CPU *cpu)
     int i = cpu->fetch.btb_probe_index;
     if (btb[i].valid && btb[i].inst_address == cpu->fetch.pc)
     {
+        if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+        {
+            /* The BTB only gave the target, the direction comes from the predictor */
+            cpu->fetch.predicted_decision = cpu->fetch.bp_info.taken;
+            return cpu->fetch.predicted_decision;
+        }
         if ((btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 1) || (btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 0))
         {
 
@@ -1313,6 +1571,8 @@ int is_btb_hit(APEX_CPU *cpu)
     cpu->fetch.btb_hit = FALSE;
     return -1;
 }
+
+/* Allocates a BTB entry in decode, with the PC relative target predecode already knows */
 void create_btb_entry(APEX_CPU *cpu)
 {
     int i = 0;
@@ -1322,6 +1582,7 @@ void create_btb_entry(APEX_CPU *cpu)
         {
             btb[i].valid = 1;
             btb[i].inst_address = cpu->decode.pc;
+            btb[i].target_address = cpu->decode.pc + cpu->decode.imm;
             if (cpu->decode.opcode == OPCODE_BNZ || cpu->decode.opcode == OPCODE_BP)
             {
                 btb[i].prev_outcome[0] = 1;
@@ -1345,6 +1606,7 @@ void create_btb_entry(APEX_CPU *cpu)
         }
         btb[i].valid = 1;
         btb[i].inst_address = cpu->decode.pc;
+        btb[i].target_address = cpu->decode.pc + cpu->decode.imm;
         if (cpu->decode.opcode == OPCODE_BNZ || cpu->decode.opcode == OPCODE_BP)
         {
             btb[i].prev_outcome[0] = 1;
@@ -1365,7 +1627,7 @@ void create_btb_entry(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const char *config_file)
 {
     int i;
     APEX_CPU *cpu;
@@ -1389,11 +1651,30 @@ APEX_cpu_init(const char *filename)
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = DISABLE_SINGLE_STEP;
     cpu->status = TRUE;
+    APEX_config_init(&cpu->config);
+    if (config_file && !APEX_config_load(&cpu->config, config_file))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_caches_init(&cpu->caches, &cpu->config))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_bpred_init(&cpu->bpred, &cpu->config))
+    {
+        APEX_caches_free(&cpu->caches);
+        free(cpu);
+        return NULL;
+    }
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     init_btb();
     if (!cpu->code_memory)
     {
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
         free(cpu);
         return NULL;
     }
@@ -1418,8 +1699,27 @@ APEX_cpu_init(const char *filename)
 
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
+    APEX_stats_interval_open(&cpu->interval, &cpu->config, &cpu->stats);
     return cpu;
 }
+
+/* Writes every counter to the statistics file at the end of a run */
+static void
+dump_stats(APEX_CPU *cpu, int cycles)
+{
+    APEX_StatsWriter writer;
+
+    if (!APEX_stats_open(&writer, &cpu->config, APEX_MODEL_NAME))
+    {
+        return;
+    }
+    APEX_stats_put(&writer, "cycles", cycles);
+    APEX_stats_put(&writer, "insn_completed", cpu->insn_completed);
+    APEX_stats_put_common(&writer, &cpu->stats);
+    APEX_caches_put_stats(&writer, &cpu->caches, cpu->insn_completed);
+    APEX_bpred_put_stats(&writer, &cpu->bpred);
+    APEX_stats_close(&writer);
+}
 static void print_mem(const APEX_CPU *cpu, int address)
 {
     if (address != 0)
@@ -1465,6 +1765,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                     /* Halt in writeback stage */
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
+                    APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                    dump_stats(cpu, cpu->clock + 1);
                     return;
                 }
 
@@ -1473,10 +1775,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 APEX_decode(cpu);
                 APEX_fetch(cpu);
                 cpu->clock++;
+                APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
                 if (no_of_cycles == cpu->clock)
                 {
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Stopped after = %d cycles  instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     return;
                 }
             }
@@ -1495,6 +1799,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             {
                 /* Halt in writeback stage */
                 printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
+                APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                dump_stats(cpu, cpu->clock + 1);
                 break;
             }
 
@@ -1511,11 +1817,13 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
                 {
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     break;
                 }
             }
 
             cpu->clock++;
+            APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
         }
 
         else if (command == 5)
@@ -1535,5 +1843,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu)
+    {
+        /* A run stopped before HALT may have been resumed, so the time series ends here */
+        APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock);
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
+    }
     free(cpu);
 }
\ No newline at end of file
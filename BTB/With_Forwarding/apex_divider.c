@@ -0,0 +1,74 @@
+/*
+ * apex_divider.c
+ * Contains the latency and result of the APEX divide unit
+ */
+#include <limits.h>
+
+#include "apex_divider.h"
+
+/* Quotient bits a full width divide produces */
+#define DIV_QUOTIENT_BITS 32
+
+/* Number of significant bits in the magnitude of value */
+static int
+significant_bits(int value)
+{
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    int bits = 0;
+
+    while (magnitude)
+    {
+        bits++;
+        magnitude >>= 1;
+    }
+    return bits;
+}
+
+/*
+ * Returns the cycles the divider is busy with one DIV, between 1 and
+ * config->div_latency
+ *
+ * Without early-out every DIV takes the full latency. With it the latency
+ * scales with the quotient bits left once the leading zeroes of both
+ * operands are skipped. Dividing by zero always takes the full latency.
+ */
+int
+APEX_div_latency(const APEX_Config *config, int dividend, int divisor)
+{
+    int quotient_bits;
+    int latency;
+
+    if (!config->div_early_out || divisor == 0)
+    {
+        return config->div_latency;
+    }
+
+    quotient_bits = significant_bits(dividend) - significant_bits(divisor) + 1;
+    if (quotient_bits <= 0)
+    {
+        return 1;
+    }
+
+    latency = (config->div_latency * quotient_bits + DIV_QUOTIENT_BITS - 1) / DIV_QUOTIENT_BITS;
+    return latency < 1 ? 1 : latency;
+}
+
+/*
+ * Returns the quotient rounded towards zero
+ *
+ * Dividing by zero gives 0, and INT_MIN / -1 wraps to INT_MIN, instead of
+ * trapping the host.
+ */
+int
+APEX_div_result(int dividend, int divisor)
+{
+    if (divisor == 0)
+    {
+        return 0;
+    }
+    if (dividend == INT_MIN && divisor == -1)
+    {
+        return INT_MIN;
+    }
+    return dividend / divisor;
+}
@@ -0,0 +1,141 @@
+/*
+ * apex_dram.c
+ * Contains functions to model the timing of APEX main memory
+ *
+ * Consecutive rows go to consecutive banks, so a stream keeps hitting the
+ * open row of one bank and moves on to the next bank at a row boundary.
+ *
+ * The caches work out the latency of an access when it is made, so the
+ * controller serves requests in the order they reach it. A request waits
+ * for room in the controller queue, then for its bank, and its burst waits
+ * for the data bus. A bank takes its next column command once the burst of
+ * the previous one is on the bus, so row hits to one bank overlap their
+ * tCAS and stream at one burst per tBURST.
+ */
+#include <string.h>
+
+#include "apex_dram.h"
+#include "apex_macros.h"
+
+void
+APEX_dram_init(APEX_Dram *dram, const APEX_Config *config)
+{
+    memset(dram, 0, sizeof(APEX_Dram));
+    dram->enabled = config->dram;
+    dram->flat_latency = config->mem_latency;
+    dram->banks = config->dram_banks;
+    dram->row_size = config->dram_row_size;
+    dram->tcas = config->dram_tcas;
+    dram->trcd = config->dram_trcd;
+    dram->trp = config->dram_trp;
+    dram->tburst = config->dram_tburst;
+    dram->queue_size = config->dram_queue_size;
+    for (int i = 0; i < dram->banks; i++)
+    {
+        dram->bank[i].open_row = -1;
+    }
+}
+
+/* Returns the queue entry that frees up first */
+static long long *
+earliest_queue_entry(APEX_Dram *dram)
+{
+    long long *entry = &dram->queue[0];
+
+    for (int i = 1; i < dram->queue_size; i++)
+    {
+        if (dram->queue[i] < *entry)
+        {
+            entry = &dram->queue[i];
+        }
+    }
+    return entry;
+}
+
+/*
+ * Reads or writes the line at address for a request made in cycle
+ * dram->now
+ *
+ * Returns the cycles until the whole burst has been transferred.
+ */
+int
+APEX_dram_access(APEX_Dram *dram, int address, int is_write)
+{
+    unsigned int row_index = (unsigned int)address / dram->row_size;
+    APEX_DramBank *bank = &dram->bank[row_index % dram->banks];
+    int row = row_index / dram->banks;
+    long long *entry;
+    long long start = dram->now;
+    long long column;
+    long long burst;
+
+    if (!dram->enabled)
+    {
+        return dram->flat_latency;
+    }
+
+    if (is_write)
+    {
+        dram->writes++;
+    }
+    else
+    {
+        dram->reads++;
+    }
+
+    entry = earliest_queue_entry(dram);
+    if (*entry > start)
+    {
+        dram->queue_full_cycles += *entry - start;
+        start = *entry;
+    }
+    if (bank->ready_cycle > start)
+    {
+        start = bank->ready_cycle;
+    }
+
+    if (bank->open_row == row)
+    {
+        dram->row_hits++;
+        column = start;
+    }
+    else if (bank->open_row < 0)
+    {
+        dram->row_empty++;
+        column = start + dram->trcd;
+    }
+    else
+    {
+        dram->row_conflicts++;
+        column = start + dram->trp + dram->trcd;
+    }
+    bank->open_row = row;
+
+    burst = column + dram->tcas;
+    if (burst < dram->bus_free_cycle)
+    {
+        burst = dram->bus_free_cycle;
+    }
+    dram->bus_free_cycle = burst + dram->tburst;
+    dram->bus_busy_cycles += dram->tburst;
+    bank->ready_cycle = column + dram->tburst;
+    *entry = burst + dram->tburst;
+    return (int)(*entry - dram->now);
+}
+
+/* Writes the DRAM counters, nothing if the flat latency is in use */
+void
+APEX_dram_put_stats(APEX_StatsWriter *writer, const APEX_Dram *dram)
+{
+    if (!dram->enabled)
+    {
+        return;
+    }
+    APEX_stats_put(writer, "dram.reads", dram->reads);
+    APEX_stats_put(writer, "dram.writes", dram->writes);
+    APEX_stats_put(writer, "dram.row_hits", dram->row_hits);
+    APEX_stats_put(writer, "dram.row_empty", dram->row_empty);
+    APEX_stats_put(writer, "dram.row_conflicts", dram->row_conflicts);
+    APEX_stats_put(writer, "dram.queue_full_cycles", dram->queue_full_cycles);
+    APEX_stats_put(writer, "dram.bus_busy_cycles", dram->bus_busy_cycles);
+}
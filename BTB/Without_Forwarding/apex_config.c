@@ -0,0 +1,542 @@
+/*
+ * apex_config.c
+ * Contains functions to parse the simulator configuration file
+ *
+ * The file holds one "key = value" pair per line, blank lines and lines
+ * starting with '#' are ignored.
+ */
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_config.h"
+#include "apex_macros.h"
+
+/* Removes leading and trailing white space in place */
+static char *
+trim(char *str)
+{
+    char *end;
+
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1]))
+    {
+        end--;
+    }
+    *end = '\0';
+
+    return str;
+}
+
+static void
+copy_string(char *dest, const char *src, size_t size)
+{
+    strncpy(dest, src, size - 1);
+    dest[size - 1] = '\0';
+}
+
+/*
+ * Parses a decimal integer in [min_value, max_value]
+ *
+ * Returns FALSE and leaves the destination untouched on a bad value.
+ */
+static int
+parse_int(const char *value, int min_value, int max_value, int *dest)
+{
+    char *end;
+    long parsed = strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || parsed < min_value || parsed > max_value)
+    {
+        return FALSE;
+    }
+    *dest = (int)parsed;
+    return TRUE;
+}
+
+/*
+ * Applies the part of a key after a cache prefix such as "l1d_" to the
+ * configuration of that cache
+ */
+static int
+set_cache_value(APEX_CacheConfig *cache, const char *key, const char *value)
+{
+    if (strcmp(key, "size") == 0)
+    {
+        return parse_int(value, 0, MAX_CACHE_SIZE, &cache->size);
+    }
+
+    if (strcmp(key, "assoc") == 0)
+    {
+        return parse_int(value, 1, MAX_CACHE_ASSOC, &cache->assoc);
+    }
+
+    if (strcmp(key, "line_size") == 0)
+    {
+        return parse_int(value, 4, MAX_CACHE_LINE_SIZE, &cache->line_size);
+    }
+
+    if (strcmp(key, "latency") == 0)
+    {
+        return parse_int(value, 1, MAX_MEM_LATENCY, &cache->latency);
+    }
+
+    if (strcmp(key, "write_back") == 0)
+    {
+        return parse_int(value, 0, 1, &cache->write_back);
+    }
+
+    if (strcmp(key, "policy") == 0)
+    {
+        if (strcmp(value, "lru") == 0)
+        {
+            cache->policy = CACHE_POLICY_LRU;
+        }
+        else if (strcmp(value, "random") == 0)
+        {
+            cache->policy = CACHE_POLICY_RANDOM;
+        }
+        else if (strcmp(value, "rrip") == 0)
+        {
+            cache->policy = CACHE_POLICY_RRIP;
+        }
+        else
+        {
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void
+init_cache_config(APEX_CacheConfig *cache, int size, int assoc, int line_size, int latency)
+{
+    cache->size = size;
+    cache->assoc = assoc;
+    cache->line_size = line_size;
+    cache->latency = latency;
+    cache->write_back = DEFAULT_CACHE_WRITE_BACK;
+    cache->policy = DEFAULT_CACHE_POLICY;
+}
+
+/*
+ * Applies a single key/value pair to the configuration
+ *
+ * Note: Add new knobs here along with their default in APEX_config_init
+ */
+static int
+set_config_value(APEX_Config *config, const char *key, const char *value)
+{
+    if (strcmp(key, "stats_file") == 0)
+    {
+        copy_string(config->stats_file, value, sizeof(config->stats_file));
+        return TRUE;
+    }
+
+    if (strcmp(key, "stats_format") == 0)
+    {
+        if (strcmp(value, "json") != 0 && strcmp(value, "csv") != 0)
+        {
+            return FALSE;
+        }
+        copy_string(config->stats_format, value, sizeof(config->stats_format));
+        return TRUE;
+    }
+
+    if (strcmp(key, "interval_file") == 0)
+    {
+        copy_string(config->interval_file, value, sizeof(config->interval_file));
+        return TRUE;
+    }
+
+    if (strcmp(key, "interval_cycles") == 0)
+    {
+        return parse_int(value, 0, INT_MAX, &config->interval_cycles);
+    }
+
+    if (strcmp(key, "frontend_width") == 0)
+    {
+        return parse_int(value, 1, MAX_FRONTEND_WIDTH, &config->frontend_width);
+    }
+
+    if (strcmp(key, "phys_regs") == 0)
+    {
+        return parse_int(value, 1, MAX_PHYS_REGS, &config->phys_regs);
+    }
+
+    if (strcmp(key, "flag_regs") == 0)
+    {
+        return parse_int(value, 1, MAX_PHYS_REGS, &config->flag_regs);
+    }
+
+    if (strcmp(key, "int_units") == 0)
+    {
+        return parse_int(value, 1, MAX_FU_UNITS, &config->int_units);
+    }
+
+    if (strcmp(key, "mul_units") == 0)
+    {
+        return parse_int(value, 1, MAX_FU_UNITS, &config->mul_units);
+    }
+
+    if (strcmp(key, "agu_units") == 0)
+    {
+        return parse_int(value, 1, MAX_FU_UNITS, &config->agu_units);
+    }
+
+    if (strcmp(key, "branch_units") == 0)
+    {
+        return parse_int(value, 1, MAX_FU_UNITS, &config->branch_units);
+    }
+
+    if (strcmp(key, "issue_width") == 0)
+    {
+        return parse_int(value, 1, MAX_ISSUE_WIDTH, &config->issue_width);
+    }
+
+    if (strcmp(key, "mul_latency") == 0)
+    {
+        return parse_int(value, 1, MAX_MUL_LATENCY, &config->mul_latency);
+    }
+
+    if (strcmp(key, "div_units") == 0)
+    {
+        return parse_int(value, 1, MAX_FU_UNITS, &config->div_units);
+    }
+
+    if (strcmp(key, "div_latency") == 0)
+    {
+        return parse_int(value, 1, MAX_DIV_LATENCY, &config->div_latency);
+    }
+
+    if (strcmp(key, "div_early_out") == 0)
+    {
+        return parse_int(value, 0, 1, &config->div_early_out);
+    }
+
+    if (strcmp(key, "lq_size") == 0)
+    {
+        return parse_int(value, 1, MAX_LQ_SIZE, &config->lq_size);
+    }
+
+    if (strcmp(key, "sq_size") == 0)
+    {
+        return parse_int(value, 1, MAX_SQ_SIZE, &config->sq_size);
+    }
+
+    if (strcmp(key, "store_sets") == 0)
+    {
+        return parse_int(value, 0, 1, &config->store_sets);
+    }
+
+    if (strcmp(key, "ssit_size") == 0)
+    {
+        return parse_int(value, 1, MAX_SSIT_SIZE, &config->ssit_size);
+    }
+
+    if (strcmp(key, "store_buffer_size") == 0)
+    {
+        return parse_int(value, 0, MAX_STORE_BUFFER_SIZE, &config->store_buffer_size);
+    }
+
+    if (strcmp(key, "l1d_mshrs") == 0)
+    {
+        return parse_int(value, 0, MAX_MSHRS, &config->l1d_mshrs);
+    }
+
+    if (strcmp(key, "l1d_prefetch") == 0)
+    {
+        return parse_int(value, 0, 1, &config->l1d_prefetch);
+    }
+
+    if (strcmp(key, "prefetch_degree") == 0)
+    {
+        return parse_int(value, 1, MAX_PREFETCH_DEGREE, &config->prefetch_degree);
+    }
+
+    if (strcmp(key, "prefetch_distance") == 0)
+    {
+        return parse_int(value, 1, MAX_PREFETCH_DISTANCE, &config->prefetch_distance);
+    }
+
+    if (strncmp(key, "l1d_", 4) == 0)
+    {
+        return set_cache_value(&config->l1d, key + 4, value);
+    }
+
+    if (strcmp(key, "l1i_prefetch") == 0)
+    {
+        return parse_int(value, 0, 1, &config->l1i_prefetch);
+    }
+
+    if (strncmp(key, "l1i_", 4) == 0)
+    {
+        return set_cache_value(&config->l1i, key + 4, value);
+    }
+
+    if (strncmp(key, "l2_", 3) == 0)
+    {
+        return set_cache_value(&config->l2, key + 3, value);
+    }
+
+    if (strcmp(key, "mem_latency") == 0)
+    {
+        return parse_int(value, 1, MAX_MEM_LATENCY, &config->mem_latency);
+    }
+
+    if (strcmp(key, "dram") == 0)
+    {
+        return parse_int(value, 0, 1, &config->dram);
+    }
+
+    if (strcmp(key, "dram_banks") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_BANKS, &config->dram_banks);
+    }
+
+    if (strcmp(key, "dram_row_size") == 0)
+    {
+        return parse_int(value, 4, MAX_DRAM_ROW_SIZE, &config->dram_row_size);
+    }
+
+    if (strcmp(key, "dram_tcas") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_TIMING, &config->dram_tcas);
+    }
+
+    if (strcmp(key, "dram_trcd") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_TIMING, &config->dram_trcd);
+    }
+
+    if (strcmp(key, "dram_trp") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_TIMING, &config->dram_trp);
+    }
+
+    if (strcmp(key, "dram_tburst") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_TIMING, &config->dram_tburst);
+    }
+
+    if (strcmp(key, "dram_queue_size") == 0)
+    {
+        return parse_int(value, 1, MAX_DRAM_QUEUE_SIZE, &config->dram_queue_size);
+    }
+
+    if (strcmp(key, "bp_predictor") == 0)
+    {
+        if (strcmp(value, "btb") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_BTB;
+        }
+        else if (strcmp(value, "bimodal") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_BIMODAL;
+        }
+        else if (strcmp(value, "gshare") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_GSHARE;
+        }
+        else if (strcmp(value, "local") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_LOCAL;
+        }
+        else if (strcmp(value, "tournament") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_TOURNAMENT;
+        }
+        else if (strcmp(value, "tage") == 0)
+        {
+            config->bp_predictor = BP_PREDICTOR_TAGE;
+        }
+        else
+        {
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (strcmp(key, "bp_table_bits") == 0)
+    {
+        return parse_int(value, 1, MAX_BP_TABLE_BITS, &config->bp_table_bits);
+    }
+
+    if (strcmp(key, "bp_history_bits") == 0)
+    {
+        return parse_int(value, 1, MAX_BP_HISTORY_BITS, &config->bp_history_bits);
+    }
+
+    if (strcmp(key, "bp_local_table_bits") == 0)
+    {
+        return parse_int(value, 1, MAX_BP_TABLE_BITS, &config->bp_local_table_bits);
+    }
+
+    if (strcmp(key, "bp_tage_table_bits") == 0)
+    {
+        return parse_int(value, 1, MAX_BP_TABLE_BITS, &config->bp_tage_table_bits);
+    }
+
+    if (strcmp(key, "ras_size") == 0)
+    {
+        return parse_int(value, 0, MAX_RAS_SIZE, &config->ras_size);
+    }
+
+    if (strcmp(key, "indirect_table_size") == 0)
+    {
+        return parse_int(value, 0, MAX_INDIRECT_TABLE_SIZE, &config->indirect_table_size);
+    }
+
+    if (strcmp(key, "ftq_size") == 0)
+    {
+        return parse_int(value, 1, MAX_FTQ_SIZE, &config->ftq_size);
+    }
+
+    if (strcmp(key, "bp_latency") == 0)
+    {
+        return parse_int(value, 1, MAX_BP_LATENCY, &config->bp_latency);
+    }
+
+    if (strcmp(key, "ftq_prefetch") == 0)
+    {
+        return parse_int(value, 0, 1, &config->ftq_prefetch);
+    }
+
+    if (strcmp(key, "loop_buffer_size") == 0)
+    {
+        return parse_int(value, 0, MAX_LOOP_BUFFER_SIZE, &config->loop_buffer_size);
+    }
+
+    if (strcmp(key, "uop_cache_size") == 0)
+    {
+        return parse_int(value, 0, MAX_UOP_CACHE_SIZE, &config->uop_cache_size);
+    }
+
+    if (strcmp(key, "macro_fusion") == 0)
+    {
+        return parse_int(value, 0, 1, &config->macro_fusion);
+    }
+
+    return FALSE;
+}
+
+/*
+ * Fills the configuration with the compiled-in defaults
+ */
+void
+APEX_config_init(APEX_Config *config)
+{
+    memset(config, 0, sizeof(APEX_Config));
+    copy_string(config->stats_file, DEFAULT_STATS_FILE, sizeof(config->stats_file));
+    copy_string(config->stats_format, DEFAULT_STATS_FORMAT, sizeof(config->stats_format));
+    copy_string(config->interval_file, DEFAULT_INTERVAL_FILE, sizeof(config->interval_file));
+    config->interval_cycles = DEFAULT_INTERVAL_CYCLES;
+    config->frontend_width = DEFAULT_FRONTEND_WIDTH;
+    config->phys_regs = DEFAULT_PHYS_REGS;
+    config->flag_regs = DEFAULT_FLAG_REGS;
+    config->int_units = DEFAULT_INT_UNITS;
+    config->mul_units = DEFAULT_MUL_UNITS;
+    config->agu_units = DEFAULT_AGU_UNITS;
+    config->branch_units = DEFAULT_BRANCH_UNITS;
+    config->issue_width = DEFAULT_ISSUE_WIDTH;
+    config->mul_latency = DEFAULT_MUL_LATENCY;
+    config->div_units = DEFAULT_DIV_UNITS;
+    config->div_latency = DEFAULT_DIV_LATENCY;
+    config->div_early_out = DEFAULT_DIV_EARLY_OUT;
+    config->lq_size = DEFAULT_LQ_SIZE;
+    config->sq_size = DEFAULT_SQ_SIZE;
+    config->store_sets = DEFAULT_STORE_SETS;
+    config->ssit_size = DEFAULT_SSIT_SIZE;
+    config->store_buffer_size = DEFAULT_STORE_BUFFER_SIZE;
+    init_cache_config(&config->l1d, DEFAULT_L1D_SIZE, DEFAULT_L1D_ASSOC, DEFAULT_L1D_LINE_SIZE,
+                      DEFAULT_L1D_LATENCY);
+    config->l1d_mshrs = DEFAULT_L1D_MSHRS;
+    config->l1d_prefetch = DEFAULT_L1D_PREFETCH;
+    config->prefetch_degree = DEFAULT_PREFETCH_DEGREE;
+    config->prefetch_distance = DEFAULT_PREFETCH_DISTANCE;
+    init_cache_config(&config->l1i, DEFAULT_L1I_SIZE, DEFAULT_L1I_ASSOC, DEFAULT_L1I_LINE_SIZE,
+                      DEFAULT_L1I_LATENCY);
+    config->l1i_prefetch = DEFAULT_L1I_PREFETCH;
+    init_cache_config(&config->l2, DEFAULT_L2_SIZE, DEFAULT_L2_ASSOC, DEFAULT_L2_LINE_SIZE,
+                      DEFAULT_L2_LATENCY);
+    config->mem_latency = DEFAULT_MEM_LATENCY;
+    config->dram = DEFAULT_DRAM;
+    config->dram_banks = DEFAULT_DRAM_BANKS;
+    config->dram_row_size = DEFAULT_DRAM_ROW_SIZE;
+    config->dram_tcas = DEFAULT_DRAM_TCAS;
+    config->dram_trcd = DEFAULT_DRAM_TRCD;
+    config->dram_trp = DEFAULT_DRAM_TRP;
+    config->dram_tburst = DEFAULT_DRAM_TBURST;
+    config->dram_queue_size = DEFAULT_DRAM_QUEUE_SIZE;
+    config->bp_predictor = DEFAULT_BP_PREDICTOR;
+    config->bp_table_bits = DEFAULT_BP_TABLE_BITS;
+    config->bp_history_bits = DEFAULT_BP_HISTORY_BITS;
+    config->bp_local_table_bits = DEFAULT_BP_LOCAL_TABLE_BITS;
+    config->bp_tage_table_bits = DEFAULT_BP_TAGE_TABLE_BITS;
+    config->ras_size = DEFAULT_RAS_SIZE;
+    config->indirect_table_size = DEFAULT_INDIRECT_TABLE_SIZE;
+    config->ftq_size = DEFAULT_FTQ_SIZE;
+    config->bp_latency = DEFAULT_BP_LATENCY;
+    config->ftq_prefetch = DEFAULT_FTQ_PREFETCH;
+    config->loop_buffer_size = DEFAULT_LOOP_BUFFER_SIZE;
+    config->uop_cache_size = DEFAULT_UOP_CACHE_SIZE;
+    config->macro_fusion = DEFAULT_MACRO_FUSION;
+}
+
+/*
+ * Overrides the defaults with the values from a configuration file
+ *
+ * Returns FALSE if the file cannot be read, unknown keys and bad values are
+ * reported and skipped.
+ */
+int
+APEX_config_load(APEX_Config *config, const char *filename)
+{
+    FILE *fp;
+    char buffer[512];
+    int line_no = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Config: Unable to open %s\n", filename);
+        return FALSE;
+    }
+
+    while (fgets(buffer, sizeof(buffer), fp))
+    {
+        char *line = trim(buffer);
+        char *separator;
+
+        line_no++;
+        if (line[0] == '\0' || line[0] == '#')
+        {
+            continue;
+        }
+
+        separator = strchr(line, '=');
+        if (!separator)
+        {
+            fprintf(stderr, "APEX_Config: %s:%d: expected key = value\n", filename, line_no);
+            continue;
+        }
+
+        *separator = '\0';
+        if (!set_config_value(config, trim(line), trim(separator + 1)))
+        {
+            fprintf(stderr, "APEX_Config: %s:%d: ignoring '%s'\n", filename, line_no, trim(line));
+        }
+    }
+
+    fclose(fp);
+    return TRUE;
+}
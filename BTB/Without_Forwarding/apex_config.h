@@ -0,0 +1,228 @@
+/*
+ * apex_config.h
+ * Contains APEX simulator run-time configuration declarations
+ *
+ * Every knob has a compiled-in default and can be overridden by a plain
+ * "key = value" file passed as the second argument to apex_sim.
+ */
+#ifndef _APEX_CONFIG_H_
+#define _APEX_CONFIG_H_
+
+#define CONFIG_PATH_LEN 256
+
+/* Default values of the configuration knobs */
+#define DEFAULT_STATS_FILE ""
+#define DEFAULT_STATS_FORMAT "json"
+#define DEFAULT_INTERVAL_FILE "apex_intervals.csv"
+#define DEFAULT_INTERVAL_CYCLES 0
+#define DEFAULT_FRONTEND_WIDTH 1
+#define DEFAULT_PHYS_REGS 0
+#define DEFAULT_FLAG_REGS 0
+#define DEFAULT_INT_UNITS 1
+#define DEFAULT_MUL_UNITS 1
+#define DEFAULT_AGU_UNITS 1
+#define DEFAULT_BRANCH_UNITS 1
+#define DEFAULT_ISSUE_WIDTH 4
+#define DEFAULT_MUL_LATENCY 3
+#define DEFAULT_DIV_UNITS 1
+#define DEFAULT_DIV_LATENCY 16
+#define DEFAULT_DIV_EARLY_OUT 1
+#define DEFAULT_LQ_SIZE 16
+#define DEFAULT_SQ_SIZE 16
+#define DEFAULT_STORE_SETS 0
+#define DEFAULT_STORE_BUFFER_SIZE 4
+#define DEFAULT_SSIT_SIZE 256
+#define DEFAULT_L1D_SIZE 0
+#define DEFAULT_L1D_ASSOC 2
+#define DEFAULT_L1D_LINE_SIZE 16
+#define DEFAULT_L1D_LATENCY 1
+#define DEFAULT_L1D_MSHRS 4
+#define DEFAULT_L1I_SIZE 0
+#define DEFAULT_L1I_ASSOC 2
+#define DEFAULT_L1I_LINE_SIZE 16
+#define DEFAULT_L1I_LATENCY 1
+#define DEFAULT_L1I_PREFETCH 1
+#define DEFAULT_L1D_PREFETCH 1
+#define DEFAULT_PREFETCH_DEGREE 2
+#define DEFAULT_PREFETCH_DISTANCE 4
+#define DEFAULT_L2_SIZE 0
+#define DEFAULT_L2_ASSOC 8
+#define DEFAULT_L2_LINE_SIZE 32
+#define DEFAULT_L2_LATENCY 8
+#define DEFAULT_CACHE_WRITE_BACK 1
+#define DEFAULT_CACHE_POLICY CACHE_POLICY_LRU
+#define DEFAULT_MEM_LATENCY 50
+#define DEFAULT_DRAM 1
+#define DEFAULT_DRAM_BANKS 8
+#define DEFAULT_DRAM_ROW_SIZE 1024
+#define DEFAULT_DRAM_TCAS 15
+#define DEFAULT_DRAM_TRCD 15
+#define DEFAULT_DRAM_TRP 15
+#define DEFAULT_DRAM_TBURST 4
+#define DEFAULT_DRAM_QUEUE_SIZE 16
+#define DEFAULT_BP_PREDICTOR BP_PREDICTOR_BTB
+#define DEFAULT_BP_TABLE_BITS 10
+#define DEFAULT_BP_HISTORY_BITS 8
+#define DEFAULT_BP_LOCAL_TABLE_BITS 6
+#define DEFAULT_BP_TAGE_TABLE_BITS 8
+#define DEFAULT_RAS_SIZE 8
+#define DEFAULT_INDIRECT_TABLE_SIZE 16
+#define DEFAULT_FTQ_SIZE 8
+#define DEFAULT_BP_LATENCY 1
+#define DEFAULT_FTQ_PREFETCH 1
+#define DEFAULT_LOOP_BUFFER_SIZE 0
+#define DEFAULT_UOP_CACHE_SIZE 64
+#define DEFAULT_MACRO_FUSION 1
+
+/* Upper bound of the out-of-order front end width */
+#define MAX_FRONTEND_WIDTH 8
+
+/* Upper bound of the out-of-order physical and flag register files */
+#define MAX_PHYS_REGS 100
+
+/* Upper bound of the out-of-order units of one type, and of the issue width */
+#define MAX_FU_UNITS 4
+#define MAX_ISSUE_WIDTH 16
+
+/* Upper bound of the out-of-order multiplier pipeline depth */
+#define MAX_MUL_LATENCY 8
+
+/* Upper bound of the cycles one DIV holds the divider */
+#define MAX_DIV_LATENCY 64
+
+/* Upper bounds of the out-of-order load queue and store queue */
+#define MAX_LQ_SIZE 64
+#define MAX_SQ_SIZE 64
+
+/* Upper bound of the out-of-order post-commit store buffer */
+#define MAX_STORE_BUFFER_SIZE 16
+
+/* Upper bound of the store set table of the out-of-order LSQ */
+#define MAX_SSIT_SIZE 4096
+
+/* Upper bounds of the cache geometry and of the latency of any level */
+#define MAX_CACHE_SIZE (1 << 20)
+#define MAX_CACHE_ASSOC 16
+#define MAX_CACHE_LINE_SIZE 256
+#define MAX_MEM_LATENCY 1000
+
+/* Upper bounds of the DRAM geometry, timing and controller queue */
+#define MAX_DRAM_BANKS 16
+#define MAX_DRAM_ROW_SIZE 8192
+#define MAX_DRAM_TIMING 100
+#define MAX_DRAM_QUEUE_SIZE 64
+
+/* Upper bounds of the lines the stride prefetcher fetches per access and of how far ahead */
+#define MAX_PREFETCH_DEGREE 8
+#define MAX_PREFETCH_DISTANCE 32
+
+/* Upper bound of the misses the data cache tracks at once */
+#define MAX_MSHRS 16
+
+/* Upper bounds of the log2 size of a branch predictor table and of its histories */
+#define MAX_BP_TABLE_BITS 16
+#define MAX_BP_HISTORY_BITS 30
+
+/* Upper bounds of the return address stack and of the indirect target table */
+#define MAX_RAS_SIZE 64
+#define MAX_INDIRECT_TABLE_SIZE 1024
+
+/* Upper bounds of the fetch target queue and of the cycles one block prediction takes */
+#define MAX_FTQ_SIZE 32
+#define MAX_BP_LATENCY 8
+
+/* Upper bound of the instructions one loop the loop buffer replays may have */
+#define MAX_LOOP_BUFFER_SIZE 64
+
+/* Upper bound of the entries of the micro-op cache */
+#define MAX_UOP_CACHE_SIZE 1024
+
+/* Replacement policies of a cache */
+enum
+{
+    CACHE_POLICY_LRU,
+    CACHE_POLICY_RANDOM,
+    CACHE_POLICY_RRIP      /* Static RRIP with 2 bit re-reference predictions */
+};
+
+/* Direction predictors of conditional branches, see apex_bpred.h */
+enum
+{
+    BP_PREDICTOR_BTB,      /* 2 bit counter of the BTB entry */
+    BP_PREDICTOR_BIMODAL,
+    BP_PREDICTOR_GSHARE,
+    BP_PREDICTOR_LOCAL,
+    BP_PREDICTOR_TOURNAMENT,
+    BP_PREDICTOR_TAGE
+};
+
+/* Geometry and timing of one cache level */
+typedef struct APEX_CacheConfig
+{
+    int size;              /* Bytes, 0 disables the level */
+    int assoc;
+    int line_size;         /* Bytes */
+    int latency;           /* Cycles of a hit */
+    int write_back;        /* Write-back and allocate, or write-through without allocating */
+    int policy;            /* CACHE_POLICY_* */
+} APEX_CacheConfig;
+
+/* Run-time configuration of the simulator */
+typedef struct APEX_Config
+{
+    char stats_file[CONFIG_PATH_LEN];    /* End of run statistics dump, "" disables it */
+    char stats_format[8];                /* "json" or "csv" */
+    char interval_file[CONFIG_PATH_LEN]; /* Time series of per-interval counters */
+    int interval_cycles;                 /* Interval length in cycles, 0 disables it */
+    int frontend_width;                  /* Instructions fetched/renamed/dispatched per cycle */
+    int phys_regs;                       /* Physical registers, 0 scales them with the width */
+    int flag_regs;                       /* Flag registers, 0 scales them with the width */
+    int int_units;                       /* Integer ALUs */
+    int mul_units;                       /* Multipliers */
+    int agu_units;                       /* Address units for loads, stores and branch targets */
+    int branch_units;                    /* Branch resolution units */
+    int issue_width;                     /* Instructions issued to the units per cycle */
+    int mul_latency;                     /* Multiplier pipeline stages, one new MUL per cycle */
+    int div_units;                       /* Dividers, out-of-order model only */
+    int div_latency;                     /* Cycles of a full width DIV, the divider is not pipelined */
+    int div_early_out;                   /* Finish a DIV once its quotient bits are known */
+    int lq_size;                         /* Load queue entries, out-of-order model only */
+    int sq_size;                         /* Store queue entries, out-of-order model only */
+    int store_sets;                      /* Store set predictor scaffold, loads still wait to broadcast */
+    int ssit_size;                       /* Entries of the store set table, indexed by PC */
+    int store_buffer_size;               /* Lines of retired stores waiting for l1d, 0 stores at commit */
+    APEX_CacheConfig l1d;                /* Data cache, size 0 gives single cycle memory */
+    int l1d_mshrs;                       /* Outstanding l1d misses, 0 blocks on every miss */
+    APEX_CacheConfig l1i;                /* Instruction cache, size 0 gives fetch without misses */
+    int l1i_prefetch;                    /* Next-line prefetch into l1i */
+    int l1d_prefetch;                    /* Stride prefetch into l1d, per instruction */
+    int prefetch_degree;                 /* Lines the stride prefetcher fetches per access */
+    int prefetch_distance;               /* Strides ahead of the access it starts at */
+    APEX_CacheConfig l2;                 /* Optional level behind l1d and l1i */
+    int mem_latency;                     /* Cycles memory takes behind the last cache without the DRAM model */
+    int dram;                            /* Model banks, row buffers and the data bus of main memory */
+    int dram_banks;
+    int dram_row_size;                   /* Bytes of one row of one bank */
+    int dram_tcas;                       /* Cycles from a column command to its data */
+    int dram_trcd;                       /* Cycles from opening a row to a column command */
+    int dram_trp;                        /* Cycles to close an open row */
+    int dram_tburst;                     /* Cycles a line takes on the data bus */
+    int dram_queue_size;                 /* Requests the memory controller holds at once */
+    int bp_predictor;                    /* BP_PREDICTOR_*, BTB and out-of-order models only */
+    int bp_table_bits;                   /* log2 of the entries of the predictor counter tables */
+    int bp_history_bits;                 /* Outcomes in the global and local histories */
+    int bp_local_table_bits;             /* log2 of the branches with a local history */
+    int bp_tage_table_bits;              /* log2 of the entries of every tagged TAGE table */
+    int ras_size;                        /* Return address stack entries, 0 disables it */
+    int indirect_table_size;             /* Targets of JUMP and JALR remembered, 0 disables it */
+    int ftq_size;                        /* Predicted fetch blocks queued ahead of fetch, out-of-order model only */
+    int bp_latency;                      /* Cycles the branch prediction unit takes per fetch block */
+    int ftq_prefetch;                    /* Prefetch the l1i lines of every block entering the queue */
+    int loop_buffer_size;                /* Decoded instructions of a loop replayed without fetch, 0 disables it */
+    int uop_cache_size;                  /* Decoded instructions kept by PC for decode2, 0 disables it */
+    int macro_fusion;                    /* Fuse a CMP, CML or SUBL with the conditional branch after it */
+} APEX_Config;
+
+void APEX_config_init(APEX_Config *config);
+int APEX_config_load(APEX_Config *config, const char *filename);
+#endif
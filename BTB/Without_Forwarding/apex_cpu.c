@@ -167,6 +167,12 @@ APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
 
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->fetch.has_insn)
     {
         
@@ -174,11 +180,21 @@ APEX_fetch(APEX_CPU *cpu)
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.stall_cycles[STALL_BRANCH_REDIRECT]++;
 
             /* Skip this cycle*/
             return;
         }
 
+        /* Wait for the line holding pc to arrive in the instruction cache */
+        if (!APEX_icache_fetch(&cpu->caches, cpu->pc, cpu->clock))
+        {
+            /* Decode has passed its instruction on, it gets a bubble */
+            cpu->decode.has_insn = FALSE;
+            cpu->stats.stall_cycles[STALL_ICACHE]++;
+            return;
+        }
+
         /* Store current PC in fetch latch */
         cpu->fetch.pc = cpu->pc;
 
@@ -192,11 +208,19 @@ APEX_fetch(APEX_CPU *cpu)
         cpu->fetch.rs2 = current_ins->rs2;
         cpu->fetch.imm = current_ins->imm;
         /* Update PC for next instruction */
+        APEX_bpred_predict(&cpu->bpred, cpu->fetch.pc, &cpu->fetch.bp_info);
+        int jump_target = APEX_bpred_predict_jump(&cpu->bpred, cpu->fetch.pc, cpu->fetch.opcode, cpu->fetch.rd,
+                                                  cpu->fetch.rs1, cpu->fetch.imm, &cpu->fetch.bp_info);
         int target_btb_index = is_btb_hit(cpu);
-        if (cpu->fetch.btb_hit) {
+        cpu->stats.bp_lookups++;
+        if (jump_target >= 0) {
+            cpu->pc = jump_target;
+        } else if (cpu->fetch.btb_hit) {
+            cpu->stats.bp_hits++;
             int prediction_output = predict_branch(cpu);
             if(prediction_output)
             {
+            cpu->stats.bp_predicted_taken++;
             cpu->pc = btb[target_btb_index].target_address;
             }
             else{
@@ -230,6 +254,76 @@ APEX_fetch(APEX_CPU *cpu)
     }
 }
 
+/* Returns TRUE if register is loaded by a missed load whose data has not arrived */
+static int
+load_pending(const APEX_CPU *cpu, int reg)
+{
+    return cpu->load_ready_cycle[reg] > cpu->clock;
+}
+
+/*
+ * Returns TRUE if the instruction in execute reads a register a missed load
+ * has not filled yet
+ */
+static int
+waits_on_load(const APEX_CPU *cpu)
+{
+    switch (cpu->execute.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        return load_pending(cpu, cpu->execute.rs1) || load_pending(cpu, cpu->execute.rs2);
+    }
+
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_CML:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JUMP:
+    case OPCODE_JALR:
+    {
+        return load_pending(cpu, cpu->execute.rs1);
+    }
+    }
+    return FALSE;
+}
+
+/* Returns TRUE if opcode writes its rd register */
+static int
+writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JALR:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
@@ -238,6 +332,12 @@ APEX_fetch(APEX_CPU *cpu)
 static void
 APEX_decode(APEX_CPU *cpu)
 {
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->decode.has_insn)
     {
 
@@ -249,6 +349,7 @@ APEX_decode(APEX_CPU *cpu)
         case OPCODE_OR:
         case OPCODE_XOR:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_SUB:
         case OPCODE_ADD:
         case OPCODE_STORE:
@@ -302,6 +403,10 @@ APEX_decode(APEX_CPU *cpu)
         }
         }
         score_boarding(cpu);
+        if (!cpu->status)
+        {
+            cpu->stats.stall_cycles[STALL_DATA_HAZARD]++;
+        }
         if (ENABLE_DEBUG_MESSAGES)
         {
             print_stage_content("Decode/RF", &cpu->decode);
@@ -315,6 +420,7 @@ void score_boarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
@@ -448,6 +554,25 @@ void score_boarding(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
+    /* The access in memory has not finished, keep this instruction */
+    if (cpu->mem_cycles_left)
+    {
+        return;
+    }
+
+    /* Memory gets bubbles until the data of a missed load a source needs is in */
+    cpu->load_use_hold = cpu->execute.has_insn && waits_on_load(cpu);
+    if (cpu->load_use_hold)
+    {
+        cpu->stats.stall_cycles[STALL_MEMORY]++;
+        return;
+    }
+    if (cpu->execute.has_insn && writes_rd(cpu->execute.opcode))
+    {
+        /* A later write replaces whatever an older missed load brings into rd */
+        cpu->load_ready_cycle[cpu->execute.rd] = 0;
+    }
+
     if (cpu->execute.has_insn)
     {
         /* Execute logic based on instruction type */
@@ -482,6 +607,38 @@ APEX_execute(APEX_CPU *cpu)
             break;
         }
 
+        case OPCODE_DIV:
+        {
+            /* The divider is not pipelined, the DIV stays in execute, and
+             * holds the front end, until its last cycle */
+            if (!cpu->div_cycles_left)
+            {
+                cpu->div_cycles_left = APEX_div_latency(&cpu->config, cpu->execute.rs1_value, cpu->execute.rs2_value);
+                cpu->stats.div_ops++;
+                if (cpu->div_cycles_left < cpu->config.div_latency)
+                {
+                    cpu->stats.div_early_outs++;
+                }
+            }
+            cpu->stats.div_busy_cycles++;
+            cpu->div_cycles_left--;
+            if (cpu->div_cycles_left)
+            {
+                cpu->stats.stall_cycles[STALL_STRUCTURAL]++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Execute", &cpu->execute);
+                }
+                return;
+            }
+            cpu->execute.result_buffer = APEX_div_result(cpu->execute.rs1_value, cpu->execute.rs2_value);
+            cpu->reg_valid[cpu->execute.rd] = 1;
+
+            /* Set the zero flag based on the result buffer */
+            set_condition_codes(cpu);
+            break;
+        }
+
         case OPCODE_LOAD:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
@@ -513,24 +670,35 @@ APEX_execute(APEX_CPU *cpu)
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
             cpu->reg_valid[cpu->execute.rd] = 1;
             cpu->execute.result_buffer = cpu->execute.pc + 4;
-            cpu->pc = cpu->execute.memory_address;
-            cpu->fetch_from_next_cycle = TRUE;
-            cpu->decode.has_insn = FALSE;
-            cpu->fetch.has_insn = TRUE;
+            if (!APEX_bpred_resolve_jump(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info,
+                                         cpu->execute.memory_address))
+            {
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
+                cpu->pc = cpu->execute.memory_address;
+                cpu->fetch_from_next_cycle = TRUE;
+                cpu->decode.has_insn = FALSE;
+                cpu->fetch.has_insn = TRUE;
+            }
             break;
         }
         case OPCODE_JUMP:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-            cpu->pc = cpu->execute.memory_address;
-            cpu->fetch_from_next_cycle = TRUE;
-            cpu->decode.has_insn = FALSE;
-            cpu->fetch.has_insn = TRUE;
+            if (!APEX_bpred_resolve_jump(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info,
+                                         cpu->execute.memory_address))
+            {
+                APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
+                cpu->pc = cpu->execute.memory_address;
+                cpu->fetch_from_next_cycle = TRUE;
+                cpu->decode.has_insn = FALSE;
+                cpu->fetch.has_insn = TRUE;
+            }
             break;
         }
 
         case OPCODE_BZ:
         {
+            cpu->stats.branches++;
             if (cpu->zero_flag == TRUE)
             {
                 branch_updation(cpu,'T');
@@ -544,6 +712,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNZ:
         {
+            cpu->stats.branches++;
            if (cpu->zero_flag == FALSE)
             {
                 branch_updation(cpu,'T');
@@ -556,6 +725,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BP:
         {
+            cpu->stats.branches++;
             if (cpu->poisitve_flag == TRUE)
             {
                branch_updation(cpu,'T');
@@ -568,6 +738,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNP:
         {
+            cpu->stats.branches++;
             if (cpu->poisitve_flag == FALSE)
             {
                 branch_updation(cpu,'T');
@@ -581,6 +752,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BN:
         {
+            cpu->stats.branches++;
             if (cpu->negative_flag == TRUE)
             {
                 branch_instruction(cpu);
@@ -589,6 +761,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNN:
         {
+            cpu->stats.branches++;
             if (cpu->negative_flag == FALSE)
             {
                 branch_instruction(cpu);
@@ -695,9 +868,14 @@ APEX_execute(APEX_CPU *cpu)
 }
 void branch_updation(APEX_CPU *cpu,char actual_decision)
 {
+   if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+   {
+    APEX_bpred_update(&cpu->bpred, cpu->execute.pc, &cpu->execute.bp_info, actual_decision == 'T');
+   }
    btb[cpu->execute.btb_probe_index].target_address = cpu->execute.pc + cpu->execute.imm;
    if(actual_decision == 'T')
    {
+    cpu->stats.branches_taken++;
     if(cpu->execute.btb_hit)
     {
         if(!cpu->execute.predicted_decision)
@@ -705,6 +883,8 @@ void branch_updation(APEX_CPU *cpu,char actual_decision)
             update_btb_entry(cpu,'T');
         cpu->pc = cpu->execute.pc + cpu->execute.imm;
      cpu->fetch_from_next_cycle = TRUE;
+     cpu->stats.bp_mispredicts++;
+     APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
      cpu->decode.has_insn = FALSE;
      cpu->fetch.has_insn = TRUE;
         }
@@ -718,6 +898,8 @@ void branch_updation(APEX_CPU *cpu,char actual_decision)
         update_btb_entry(cpu,'T');
         cpu->pc = cpu->execute.pc + cpu->execute.imm;
      cpu->fetch_from_next_cycle = TRUE;
+     cpu->stats.bp_mispredicts++;
+     APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
      cpu->decode.has_insn = FALSE;
      cpu->fetch.has_insn = TRUE;
     }
@@ -731,6 +913,8 @@ void branch_updation(APEX_CPU *cpu,char actual_decision)
             update_btb_entry(cpu,'N');
             cpu->pc = cpu->execute.pc +4;
             cpu->fetch_from_next_cycle = TRUE;
+            cpu->stats.bp_mispredicts++;
+            APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
         cpu->decode.has_insn = FALSE;
      cpu->fetch.has_insn = TRUE;
         }
@@ -749,6 +933,9 @@ void branch_instruction(APEX_CPU *cpu)
     /* Since we are using reverse callbacks for pipeline stages,
      * this will prevent the new instruction from being fetched in the current cycle*/
     cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.branches_taken++;
+    cpu->stats.bp_mispredicts++;
+    APEX_bpred_repair(&cpu->bpred, &cpu->execute.bp_info);
 
     /* Flush previous stages */
     cpu->decode.has_insn = FALSE;
@@ -778,6 +965,42 @@ void set_condition_codes(APEX_CPU *cpu)
     }
 }
 
+/*
+ * Looks the access of the instruction in memory up in the data caches on its
+ * first cycle and counts down the cycles it takes
+ *
+ * Returns TRUE once the access is done, or if the instruction has none.
+ */
+static int
+data_access_done(APEX_CPU *cpu)
+{
+    switch (cpu->memory.opcode)
+    {
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        if (!cpu->mem_cycles_left)
+        {
+            int is_write = (cpu->memory.opcode == OPCODE_STORE || cpu->memory.opcode == OPCODE_STOREP);
+            long long ready_cycle;
+
+            cpu->mem_cycles_left = APEX_dcache_access(&cpu->caches, cpu->memory.pc, cpu->memory.memory_address,
+                                                      is_write, cpu->clock, &ready_cycle);
+            cpu->stats.stall_cycles[STALL_MEMORY] += cpu->mem_cycles_left - 1;
+            if (!is_write)
+            {
+                cpu->load_ready_cycle[cpu->memory.rd] = (int)ready_cycle;
+            }
+        }
+        cpu->mem_cycles_left--;
+        return !cpu->mem_cycles_left;
+    }
+    }
+    return TRUE;
+}
+
 /*
  * Memory Stage of APEX Pipeline
  *
@@ -788,6 +1011,15 @@ APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        if (!data_access_done(cpu))
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Memory", &cpu->memory);
+            }
+            return;
+        }
+
         switch (cpu->memory.opcode)
         {
         case OPCODE_ADDL:
@@ -811,6 +1043,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Read from data memory */
             cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+            cpu->stats.mem_reads++;
             break;
         }
         case OPCODE_STORE:
@@ -818,6 +1051,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             break;
         }
         }
@@ -848,6 +1082,7 @@ APEX_writeback(APEX_CPU *cpu)
         {
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         case OPCODE_AND:
@@ -907,6 +1142,7 @@ APEX_writeback(APEX_CPU *cpu)
             cpu->status = TRUE;
         }
         cpu->insn_completed++;
+        cpu->stats.retired[cpu->writeback.opcode]++;
         cpu->writeback.has_insn = FALSE;
 
         if (ENABLE_DEBUG_MESSAGES)
@@ -937,6 +1173,12 @@ void init_btb()
 int predict_branch(APEX_CPU *cpu) {
         int i = cpu->fetch.btb_probe_index;
         if (btb[i].valid && btb[i].inst_address == cpu->fetch.pc) {
+            if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+            {
+                /* The BTB only gave the target, the direction comes from the predictor */
+                cpu->fetch.predicted_decision = cpu->fetch.bp_info.taken;
+                return cpu->fetch.predicted_decision;
+            }
             if((btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 1) || (btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 0))
             {
 
@@ -1009,6 +1251,8 @@ int is_btb_hit(APEX_CPU *cpu) {
     cpu->fetch.btb_hit = FALSE;
     return -1;
 }
+
+/* Allocates a BTB entry in decode, with the PC relative target predecode already knows */
 void create_btb_entry(APEX_CPU *cpu)
 {
     int i=0;
@@ -1018,6 +1262,7 @@ void create_btb_entry(APEX_CPU *cpu)
         {
             btb[i].valid = 1;
             btb[i].inst_address = cpu->decode.pc;
+            btb[i].target_address = cpu->decode.pc + cpu->decode.imm;
             if(cpu->decode.opcode == OPCODE_BNZ || cpu->decode.opcode == OPCODE_BP)
             {
                 btb[i].prev_outcome[0] = 1;
@@ -1041,6 +1286,7 @@ void create_btb_entry(APEX_CPU *cpu)
         }
         btb[i].valid = 1;
             btb[i].inst_address = cpu->decode.pc;
+            btb[i].target_address = cpu->decode.pc + cpu->decode.imm;
             if(cpu->decode.opcode == OPCODE_BNZ || cpu->decode.opcode == OPCODE_BP)
             {
                 btb[i].prev_outcome[0] = 1;
@@ -1062,7 +1308,7 @@ void create_btb_entry(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const char *config_file)
 {
     int i;
     APEX_CPU *cpu;
@@ -1086,11 +1332,30 @@ APEX_cpu_init(const char *filename)
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = DISABLE_SINGLE_STEP;
     cpu->status = TRUE;
+    APEX_config_init(&cpu->config);
+    if (config_file && !APEX_config_load(&cpu->config, config_file))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_caches_init(&cpu->caches, &cpu->config))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_bpred_init(&cpu->bpred, &cpu->config))
+    {
+        APEX_caches_free(&cpu->caches);
+        free(cpu);
+        return NULL;
+    }
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     init_btb();
     if (!cpu->code_memory)
     {
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
         free(cpu);
         return NULL;
     }
@@ -1115,8 +1380,27 @@ APEX_cpu_init(const char *filename)
 
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
+    APEX_stats_interval_open(&cpu->interval, &cpu->config, &cpu->stats);
     return cpu;
 }
+
+/* Writes every counter to the statistics file at the end of a run */
+static void
+dump_stats(APEX_CPU *cpu, int cycles)
+{
+    APEX_StatsWriter writer;
+
+    if (!APEX_stats_open(&writer, &cpu->config, APEX_MODEL_NAME))
+    {
+        return;
+    }
+    APEX_stats_put(&writer, "cycles", cycles);
+    APEX_stats_put(&writer, "insn_completed", cpu->insn_completed);
+    APEX_stats_put_common(&writer, &cpu->stats);
+    APEX_caches_put_stats(&writer, &cpu->caches, cpu->insn_completed);
+    APEX_bpred_put_stats(&writer, &cpu->bpred);
+    APEX_stats_close(&writer);
+}
 static void print_mem(const APEX_CPU *cpu, int *address)
 {
    if(address)
@@ -1162,6 +1446,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                     /* Halt in writeback stage */
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                    APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                    dump_stats(cpu, cpu->clock + 1);
                     return;
                 }
 
@@ -1170,10 +1456,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 APEX_decode(cpu);
                 APEX_fetch(cpu);
                 cpu->clock++;
+                APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
                 if (no_of_cycles == cpu->clock)
                 {
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Stopped after = %d cycles  instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     return;
                 }
             }
@@ -1192,6 +1480,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             {
                 /* Halt in writeback stage */
                 printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                dump_stats(cpu, cpu->clock + 1);
                 break;
             }
 
@@ -1208,11 +1498,13 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
                 {
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     break;
                 }
             }
 
             cpu->clock++;
+            APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
         }
 
         else if (command == 5)
@@ -1232,5 +1524,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu)
+    {
+        /* A run stopped before HALT may have been resumed, so the time series ends here */
+        APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock);
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
+    }
     free(cpu);
 }
\ No newline at end of file
@@ -0,0 +1,17 @@
+/*
+ * apex_divider.h
+ * Contains the APEX divide unit declarations
+ *
+ * The divider is not pipelined. A DIV holds the unit for its whole latency,
+ * which is config.div_latency for a full width quotient. With early-out the
+ * divider stops once every quotient bit is known, so a DIV of small operands
+ * finishes sooner.
+ */
+#ifndef _APEX_DIVIDER_H_
+#define _APEX_DIVIDER_H_
+
+#include "apex_config.h"
+
+int APEX_div_latency(const APEX_Config *config, int dividend, int divisor);
+int APEX_div_result(int dividend, int divisor);
+#endif
@@ -0,0 +1,113 @@
+/*
+ * apex_bpred.h
+ * Contains the APEX branch direction predictor declarations
+ *
+ * The BTB still supplies branch targets. With bp_predictor = btb the 2 bit
+ * counter kept in every BTB entry also gives the direction, as it always
+ * did. Any other predictor gives the direction of every conditional branch
+ * from its own tables, which are indexed by instruction address and, for
+ * the history based ones, by the outcomes of earlier branches.
+ *
+ * Histories are updated when a branch resolves, not when it is predicted,
+ * so nothing has to be repaired after a misprediction. A prediction keeps
+ * the histories it was made with, and the update trains the same entries.
+ *
+ * Targets of JUMP and JALR come from a return address stack and an
+ * indirect target table. Every JALR pushes its return address, and a JUMP
+ * through the link register of the newest entry with no offset is taken
+ * as a return and pops it. Any other JUMP or JALR looks up the target it
+ * jumped to last time. The stack is changed in fetch, so every fetched
+ * instruction saves the top of it, and an instruction that redirects fetch
+ * puts that back before the instructions behind it are fetched again.
+ */
+#ifndef _APEX_BPRED_H_
+#define _APEX_BPRED_H_
+
+#include "apex_config.h"
+#include "apex_stats.h"
+
+/* Tagged tables of the TAGE predictor, behind its bimodal base table */
+#define TAGE_TABLES 4
+
+/* Return address pushed by one JALR */
+typedef struct APEX_RasEntry
+{
+    int return_pc;
+    int link_reg;               /* Register the JALR wrote the return address to */
+} APEX_RasEntry;
+
+/* Top of the return address stack, as it was after one instruction was fetched */
+typedef struct APEX_RasCheckpoint
+{
+    int top;
+    int count;
+    APEX_RasEntry entry;        /* Entry at top, a later push may overwrite it */
+} APEX_RasCheckpoint;
+
+/* Predictions fetch made for one instruction, travels with it */
+typedef struct APEX_BpredInfo
+{
+    int taken;                  /* Direction predicted */
+    unsigned long long history; /* Global outcomes, the latest in bit 0 */
+    int local_history;          /* Outcomes of this branch, the latest in bit 0 */
+    int target;                 /* Target fetch followed for a JUMP or JALR, -1 if it went on to pc + 4 */
+    int from_ras;               /* The target was popped off the return address stack */
+    APEX_RasCheckpoint ras;
+} APEX_BpredInfo;
+
+/* Last target of one JUMP or JALR */
+typedef struct APEX_IndirectEntry
+{
+    int valid;
+    int pc;
+    int target;
+} APEX_IndirectEntry;
+
+/* Entry of one tagged TAGE table */
+typedef struct APEX_TageEntry
+{
+    int tag;
+    int ctr;                    /* 3 bit signed counter, taken if not negative */
+    int useful;                 /* 2 bit usefulness, 0 if the entry can be replaced */
+} APEX_TageEntry;
+
+typedef struct APEX_BranchPredictor
+{
+    int kind;                   /* BP_PREDICTOR_* */
+    int table_bits;             /* log2 of the entries of the counter tables */
+    int history_bits;           /* Outcomes kept by the global and the local histories */
+    int local_table_bits;       /* log2 of the branches with a local history */
+    int tage_table_bits;        /* log2 of the entries of every tagged table */
+    unsigned char *counters;    /* 2 bit counters indexed by address, bimodal and TAGE base */
+    unsigned char *global_counters; /* 2 bit counters indexed by address xor global history */
+    unsigned char *local_counters;  /* 2 bit counters indexed by local history */
+    unsigned char *choice;      /* 2 bit counters, set picks the global prediction */
+    int *local_history;
+    APEX_TageEntry *tage[TAGE_TABLES];
+    unsigned long long history; /* Global history of resolved branches */
+    long long updates;
+    long long global_chosen;    /* Tournament predictions that came from gshare */
+    long long tage_provided;    /* TAGE predictions that came from a tagged table */
+    long long tage_allocations; /* Tagged entries claimed after a misprediction */
+    int ras_size;               /* Entries of the return address stack, 0 if there is none */
+    int ras_top;                /* Newest entry, the stack wraps and drops the oldest when full */
+    int ras_count;
+    APEX_RasEntry ras[MAX_RAS_SIZE];
+    int indirect_size;          /* Entries of the indirect target table, 0 if there is none */
+    APEX_IndirectEntry *indirect;
+    long long ras_predictions;  /* Returns that took their target from the stack */
+    long long ras_mispredicts;
+    long long indirect_predictions; /* JUMPs and JALRs that found a target in the table */
+    long long indirect_mispredicts;
+} APEX_BranchPredictor;
+
+int APEX_bpred_init(APEX_BranchPredictor *bp, const APEX_Config *config);
+int APEX_bpred_predict(APEX_BranchPredictor *bp, int pc, APEX_BpredInfo *info);
+void APEX_bpred_update(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int taken);
+int APEX_bpred_predict_jump(APEX_BranchPredictor *bp, int pc, int opcode, int rd, int rs1, int imm,
+                            APEX_BpredInfo *info);
+int APEX_bpred_resolve_jump(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int target);
+void APEX_bpred_repair(APEX_BranchPredictor *bp, const APEX_BpredInfo *info);
+void APEX_bpred_put_stats(APEX_StatsWriter *writer, const APEX_BranchPredictor *bp);
+void APEX_bpred_free(APEX_BranchPredictor *bp);
+#endif
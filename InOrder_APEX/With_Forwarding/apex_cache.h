@@ -0,0 +1,99 @@
+/*
+ * apex_cache.h
+ * Contains the APEX cache hierarchy declarations
+ *
+ * The caches only model timing. Tags, dirty bits and replacement state are
+ * kept per block, values always live in data_memory, so a cache can never
+ * change what a program computes, only how long its accesses take.
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include "apex_config.h"
+#include "apex_dram.h"
+#include "apex_stats.h"
+
+/* Entries of the stride prefetcher table, indexed by instruction address */
+#define STRIDE_TABLE_SIZE 16
+
+/* Tag and replacement state of one cache block */
+typedef struct APEX_CacheBlock
+{
+    int valid;
+    int dirty;
+    int tag;
+    long long last_use;         /* Access count of the last touch, for LRU */
+    int rrpv;                   /* Re-reference prediction value, for RRIP */
+    int prefetched;             /* Filled by the prefetcher and not demanded yet */
+    long long ready_cycle;      /* Cycle the fill of an instruction line arrives */
+} APEX_CacheBlock;
+
+/* One level of the hierarchy */
+typedef struct APEX_Cache
+{
+    const char *name;           /* Used in the statistics names */
+    APEX_CacheConfig config;
+    int sets;
+    APEX_CacheBlock *blocks;    /* sets * config.assoc blocks, one set after the other */
+    struct APEX_Cache *next;    /* Next level, NULL if data memory is behind this one */
+    APEX_Dram *memory;          /* Main memory, behind this level when next is NULL */
+    long long accesses;
+    unsigned int random_state;  /* Victim choice of the random policy, fixed seed */
+    long long reads;
+    long long read_misses;
+    long long writes;
+    long long write_misses;
+    long long evictions;        /* Valid blocks replaced by a fill */
+    long long writebacks;       /* Dirty blocks written to the next level */
+    long long prefetches;       /* Lines filled by the prefetcher */
+    long long useful_prefetches; /* Prefetched lines later demanded */
+} APEX_Cache;
+
+/* Miss status holding register, one line on its way into l1d */
+typedef struct APEX_Mshr
+{
+    unsigned int line;
+    long long ready_cycle;      /* Cycle the line arrives, the register is free after it */
+} APEX_Mshr;
+
+/* Stride of the data accesses of one instruction, an entry of the prefetcher table */
+typedef struct APEX_StrideEntry
+{
+    int valid;
+    int pc;                     /* Instruction the entry tracks */
+    int last_address;
+    int stride;                 /* Bytes between its last two accesses */
+    int confidence;             /* Times in a row the stride repeated, saturating */
+} APEX_StrideEntry;
+
+/* Instruction and data caches, with the optional L2 shared behind both */
+typedef struct APEX_CacheHierarchy
+{
+    int enabled;                /* FALSE if l1d_size is 0, every access then takes one cycle */
+    int mshrs;                  /* MSHRs of l1d, 0 if a miss holds the pipeline until it is filled */
+    APEX_Mshr mshr[MAX_MSHRS];
+    long long mshr_merges;      /* Misses to a line an MSHR already fetches */
+    long long mshr_full_cycles; /* Cycles misses waited for a free MSHR */
+    int stride_prefetch;        /* Prefetch l1d lines ahead of instructions with a steady stride */
+    int prefetch_degree;        /* Lines prefetched per triggering access */
+    int prefetch_distance;      /* Strides ahead of the access the first prefetch goes */
+    APEX_StrideEntry stride_table[STRIDE_TABLE_SIZE];
+    long long late_prefetches;  /* Demand accesses to a prefetched l1d line still in flight */
+    int icache_enabled;         /* FALSE if l1i_size is 0, fetch then never waits */
+    int next_line_prefetch;     /* Prefetch the line after every line fetch moves to */
+    int fetch_line;             /* Line fetch last looked up, -1 before the first */
+    APEX_Cache l1d;
+    APEX_Cache l1i;
+    APEX_Cache l2;              /* Only in use if l2_size is not 0 */
+    APEX_Dram dram;
+} APEX_CacheHierarchy;
+
+int APEX_caches_init(APEX_CacheHierarchy *caches, const APEX_Config *config);
+int APEX_dcache_access(APEX_CacheHierarchy *caches, int pc, int address, int is_write, long long now,
+                       long long *ready_cycle);
+int APEX_icache_fetch(APEX_CacheHierarchy *caches, int pc, long long now);
+void APEX_icache_prefetch(APEX_CacheHierarchy *caches, int pc, long long now);
+void APEX_caches_put_stats(APEX_StatsWriter *writer, const APEX_CacheHierarchy *caches,
+                           long long insn_completed);
+void APEX_caches_free(APEX_CacheHierarchy *caches);
+#endif
@@ -155,17 +155,33 @@ APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
 
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->fetch.has_insn)
     {
         /* This fetches new branch target instruction from next cycle */
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.stall_cycles[STALL_BRANCH_REDIRECT]++;
 
             /* Skip this cycle*/
             return;
         }
 
+        /* Wait for the line holding pc to arrive in the instruction cache */
+        if (!APEX_icache_fetch(&cpu->caches, cpu->pc, cpu->clock))
+        {
+            /* Decode has passed its instruction on, it gets a bubble */
+            cpu->decode.has_insn = FALSE;
+            cpu->stats.stall_cycles[STALL_ICACHE]++;
+            return;
+        }
+
         /* Store current PC in fetch latch */
         cpu->fetch.pc = cpu->pc;
 
@@ -199,6 +215,76 @@ APEX_fetch(APEX_CPU *cpu)
     }
 }
 
+/* Returns TRUE if register is loaded by a missed load whose data has not arrived */
+static int
+load_pending(const APEX_CPU *cpu, int reg)
+{
+    return cpu->load_ready_cycle[reg] > cpu->clock;
+}
+
+/*
+ * Returns TRUE if the instruction in execute reads a register a missed load
+ * has not filled yet
+ */
+static int
+waits_on_load(const APEX_CPU *cpu)
+{
+    switch (cpu->execute.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        return load_pending(cpu, cpu->execute.rs1) || load_pending(cpu, cpu->execute.rs2);
+    }
+
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_CML:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JUMP:
+    case OPCODE_JALR:
+    {
+        return load_pending(cpu, cpu->execute.rs1);
+    }
+    }
+    return FALSE;
+}
+
+/* Returns TRUE if opcode writes its rd register */
+static int
+writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JALR:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
@@ -207,6 +293,12 @@ APEX_fetch(APEX_CPU *cpu)
 static void
 APEX_decode(APEX_CPU *cpu)
 {
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->decode.has_insn)
     {
 
@@ -218,6 +310,7 @@ APEX_decode(APEX_CPU *cpu)
         case OPCODE_OR:
         case OPCODE_XOR:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_SUB:
         case OPCODE_ADD:
         case OPCODE_STORE:
@@ -300,6 +393,7 @@ void data_forwarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_STORE:
     case OPCODE_STOREP:
     case OPCODE_CMP:
@@ -457,6 +551,7 @@ void score_boarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
@@ -611,6 +706,25 @@ void score_boarding(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
+    /* The access in memory has not finished, keep this instruction */
+    if (cpu->mem_cycles_left)
+    {
+        return;
+    }
+
+    /* Memory gets bubbles until the data of a missed load a source needs is in */
+    cpu->load_use_hold = cpu->execute.has_insn && waits_on_load(cpu);
+    if (cpu->load_use_hold)
+    {
+        cpu->stats.stall_cycles[STALL_MEMORY]++;
+        return;
+    }
+    if (cpu->execute.has_insn && writes_rd(cpu->execute.opcode))
+    {
+        /* A later write replaces whatever an older missed load brings into rd */
+        cpu->load_ready_cycle[cpu->execute.rd] = 0;
+    }
+
     if (cpu->execute.has_insn)
     {
         cpu->no_forward = FALSE;
@@ -648,6 +762,38 @@ APEX_execute(APEX_CPU *cpu)
             break;
         }
 
+        case OPCODE_DIV:
+        {
+            /* The divider is not pipelined, the DIV stays in execute, and
+             * holds the front end, until its last cycle */
+            if (!cpu->div_cycles_left)
+            {
+                cpu->div_cycles_left = APEX_div_latency(&cpu->config, cpu->execute.rs1_value, cpu->execute.rs2_value);
+                cpu->stats.div_ops++;
+                if (cpu->div_cycles_left < cpu->config.div_latency)
+                {
+                    cpu->stats.div_early_outs++;
+                }
+            }
+            cpu->stats.div_busy_cycles++;
+            cpu->div_cycles_left--;
+            if (cpu->div_cycles_left)
+            {
+                cpu->stats.stall_cycles[STALL_STRUCTURAL]++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Execute", &cpu->execute);
+                }
+                return;
+            }
+            cpu->execute.result_buffer = APEX_div_result(cpu->execute.rs1_value, cpu->execute.rs2_value);
+
+            /* Set the zero flag based on the result buffer */
+            set_condition_codes(cpu);
+            data_forwarding(cpu);
+            break;
+        }
+
         case OPCODE_LOAD:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
@@ -697,6 +843,7 @@ APEX_execute(APEX_CPU *cpu)
 
         case OPCODE_BZ:
         {
+            cpu->stats.branches++;
             cpu->no_forward = TRUE;
             if (cpu->zero_flag == TRUE)
             {
@@ -707,6 +854,7 @@ APEX_execute(APEX_CPU *cpu)
 
         case OPCODE_BNZ:
         {
+            cpu->stats.branches++;
             cpu->no_forward = TRUE;
             if (cpu->zero_flag == FALSE)
             {
@@ -717,6 +865,7 @@ APEX_execute(APEX_CPU *cpu)
         case OPCODE_BP:
             cpu->no_forward = TRUE;
         {
+            cpu->stats.branches++;
             if (cpu->poisitve_flag == TRUE)
             {
                 branch_instruction(cpu);
@@ -725,6 +874,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNP:
         {
+            cpu->stats.branches++;
             cpu->no_forward = TRUE;
             if (cpu->poisitve_flag == FALSE)
             {
@@ -734,6 +884,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BN:
         {
+            cpu->stats.branches++;
             cpu->no_forward = TRUE;
             if (cpu->negative_flag == TRUE)
             {
@@ -743,6 +894,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNN:
         {
+            cpu->stats.branches++;
             cpu->no_forward = TRUE;
             if (cpu->negative_flag == FALSE)
             {
@@ -864,6 +1016,8 @@ void branch_instruction(APEX_CPU *cpu)
     /* Since we are using reverse callbacks for pipeline stages,
      * this will prevent the new instruction from being fetched in the current cycle*/
     cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.branches_taken++;
+    cpu->stats.bp_mispredicts++;
 
     /* Flush previous stages */
     cpu->decode.has_insn = FALSE;
@@ -894,6 +1048,42 @@ void set_condition_codes(APEX_CPU *cpu)
     }
 }
 
+/*
+ * Looks the access of the instruction in memory up in the data caches on its
+ * first cycle and counts down the cycles it takes
+ *
+ * Returns TRUE once the access is done, or if the instruction has none.
+ */
+static int
+data_access_done(APEX_CPU *cpu)
+{
+    switch (cpu->memory.opcode)
+    {
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        if (!cpu->mem_cycles_left)
+        {
+            int is_write = (cpu->memory.opcode == OPCODE_STORE || cpu->memory.opcode == OPCODE_STOREP);
+            long long ready_cycle;
+
+            cpu->mem_cycles_left = APEX_dcache_access(&cpu->caches, cpu->memory.pc, cpu->memory.memory_address,
+                                                      is_write, cpu->clock, &ready_cycle);
+            cpu->stats.stall_cycles[STALL_MEMORY] += cpu->mem_cycles_left - 1;
+            if (!is_write)
+            {
+                cpu->load_ready_cycle[cpu->memory.rd] = (int)ready_cycle;
+            }
+        }
+        cpu->mem_cycles_left--;
+        return !cpu->mem_cycles_left;
+    }
+    }
+    return TRUE;
+}
+
 /*
  * Memory Stage of APEX Pipeline
  *
@@ -904,6 +1094,15 @@ APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        if (!data_access_done(cpu))
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Memory", &cpu->memory);
+            }
+            return;
+        }
+
         cpu->no_forward = FALSE;
         cpu->memory_update_rs1 = FALSE;
         cpu->memory_update_rs2 = FALSE;
@@ -922,6 +1121,7 @@ APEX_memory(APEX_CPU *cpu)
         case OPCODE_JALR:
         case OPCODE_MOVC:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         {
             data_forwarding(cpu);
             /* No work for ADD */
@@ -934,6 +1134,7 @@ APEX_memory(APEX_CPU *cpu)
             /* Read from data memory */
             printf("Data from calculated memory address is Mem[%d]: %d", cpu->memory.memory_address,cpu->data_memory[cpu->memory.memory_address]);
             cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+            cpu->stats.mem_reads++;
             data_forwarding(cpu);
             break;
         }
@@ -941,12 +1142,14 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             break;
         }
         case OPCODE_STOREP:
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             data_forwarding(cpu);
             break;
         }
@@ -978,6 +1181,7 @@ APEX_writeback(APEX_CPU *cpu)
         {
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         case OPCODE_AND:
@@ -1032,6 +1236,7 @@ APEX_writeback(APEX_CPU *cpu)
             cpu->status = TRUE;
         }
         cpu->insn_completed++;
+        cpu->stats.retired[cpu->writeback.opcode]++;
         cpu->writeback.has_insn = FALSE;
 
         if (ENABLE_DEBUG_MESSAGES)
@@ -1056,7 +1261,7 @@ APEX_writeback(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const char *config_file)
 {
     int i;
     APEX_CPU *cpu;
@@ -1080,10 +1285,22 @@ APEX_cpu_init(const char *filename)
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = DISABLE_SINGLE_STEP;
     cpu->status = TRUE;
+    APEX_config_init(&cpu->config);
+    if (config_file && !APEX_config_load(&cpu->config, config_file))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_caches_init(&cpu->caches, &cpu->config))
+    {
+        free(cpu);
+        return NULL;
+    }
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     if (!cpu->code_memory)
     {
+        APEX_caches_free(&cpu->caches);
         free(cpu);
         return NULL;
     }
@@ -1108,8 +1325,26 @@ APEX_cpu_init(const char *filename)
 
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
+    APEX_stats_interval_open(&cpu->interval, &cpu->config, &cpu->stats);
     return cpu;
 }
+
+/* Writes every counter to the statistics file at the end of a run */
+static void
+dump_stats(APEX_CPU *cpu, int cycles)
+{
+    APEX_StatsWriter writer;
+
+    if (!APEX_stats_open(&writer, &cpu->config, APEX_MODEL_NAME))
+    {
+        return;
+    }
+    APEX_stats_put(&writer, "cycles", cycles);
+    APEX_stats_put(&writer, "insn_completed", cpu->insn_completed);
+    APEX_stats_put_common(&writer, &cpu->stats);
+    APEX_caches_put_stats(&writer, &cpu->caches, cpu->insn_completed);
+    APEX_stats_close(&writer);
+}
 static void print_mem(const APEX_CPU *cpu, int address)
 {
    if(address !=0)
@@ -1155,6 +1390,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                     /* Halt in writeback stage */
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                    APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                    dump_stats(cpu, cpu->clock + 1);
                     return;
                 }
 
@@ -1163,10 +1400,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 APEX_decode(cpu);
                 APEX_fetch(cpu);
                 cpu->clock++;
+                APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
                 if (no_of_cycles == cpu->clock)
                 {
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Stopped after = %d cycles  instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     return;
                 }
             }
@@ -1185,6 +1424,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             {
                 /* Halt in writeback stage */
                 printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                dump_stats(cpu, cpu->clock + 1);
                 break;
             }
 
@@ -1202,11 +1443,13 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
                 {
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     break;
                 }
             }
 
             cpu->clock++;
+            APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
         }
 
         else if (command == 5)
@@ -1226,5 +1469,11 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu)
+    {
+        /* A run stopped before HALT may have been resumed, so the time series ends here */
+        APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock);
+        APEX_caches_free(&cpu->caches);
+    }
     free(cpu);
 }
\ No newline at end of file
@@ -9,7 +9,14 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include "apex_cache.h"
+#include "apex_config.h"
+#include "apex_divider.h"
 #include "apex_macros.h"
+#include "apex_stats.h"
+
+/* Model name reported in the statistics dump */
+#define APEX_MODEL_NAME "in_order_forwarding"
 
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
@@ -62,6 +69,14 @@ typedef struct APEX_CPU
     int memory_update_rs2;
     int rs1_updated;
     int rs2_updated;
+    int div_cycles_left;           /* Cycles the DIV in execute still needs, 0 if none */
+    int mem_cycles_left;           /* Cycles the access in memory still needs, 0 if none */
+    int load_ready_cycle[REG_FILE_SIZE]; /* Last cycle before the data loaded into a register arrives */
+    int load_use_hold;             /* Decode waits for the data of a missed load */
+    APEX_Config config;            /* Run-time configuration */
+    APEX_CacheHierarchy caches;    /* Data caches in front of data_memory */
+    APEX_Stats stats;              /* Counters for the statistics dump */
+    APEX_StatsInterval interval;   /* Per-interval time series */
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -72,7 +87,7 @@ typedef struct APEX_CPU
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+APEX_CPU *APEX_cpu_init(const char *filename, const char *config_file);
 void APEX_cpu_run(APEX_CPU *cpu, int command);
 void APEX_cpu_stop(APEX_CPU *cpu);
 void set_condition_codes(APEX_CPU *cpu);
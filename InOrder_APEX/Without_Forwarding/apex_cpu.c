@@ -157,17 +157,33 @@ APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
 
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->fetch.has_insn)
     {
         /* This fetches new branch target instruction from next cycle */
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.stall_cycles[STALL_BRANCH_REDIRECT]++;
 
             /* Skip this cycle*/
             return;
         }
 
+        /* Wait for the line holding pc to arrive in the instruction cache */
+        if (!APEX_icache_fetch(&cpu->caches, cpu->pc, cpu->clock))
+        {
+            /* Decode has passed its instruction on, it gets a bubble */
+            cpu->decode.has_insn = FALSE;
+            cpu->stats.stall_cycles[STALL_ICACHE]++;
+            return;
+        }
+
         /* Store current PC in fetch latch */
         cpu->fetch.pc = cpu->pc;
 
@@ -208,6 +224,76 @@ APEX_fetch(APEX_CPU *cpu)
     }
 }
 
+/* Returns TRUE if register is loaded by a missed load whose data has not arrived */
+static int
+load_pending(const APEX_CPU *cpu, int reg)
+{
+    return cpu->load_ready_cycle[reg] > cpu->clock;
+}
+
+/*
+ * Returns TRUE if the instruction in execute reads a register a missed load
+ * has not filled yet
+ */
+static int
+waits_on_load(const APEX_CPU *cpu)
+{
+    switch (cpu->execute.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_CMP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        return load_pending(cpu, cpu->execute.rs1) || load_pending(cpu, cpu->execute.rs2);
+    }
+
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_CML:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JUMP:
+    case OPCODE_JALR:
+    {
+        return load_pending(cpu, cpu->execute.rs1);
+    }
+    }
+    return FALSE;
+}
+
+/* Returns TRUE if opcode writes its rd register */
+static int
+writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_JALR:
+    {
+        return TRUE;
+    }
+    }
+    return FALSE;
+}
+
 /*
  * Decode Stage of APEX Pipeline
  *
@@ -216,6 +302,12 @@ APEX_fetch(APEX_CPU *cpu)
 static void
 APEX_decode(APEX_CPU *cpu)
 {
+    /* A DIV in execute, a cache miss in memory or a load-use wait holds the front end */
+    if (cpu->div_cycles_left || cpu->mem_cycles_left || cpu->load_use_hold)
+    {
+        return;
+    }
+
     if (cpu->decode.has_insn)
     {
 
@@ -227,6 +319,7 @@ APEX_decode(APEX_CPU *cpu)
         case OPCODE_OR:
         case OPCODE_XOR:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_SUB:
         case OPCODE_ADD:
         case OPCODE_STORE:
@@ -269,6 +362,10 @@ APEX_decode(APEX_CPU *cpu)
         }
         }
         score_boarding(cpu);
+        if (!cpu->status)
+        {
+            cpu->stats.stall_cycles[STALL_DATA_HAZARD]++;
+        }
         if (ENABLE_DEBUG_MESSAGES)
         {
             print_stage_content("Decode/RF", &cpu->decode);
@@ -282,6 +379,7 @@ void score_boarding(APEX_CPU *cpu)
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
@@ -432,6 +530,25 @@ void score_boarding(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
+    /* The access in memory has not finished, keep this instruction */
+    if (cpu->mem_cycles_left)
+    {
+        return;
+    }
+
+    /* Memory gets bubbles until the data of a missed load a source needs is in */
+    cpu->load_use_hold = cpu->execute.has_insn && waits_on_load(cpu);
+    if (cpu->load_use_hold)
+    {
+        cpu->stats.stall_cycles[STALL_MEMORY]++;
+        return;
+    }
+    if (cpu->execute.has_insn && writes_rd(cpu->execute.opcode))
+    {
+        /* A later write replaces whatever an older missed load brings into rd */
+        cpu->load_ready_cycle[cpu->execute.rd] = 0;
+    }
+
     if (cpu->execute.has_insn)
     {
         /* Execute logic based on instruction type */
@@ -463,6 +580,37 @@ APEX_execute(APEX_CPU *cpu)
             break;
         }
 
+        case OPCODE_DIV:
+        {
+            /* The divider is not pipelined, the DIV stays in execute, and
+             * holds the front end, until its last cycle */
+            if (!cpu->div_cycles_left)
+            {
+                cpu->div_cycles_left = APEX_div_latency(&cpu->config, cpu->execute.rs1_value, cpu->execute.rs2_value);
+                cpu->stats.div_ops++;
+                if (cpu->div_cycles_left < cpu->config.div_latency)
+                {
+                    cpu->stats.div_early_outs++;
+                }
+            }
+            cpu->stats.div_busy_cycles++;
+            cpu->div_cycles_left--;
+            if (cpu->div_cycles_left)
+            {
+                cpu->stats.stall_cycles[STALL_STRUCTURAL]++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Execute", &cpu->execute);
+                }
+                return;
+            }
+            cpu->execute.result_buffer = APEX_div_result(cpu->execute.rs1_value, cpu->execute.rs2_value);
+
+            /* Set the zero flag based on the result buffer */
+            set_condition_codes(cpu);
+            break;
+        }
+
         case OPCODE_LOAD:
         {
             cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
@@ -507,6 +655,7 @@ APEX_execute(APEX_CPU *cpu)
 
         case OPCODE_BZ:
         {
+            cpu->stats.branches++;
             if (cpu->zero_flag == TRUE)
             {
                 branch_instruction(cpu);
@@ -516,6 +665,7 @@ APEX_execute(APEX_CPU *cpu)
 
         case OPCODE_BNZ:
         {
+            cpu->stats.branches++;
             if (cpu->zero_flag == FALSE)
             {
                 branch_instruction(cpu);
@@ -524,6 +674,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BP:
         {
+            cpu->stats.branches++;
             if (cpu->poisitve_flag == TRUE)
             {
                 branch_instruction(cpu);
@@ -532,6 +683,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNP:
         {
+            cpu->stats.branches++;
             if (cpu->poisitve_flag == FALSE)
             {
                 branch_instruction(cpu);
@@ -540,6 +692,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BN:
         {
+            cpu->stats.branches++;
             if (cpu->negative_flag == TRUE)
             {
                 branch_instruction(cpu);
@@ -548,6 +701,7 @@ APEX_execute(APEX_CPU *cpu)
         }
         case OPCODE_BNN:
         {
+            cpu->stats.branches++;
             if (cpu->negative_flag == FALSE)
             {
                 branch_instruction(cpu);
@@ -654,6 +808,8 @@ void branch_instruction(APEX_CPU *cpu)
     /* Since we are using reverse callbacks for pipeline stages,
      * this will prevent the new instruction from being fetched in the current cycle*/
     cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.branches_taken++;
+    cpu->stats.bp_mispredicts++;
 
     /* Flush previous stages */
     cpu->decode.has_insn = FALSE;
@@ -683,6 +839,42 @@ void set_condition_codes(APEX_CPU *cpu)
     }
 }
 
+/*
+ * Looks the access of the instruction in memory up in the data caches on its
+ * first cycle and counts down the cycles it takes
+ *
+ * Returns TRUE once the access is done, or if the instruction has none.
+ */
+static int
+data_access_done(APEX_CPU *cpu)
+{
+    switch (cpu->memory.opcode)
+    {
+    case OPCODE_LOAD:
+    case OPCODE_LOADP:
+    case OPCODE_STORE:
+    case OPCODE_STOREP:
+    {
+        if (!cpu->mem_cycles_left)
+        {
+            int is_write = (cpu->memory.opcode == OPCODE_STORE || cpu->memory.opcode == OPCODE_STOREP);
+            long long ready_cycle;
+
+            cpu->mem_cycles_left = APEX_dcache_access(&cpu->caches, cpu->memory.pc, cpu->memory.memory_address,
+                                                      is_write, cpu->clock, &ready_cycle);
+            cpu->stats.stall_cycles[STALL_MEMORY] += cpu->mem_cycles_left - 1;
+            if (!is_write)
+            {
+                cpu->load_ready_cycle[cpu->memory.rd] = (int)ready_cycle;
+            }
+        }
+        cpu->mem_cycles_left--;
+        return !cpu->mem_cycles_left;
+    }
+    }
+    return TRUE;
+}
+
 /*
  * Memory Stage of APEX Pipeline
  *
@@ -693,6 +885,15 @@ APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        if (!data_access_done(cpu))
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Memory", &cpu->memory);
+            }
+            return;
+        }
+
         switch (cpu->memory.opcode)
         {
         case OPCODE_ADDL:
@@ -716,6 +917,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Read from data memory */
             cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
+            cpu->stats.mem_reads++;
             break;
         }
         case OPCODE_STORE:
@@ -723,6 +925,7 @@ APEX_memory(APEX_CPU *cpu)
         {
             /* Write  data to memory */
             cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+            cpu->stats.mem_writes++;
             break;
         }
         }
@@ -753,6 +956,7 @@ APEX_writeback(APEX_CPU *cpu)
         {
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         case OPCODE_AND:
@@ -807,6 +1011,7 @@ APEX_writeback(APEX_CPU *cpu)
             cpu->status = TRUE;
         }
         cpu->insn_completed++;
+        cpu->stats.retired[cpu->writeback.opcode]++;
         cpu->writeback.has_insn = FALSE;
 
         if (ENABLE_DEBUG_MESSAGES)
@@ -831,7 +1036,7 @@ APEX_writeback(APEX_CPU *cpu)
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const char *config_file)
 {
     int i;
     APEX_CPU *cpu;
@@ -855,10 +1060,22 @@ APEX_cpu_init(const char *filename)
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = DISABLE_SINGLE_STEP;
     cpu->status = TRUE;
+    APEX_config_init(&cpu->config);
+    if (config_file && !APEX_config_load(&cpu->config, config_file))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_caches_init(&cpu->caches, &cpu->config))
+    {
+        free(cpu);
+        return NULL;
+    }
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     if (!cpu->code_memory)
     {
+        APEX_caches_free(&cpu->caches);
         free(cpu);
         return NULL;
     }
@@ -883,8 +1100,26 @@ APEX_cpu_init(const char *filename)
 
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
+    APEX_stats_interval_open(&cpu->interval, &cpu->config, &cpu->stats);
     return cpu;
 }
+
+/* Writes every counter to the statistics file at the end of a run */
+static void
+dump_stats(APEX_CPU *cpu, int cycles)
+{
+    APEX_StatsWriter writer;
+
+    if (!APEX_stats_open(&writer, &cpu->config, APEX_MODEL_NAME))
+    {
+        return;
+    }
+    APEX_stats_put(&writer, "cycles", cycles);
+    APEX_stats_put(&writer, "insn_completed", cpu->insn_completed);
+    APEX_stats_put_common(&writer, &cpu->stats);
+    APEX_caches_put_stats(&writer, &cpu->caches, cpu->insn_completed);
+    APEX_stats_close(&writer);
+}
 static void print_mem(const APEX_CPU *cpu, int *address)
 {
    if(address)
@@ -930,6 +1165,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                     /* Halt in writeback stage */
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                    APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                    dump_stats(cpu, cpu->clock + 1);
                     return;
                 }
 
@@ -938,10 +1175,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 APEX_decode(cpu);
                 APEX_fetch(cpu);
                 cpu->clock++;
+                APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
                 if (no_of_cycles == cpu->clock)
                 {
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Stopped after = %d cycles  instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     return;
                 }
             }
@@ -960,6 +1199,8 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             {
                 /* Halt in writeback stage */
                 printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock+1, cpu->insn_completed);
+                APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                dump_stats(cpu, cpu->clock + 1);
                 break;
             }
 
@@ -976,11 +1217,13 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
                 {
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     break;
                 }
             }
 
             cpu->clock++;
+            APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
         }
 
         else if (command == 5)
@@ -1000,5 +1243,11 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu)
+    {
+        /* A run stopped before HALT may have been resumed, so the time series ends here */
+        APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock);
+        APEX_caches_free(&cpu->caches);
+    }
     free(cpu);
 }
\ No newline at end of file
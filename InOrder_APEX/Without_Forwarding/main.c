@@ -18,18 +18,18 @@ main(int argc, char const *argv[])
     int command =  0;
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 2)
+    if (argc != 2 && argc != 3)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file> [config_file]\n", argv[0]);
         exit(1);
     }
-    else if(argc == 2){
+    else {
     while(1){
     printf("Enter a command:\n1.Initialize\n2.Simulate <no of cycles>\n3.Single_step\n4.Display\n5.ShowMem <address>\n6.quit\n");
     scanf("%d", &command);
     
     if(command == 1 ){
-        cpu = APEX_cpu_init(argv[1]);
+        cpu = APEX_cpu_init(argv[1], argc == 3 ? argv[2] : NULL);
     }
     else if(command >=2 && command <=5){
         if(cpu ==NULL || cpu->pc < 4000){
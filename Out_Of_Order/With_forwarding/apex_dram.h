@@ -0,0 +1,53 @@
+/*
+ * apex_dram.h
+ * Contains the APEX main memory timing model declarations
+ *
+ * Main memory sits behind the last cache level. Like the caches it only
+ * models timing, values always live in data_memory. Without the DRAM model
+ * every access takes config.mem_latency. With it, an address maps to a row
+ * of one bank, and an access costs tCAS if that row is open, tRCD + tCAS
+ * if the bank is precharged and tRP + tRCD + tCAS if another row is open,
+ * plus tBURST on the data bus all banks share. Rows stay open after an
+ * access.
+ */
+#ifndef _APEX_DRAM_H_
+#define _APEX_DRAM_H_
+
+#include "apex_config.h"
+#include "apex_stats.h"
+
+/* Row buffer and timing state of one bank */
+typedef struct APEX_DramBank
+{
+    int open_row;               /* -1 while the bank is precharged */
+    long long ready_cycle;      /* Cycle the bank takes its next command */
+} APEX_DramBank;
+
+typedef struct APEX_Dram
+{
+    int enabled;                /* FALSE if every access takes flat_latency */
+    int flat_latency;
+    int banks;
+    int row_size;               /* Bytes of one row of one bank */
+    int tcas;
+    int trcd;
+    int trp;
+    int tburst;
+    int queue_size;             /* Requests the controller holds at once */
+    APEX_DramBank bank[MAX_DRAM_BANKS];
+    long long queue[MAX_DRAM_QUEUE_SIZE]; /* Cycle each request held finishes, free once past */
+    long long bus_free_cycle;   /* Cycle the data bus is free again */
+    long long now;              /* Cycle of the access the caches are serving, set before each lookup */
+    long long reads;
+    long long writes;
+    long long row_hits;
+    long long row_empty;        /* Accesses to a precharged bank */
+    long long row_conflicts;    /* Accesses that closed another row first */
+    long long queue_full_cycles; /* Cycles requests waited for room in the controller */
+    long long bus_busy_cycles;  /* Cycles the data bus transferred bursts */
+} APEX_Dram;
+
+void APEX_dram_init(APEX_Dram *dram, const APEX_Config *config);
+int APEX_dram_access(APEX_Dram *dram, int address, int is_write);
+void APEX_dram_put_stats(APEX_StatsWriter *writer, const APEX_Dram *dram);
+#endif
@@ -0,0 +1,5 @@
+MOVC R0,#64
+MOVC R1,#5
+MOVC R2,#6
+CMP R1,R2
+HALT
@@ -0,0 +1,585 @@
+/*
+ * apex_bpred.c
+ * Contains the APEX branch direction predictors
+ *
+ * bimodal     2 bit counters indexed by address
+ * gshare      2 bit counters indexed by address xor global history
+ * local       2 bit counters indexed by the history of the branch itself
+ * tournament  local and gshare, with a choice table indexed by global
+ *             history picking which of the two to follow
+ * tage        a bimodal base table and tagged tables indexed by address and
+ *             global histories of growing length. The longest history that
+ *             hits gives the prediction, a misprediction claims an entry in
+ *             a table with a longer history.
+ *
+ * The counter tables start weakly taken, most APEX branches close loops.
+ *
+ * The indirect target table is indexed by address and tagged with it, an
+ * entry holds the target the instruction last jumped to.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_bpred.h"
+#include "apex_macros.h"
+
+/* Bits of the tag of a TAGE entry */
+#define TAGE_TAG_BITS 8
+
+/* Global history lengths of the tagged TAGE tables, shortest first */
+static const int tage_history_length[TAGE_TABLES] = {4, 8, 16, 32};
+
+static unsigned char *
+alloc_counters(int bits)
+{
+    unsigned char *counters = malloc((size_t)1 << bits);
+
+    if (counters)
+    {
+        memset(counters, 2, (size_t)1 << bits);
+    }
+    return counters;
+}
+
+int
+APEX_bpred_init(APEX_BranchPredictor *bp, const APEX_Config *config)
+{
+    int failed = FALSE;
+
+    memset(bp, 0, sizeof(APEX_BranchPredictor));
+    bp->kind = config->bp_predictor;
+    bp->table_bits = config->bp_table_bits;
+    bp->history_bits = config->bp_history_bits;
+    bp->local_table_bits = config->bp_local_table_bits;
+    bp->tage_table_bits = config->bp_tage_table_bits;
+    bp->ras_size = config->ras_size;
+    bp->ras_top = -1;
+    bp->indirect_size = config->indirect_table_size;
+    if (bp->indirect_size)
+    {
+        bp->indirect = calloc(bp->indirect_size, sizeof(APEX_IndirectEntry));
+        failed = !bp->indirect;
+    }
+
+    switch (bp->kind)
+    {
+    case BP_PREDICTOR_BIMODAL:
+        bp->counters = alloc_counters(bp->table_bits);
+        failed = failed || !bp->counters;
+        break;
+
+    case BP_PREDICTOR_GSHARE:
+        bp->global_counters = alloc_counters(bp->table_bits);
+        failed = failed || !bp->global_counters;
+        break;
+
+    case BP_PREDICTOR_TOURNAMENT:
+        bp->global_counters = alloc_counters(bp->table_bits);
+        bp->choice = alloc_counters(bp->table_bits);
+        failed = failed || !bp->global_counters || !bp->choice;
+        /* The local side is set up like the local predictor */
+        /* fall through */
+    case BP_PREDICTOR_LOCAL:
+        bp->local_counters = alloc_counters(bp->table_bits);
+        bp->local_history = calloc((size_t)1 << bp->local_table_bits, sizeof(int));
+        failed = failed || !bp->local_counters || !bp->local_history;
+        break;
+
+    case BP_PREDICTOR_TAGE:
+        bp->counters = alloc_counters(bp->table_bits);
+        failed = failed || !bp->counters;
+        for (int i = 0; i < TAGE_TABLES; i++)
+        {
+            bp->tage[i] = calloc((size_t)1 << bp->tage_table_bits, sizeof(APEX_TageEntry));
+            failed = failed || !bp->tage[i];
+            for (int j = 0; bp->tage[i] && j < 1 << bp->tage_table_bits; j++)
+            {
+                bp->tage[i][j].tag = -1;
+            }
+        }
+        break;
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "APEX_Bpred: Unable to allocate the predictor tables\n");
+        APEX_bpred_free(bp);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int
+mask(int bits)
+{
+    return (int)((1u << bits) - 1);
+}
+
+/* Word address of an instruction, the low bits of a PC are always 0 */
+static int
+pc_index(int pc)
+{
+    return (unsigned int)pc >> 2;
+}
+
+/* Moves a 2 bit counter towards the outcome */
+static void
+train_counter(unsigned char *counter, int taken)
+{
+    if (taken && *counter < 3)
+    {
+        (*counter)++;
+    }
+    else if (!taken && *counter > 0)
+    {
+        (*counter)--;
+    }
+}
+
+/* Xors the latest length outcomes of history down to bits bits */
+static int
+fold_history(unsigned long long history, int length, int bits)
+{
+    int folded = 0;
+
+    if (length < 64)
+    {
+        history &= (1ull << length) - 1;
+    }
+    while (history)
+    {
+        folded ^= (int)(history & (unsigned long long)mask(bits));
+        history >>= bits;
+    }
+    return folded;
+}
+
+static int
+local_slot(const APEX_BranchPredictor *bp, int pc)
+{
+    return pc_index(pc) & mask(bp->local_table_bits);
+}
+
+static unsigned char *
+bimodal_counter(APEX_BranchPredictor *bp, int pc)
+{
+    return &bp->counters[pc_index(pc) & mask(bp->table_bits)];
+}
+
+static unsigned char *
+gshare_counter(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info)
+{
+    int history = (int)(info->history & (unsigned long long)mask(bp->history_bits));
+
+    return &bp->global_counters[(pc_index(pc) ^ history) & mask(bp->table_bits)];
+}
+
+static unsigned char *
+local_counter(APEX_BranchPredictor *bp, const APEX_BpredInfo *info)
+{
+    return &bp->local_counters[info->local_history & mask(bp->table_bits)];
+}
+
+static unsigned char *
+choice_counter(APEX_BranchPredictor *bp, const APEX_BpredInfo *info)
+{
+    return &bp->choice[info->history & (unsigned long long)mask(bp->table_bits)];
+}
+
+static int
+tage_index(const APEX_BranchPredictor *bp, int table, int pc, const APEX_BpredInfo *info)
+{
+    int length = tage_history_length[table];
+
+    return (pc_index(pc) ^ fold_history(info->history, length, bp->tage_table_bits))
+           & mask(bp->tage_table_bits);
+}
+
+static int
+tage_tag(int table, int pc, const APEX_BpredInfo *info)
+{
+    int length = tage_history_length[table];
+
+    return (pc_index(pc) ^ fold_history(info->history, length, TAGE_TAG_BITS)
+            ^ (fold_history(info->history, length, TAGE_TAG_BITS - 1) << 1))
+           & mask(TAGE_TAG_BITS);
+}
+
+/* Returns the tagged entry of table that matches the branch, NULL if none does */
+static APEX_TageEntry *
+tage_lookup(APEX_BranchPredictor *bp, int table, int pc, const APEX_BpredInfo *info)
+{
+    APEX_TageEntry *entry = &bp->tage[table][tage_index(bp, table, pc, info)];
+
+    return entry->tag == tage_tag(table, pc, info) ? entry : NULL;
+}
+
+/*
+ * Finds the longest history TAGE table that hits, and the prediction the
+ * next shorter hit or the base table would give
+ *
+ * Returns the table, -1 if only the base table applies.
+ */
+static int
+tage_provider(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int *alt_taken)
+{
+    int provider = -1;
+
+    *alt_taken = *bimodal_counter(bp, pc) >= 2;
+    for (int i = 0; i < TAGE_TABLES; i++)
+    {
+        APEX_TageEntry *entry = tage_lookup(bp, i, pc, info);
+
+        if (!entry)
+        {
+            continue;
+        }
+        if (provider >= 0)
+        {
+            *alt_taken = tage_lookup(bp, provider, pc, info)->ctr >= 0;
+        }
+        provider = i;
+    }
+    return provider;
+}
+
+/* Returns the direction the tables give for the branch at pc under info */
+static int
+predict_direction(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info)
+{
+    switch (bp->kind)
+    {
+    case BP_PREDICTOR_BIMODAL:
+        return *bimodal_counter(bp, pc) >= 2;
+
+    case BP_PREDICTOR_GSHARE:
+        return *gshare_counter(bp, pc, info) >= 2;
+
+    case BP_PREDICTOR_LOCAL:
+        return *local_counter(bp, info) >= 2;
+
+    case BP_PREDICTOR_TOURNAMENT:
+        if (*choice_counter(bp, info) >= 2)
+        {
+            return *gshare_counter(bp, pc, info) >= 2;
+        }
+        return *local_counter(bp, info) >= 2;
+
+    case BP_PREDICTOR_TAGE:
+    {
+        int alt_taken;
+        int provider = tage_provider(bp, pc, info, &alt_taken);
+
+        if (provider < 0)
+        {
+            return alt_taken;
+        }
+        return tage_lookup(bp, provider, pc, info)->ctr >= 0;
+    }
+    }
+    return FALSE;
+}
+
+/*
+ * Predicts the branch at pc, and records in info the direction and the
+ * histories the prediction was made with
+ *
+ * Fetch calls this before it knows whether pc holds a branch, so it is
+ * cheap and changes no state. With the BTB counters selected it only fills
+ * in info and predicts not taken.
+ *
+ * Returns TRUE if the branch is predicted taken.
+ */
+int
+APEX_bpred_predict(APEX_BranchPredictor *bp, int pc, APEX_BpredInfo *info)
+{
+    info->history = bp->history;
+    info->local_history = bp->local_history ? bp->local_history[local_slot(bp, pc)] : 0;
+    info->taken = predict_direction(bp, pc, info);
+    return info->taken;
+}
+
+/* Trains the TAGE entries a prediction under info used, and claims a longer one if it was wrong */
+static void
+update_tage(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int taken)
+{
+    int alt_taken;
+    int provider = tage_provider(bp, pc, info, &alt_taken);
+    int predicted = alt_taken;
+    int claimed = FALSE;
+
+    if (provider >= 0)
+    {
+        APEX_TageEntry *entry = tage_lookup(bp, provider, pc, info);
+
+        bp->tage_provided++;
+        predicted = entry->ctr >= 0;
+        if (predicted != alt_taken)
+        {
+            if (predicted == taken && entry->useful < 3)
+            {
+                entry->useful++;
+            }
+            else if (predicted != taken && entry->useful > 0)
+            {
+                entry->useful--;
+            }
+        }
+        if (taken && entry->ctr < 3)
+        {
+            entry->ctr++;
+        }
+        else if (!taken && entry->ctr > -4)
+        {
+            entry->ctr--;
+        }
+    }
+    else
+    {
+        train_counter(bimodal_counter(bp, pc), taken);
+    }
+
+    if (predicted == taken)
+    {
+        return;
+    }
+
+    for (int i = provider + 1; i < TAGE_TABLES && !claimed; i++)
+    {
+        APEX_TageEntry *entry = &bp->tage[i][tage_index(bp, i, pc, info)];
+
+        if (entry->useful == 0)
+        {
+            entry->tag = tage_tag(i, pc, info);
+            entry->ctr = taken ? 0 : -1;
+            bp->tage_allocations++;
+            claimed = TRUE;
+        }
+    }
+
+    /* Every candidate was useful, age them so a later misprediction finds room */
+    for (int i = provider + 1; i < TAGE_TABLES && !claimed; i++)
+    {
+        bp->tage[i][tage_index(bp, i, pc, info)].useful--;
+    }
+}
+
+/*
+ * Trains the predictor with the outcome of the branch at pc, predicted
+ * with the histories in info, and shifts the outcome into the histories
+ */
+void
+APEX_bpred_update(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int taken)
+{
+    taken = taken ? 1 : 0;
+    bp->updates++;
+
+    switch (bp->kind)
+    {
+    case BP_PREDICTOR_BIMODAL:
+        train_counter(bimodal_counter(bp, pc), taken);
+        break;
+
+    case BP_PREDICTOR_GSHARE:
+        train_counter(gshare_counter(bp, pc, info), taken);
+        break;
+
+    case BP_PREDICTOR_LOCAL:
+        train_counter(local_counter(bp, info), taken);
+        break;
+
+    case BP_PREDICTOR_TOURNAMENT:
+    {
+        int global_taken = *gshare_counter(bp, pc, info) >= 2;
+        int local_taken = *local_counter(bp, info) >= 2;
+
+        if (*choice_counter(bp, info) >= 2)
+        {
+            bp->global_chosen++;
+        }
+        if (global_taken != local_taken)
+        {
+            train_counter(choice_counter(bp, info), global_taken == taken);
+        }
+        train_counter(gshare_counter(bp, pc, info), taken);
+        train_counter(local_counter(bp, info), taken);
+        break;
+    }
+
+    case BP_PREDICTOR_TAGE:
+        update_tage(bp, pc, info, taken);
+        break;
+    }
+
+    bp->history = (bp->history << 1) | (unsigned long long)taken;
+    if (bp->local_history)
+    {
+        int *local = &bp->local_history[local_slot(bp, pc)];
+
+        *local = ((*local << 1) | taken) & mask(bp->history_bits);
+    }
+}
+
+static APEX_IndirectEntry *
+indirect_entry(APEX_BranchPredictor *bp, int pc)
+{
+    return &bp->indirect[pc_index(pc) % bp->indirect_size];
+}
+
+/* Returns TRUE if a JUMP through rs1 with offset imm returns to the newest JALR */
+static int
+is_return(const APEX_BranchPredictor *bp, int rs1, int imm)
+{
+    return bp->ras_count && imm == 0 && bp->ras[bp->ras_top].link_reg == rs1;
+}
+
+/*
+ * Predicts the target of the instruction at pc in fetch, if it is a JUMP
+ * or JALR, and pushes the return address of a JALR. Records the target and
+ * the top of the return address stack in info for every instruction.
+ *
+ * Returns the target, -1 if the instruction is no JUMP or JALR or nothing
+ * predicts where it goes.
+ */
+int
+APEX_bpred_predict_jump(APEX_BranchPredictor *bp, int pc, int opcode, int rd, int rs1, int imm,
+                        APEX_BpredInfo *info)
+{
+    info->target = -1;
+    info->from_ras = FALSE;
+
+    if (opcode == OPCODE_JUMP && bp->ras_size && is_return(bp, rs1, imm))
+    {
+        info->target = bp->ras[bp->ras_top].return_pc;
+        info->from_ras = TRUE;
+        bp->ras_top = (bp->ras_top + bp->ras_size - 1) % bp->ras_size;
+        bp->ras_count--;
+    }
+    else if ((opcode == OPCODE_JUMP || opcode == OPCODE_JALR) && bp->indirect_size)
+    {
+        APEX_IndirectEntry *entry = indirect_entry(bp, pc);
+
+        if (entry->valid && entry->pc == pc)
+        {
+            info->target = entry->target;
+        }
+    }
+
+    if (opcode == OPCODE_JALR && bp->ras_size)
+    {
+        bp->ras_top = (bp->ras_top + 1) % bp->ras_size;
+        bp->ras[bp->ras_top].return_pc = pc + 4;
+        bp->ras[bp->ras_top].link_reg = rd;
+        if (bp->ras_count < bp->ras_size)
+        {
+            bp->ras_count++;
+        }
+    }
+
+    info->ras.top = bp->ras_top;
+    info->ras.count = bp->ras_count;
+    if (bp->ras_top >= 0)
+    {
+        info->ras.entry = bp->ras[bp->ras_top];
+    }
+    return info->target;
+}
+
+/*
+ * Checks the target fetch followed for the JUMP or JALR at pc against the
+ * one it jumped to, and remembers that one in the indirect target table
+ *
+ * Returns TRUE if fetch went the right way.
+ */
+int
+APEX_bpred_resolve_jump(APEX_BranchPredictor *bp, int pc, const APEX_BpredInfo *info, int target)
+{
+    int correct = info->target == target;
+
+    if (info->from_ras)
+    {
+        bp->ras_predictions++;
+        bp->ras_mispredicts += !correct;
+        return correct;
+    }
+
+    if (info->target >= 0)
+    {
+        bp->indirect_predictions++;
+        bp->indirect_mispredicts += !correct;
+    }
+    if (bp->indirect_size)
+    {
+        APEX_IndirectEntry *entry = indirect_entry(bp, pc);
+
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->target = target;
+    }
+    return correct;
+}
+
+/*
+ * Puts the return address stack back the way it was after the instruction
+ * info belongs to was fetched, undoing the instructions fetched behind it
+ */
+void
+APEX_bpred_repair(APEX_BranchPredictor *bp, const APEX_BpredInfo *info)
+{
+    if (!bp->ras_size)
+    {
+        return;
+    }
+    bp->ras_top = info->ras.top;
+    bp->ras_count = info->ras.count;
+    if (bp->ras_top >= 0)
+    {
+        bp->ras[bp->ras_top] = info->ras.entry;
+    }
+}
+
+void
+APEX_bpred_put_stats(APEX_StatsWriter *writer, const APEX_BranchPredictor *bp)
+{
+    if (bp->ras_size)
+    {
+        APEX_stats_put(writer, "bp.ras.predictions", bp->ras_predictions);
+        APEX_stats_put(writer, "bp.ras.mispredicts", bp->ras_mispredicts);
+    }
+    if (bp->indirect_size)
+    {
+        APEX_stats_put(writer, "bp.indirect.predictions", bp->indirect_predictions);
+        APEX_stats_put(writer, "bp.indirect.mispredicts", bp->indirect_mispredicts);
+    }
+    if (bp->kind == BP_PREDICTOR_BTB)
+    {
+        return;
+    }
+    APEX_stats_put(writer, "bp.predictor.updates", bp->updates);
+    if (bp->kind == BP_PREDICTOR_TOURNAMENT)
+    {
+        APEX_stats_put(writer, "bp.tournament.global_chosen", bp->global_chosen);
+    }
+    if (bp->kind == BP_PREDICTOR_TAGE)
+    {
+        APEX_stats_put(writer, "bp.tage.provided", bp->tage_provided);
+        APEX_stats_put(writer, "bp.tage.allocations", bp->tage_allocations);
+    }
+}
+
+void
+APEX_bpred_free(APEX_BranchPredictor *bp)
+{
+    free(bp->counters);
+    free(bp->global_counters);
+    free(bp->local_counters);
+    free(bp->choice);
+    free(bp->local_history);
+    free(bp->indirect);
+    for (int i = 0; i < TAGE_TABLES; i++)
+    {
+        free(bp->tage[i]);
+    }
+    memset(bp, 0, sizeof(APEX_BranchPredictor));
+}
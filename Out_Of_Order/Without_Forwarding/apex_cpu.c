@@ -6,12 +6,59 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
+
+/* Pipeline state shared by the stages in this file */
+static struct BTBEntry btb[BTB_SIZE];
+static struct BQ bq[BQ_SIZE];
+static  int rename_table[Rename_Table_SIZE];
+static struct PRF physical_reg_file[Free_List_SIZE];
+static struct REG physical_reg[Free_List_SIZE];
+static struct REG cc_reg[CC_PSize];
+static int reg_free_list[MAX_PHYS_REGS];
+static int cc_free_list[MAX_PHYS_REGS];
+static IQ issue_queue[IQ_SIZE];
+static int dispatch_counter =0;
+static struct bus forwarding_bus[MAX_PHYS_REGS];
+static struct bus cc_forwarding_bus[MAX_PHYS_REGS];
+static struct PRF prf_file[MAX_PHYS_REGS];
+static struct ROB rob[ROB_SIZE];
+static struct LSQ lq[MAX_LQ_SIZE];//loads in program order, config.lq_size in use
+static struct LSQ sq[MAX_SQ_SIZE];//stores in program order, config.sq_size in use
+static int ssit[MAX_SSIT_SIZE];//store set of each load/store PC, 0 if none
+static int rob_head = 0;
+static int rob_tail = 0;
+static int prev;
+static int prev_cc = -1;
+static int free_physical_reg_index;
+static int free_cc_physical_reg_index;
+static struct ARF arf;
+static int mau_cycles_left = 0;
+static int load_port_free_cycle = 0;
+static StoreBufferEntry store_buffer[MAX_STORE_BUFFER_SIZE];//oldest first
+static int store_buffer_count = 0;
+static int store_buffer_cycles_left = 0;//of the write of store_buffer[0], 0 before it starts
+static int stop_simulator = FALSE;
+static int lq_tail = 0;
+static int lq_head = 0;
+static int sq_tail = 0;
+static int sq_head = 0;
+/* Both free lists are circular over config.phys_regs and config.flag_regs slots,
+ * taken at the head and refilled at the tail */
+static int rename_head = 0;
+static int rename_tail = -1;
+static int cc_rename_head = 0;
+static int cc_rename_tail = -1;
+static int free_list_slots = Free_List_SIZE;
+static int cc_free_list_slots = CC_PSize;
+
 /* Converts the PC(4000 series) into array index for code memory
  *
  * Note: You are not supposed to edit this function
@@ -111,6 +158,37 @@ print_stage_content(const char *name, const CPU_Stage *stage)
     printf("\n");
 }
 
+/* Accounts a ROB entry leaving the machine in the statistics */
+static void
+count_retired(APEX_CPU *cpu, int rob_index)
+{
+    /* A cracked instruction retires with its last micro-op */
+    if (rob[rob_index].uop == UOP_MEMORY)
+    {
+        return;
+    }
+    if (rob[rob_index].uop == UOP_FUSED)
+    {
+        cpu->insn_completed++;
+        cpu->stats.retired[rob[rob_index].fused_with]++;
+    }
+    cpu->insn_completed++;
+    cpu->stats.retired[rob[rob_index].opcode]++;
+}
+
+/* Entries left on the free lists, a list never holds every slot so head and tail tell full from empty */
+static int
+free_pr_count()
+{
+    return (rename_tail - rename_head + 1 + free_list_slots) % free_list_slots;
+}
+
+static int
+free_cc_count()
+{
+    return (cc_rename_tail - cc_rename_head + 1 + cc_free_list_slots) % cc_free_list_slots;
+}
+
 /* Debug function which prints the register file
  *
  * Note: You are not supposed to edit this function
@@ -118,13 +196,21 @@ print_stage_content(const char *name, const CPU_Stage *stage)
 static void
 print_reg_file(const APEX_CPU *cpu)
 {
-    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "LSQ-head:");
+    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "LQ-head:");
+    printf("entry bit | load/store | mem_valid | mem_addr | dest_addr(L)| src_valid| src_tag | src_value\n");
+    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", lq[lq_head].entry_bit, lq[lq_head].load_store_bit, lq[lq_head].mem_addr_valid_bit, lq[lq_head].mem_addr, lq[lq_head].dest, lq[lq_head].src_data_valid_bit, lq[lq_head].src_tag, lq[lq_head].src_value);
+    printf("\n");
+    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "LQ-tail:");
+    printf("entry bit | load/store | mem_valid | mem_addr | dest_addr(L)| src_valid| src_tag | src_value\n");
+    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", lq[lq_tail].entry_bit, lq[lq_tail].load_store_bit, lq[lq_tail].mem_addr_valid_bit, lq[lq_tail].mem_addr, lq[lq_tail].dest, lq[lq_tail].src_data_valid_bit, lq[lq_tail].src_tag, lq[lq_tail].src_value);
+    printf("\n");
+    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "SQ-head:");
     printf("entry bit | load/store | mem_valid | mem_addr | dest_addr(L)| src_valid| src_tag | src_value\n");
-    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", lsq[lsq_head].entry_bit, lsq[lsq_head].load_store_bit, lsq[lsq_head].mem_addr_valid_bit, lsq[lsq_head].mem_addr, lsq[lsq_head].dest, lsq[lsq_head].src_data_valid_bit, lsq[lsq_head].src_tag, lsq[lsq_head].src_value);
+    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", sq[sq_head].entry_bit, sq[sq_head].load_store_bit, sq[sq_head].mem_addr_valid_bit, sq[sq_head].mem_addr, sq[sq_head].dest, sq[sq_head].src_data_valid_bit, sq[sq_head].src_tag, sq[sq_head].src_value);
     printf("\n");
-    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "LSQ-tail:");
+    printf("\n---------------------------------------\n%s\n-------------------------------------\n", "SQ-tail:");
     printf("entry bit | load/store | mem_valid | mem_addr | dest_addr(L)| src_valid| src_tag | src_value\n");
-    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", lsq[lsq_tail].entry_bit, lsq[lsq_tail].load_store_bit, lsq[lsq_tail].mem_addr_valid_bit, lsq[lsq_tail].mem_addr, lsq[lsq_tail].dest, lsq[lsq_tail].src_data_valid_bit, lsq[lsq_tail].src_tag, lsq[lsq_tail].src_value);
+    printf("%d | %d| %d | %d | %d | %d | %d | %d\n", sq[sq_tail].entry_bit, sq[sq_tail].load_store_bit, sq[sq_tail].mem_addr_valid_bit, sq[sq_tail].mem_addr, sq[sq_tail].dest, sq[sq_tail].src_data_valid_bit, sq[sq_tail].src_tag, sq[sq_tail].src_value);
     printf("\n");
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "ROB-head:");
     printf("F_bit | Instr_type | pc_val | PR | PREV | ARCn| LSQ_index | CC\n");
@@ -143,7 +229,7 @@ print_reg_file(const APEX_CPU *cpu)
     }
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "Forwarding bus:");
     printf("Valid | tag |data \n");
-    for (int i = 0; i < 100; i++)
+    for (int i = 0; i < MAX_PHYS_REGS; i++)
     {
     if(forwarding_bus[i].valid)
     printf("%d | %d | %d\n", forwarding_bus[i].valid , forwarding_bus[i].tag , forwarding_bus[i].data); // need to check how to print only for latest instriction
@@ -156,18 +242,18 @@ print_reg_file(const APEX_CPU *cpu)
         printf("R%d\tP%d\n", i, rename_table[i]);
     }
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "Physical_Registers_Free_List:");
-    for (int i = 0; i < Free_List_SIZE; i++)
+    for (int i = rename_head; i != (rename_tail + 1) % free_list_slots; i = (i + 1) % free_list_slots)
     {
         printf("%d, ", reg_free_list[i]);
     }
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "CC_Free_List:");
-    for (int i = 0; i < CC_PSize; i++)
+    for (int i = cc_rename_head; i != (cc_rename_tail + 1) % cc_free_list_slots; i = (i + 1) % cc_free_list_slots)
     {
         printf("%d, ", cc_free_list[i]);
     }
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "PRF:");
     printf("P | Valid | Data\n");
-    for (int i = 0; i < Free_List_SIZE; i++)
+    for (int i = 0; i < cpu->config.phys_regs; i++)
     {
         if (prf_file[i].pr.valid)
         {
@@ -176,7 +262,7 @@ print_reg_file(const APEX_CPU *cpu)
     }
     printf("\n---------------------------------------\n%s\n-------------------------------------\n", "CC_PRF:");
     printf("C| Valid | Data\n");
-    for (int i = 0; i < CC_PSize; i++)
+    for (int i = 0; i < cpu->config.flag_regs; i++)
     {
         if (prf_file[i].cc.valid)
         {
@@ -192,7 +278,7 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\n");
     for (int i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
     {
-        printf("R%-3d[%-3d] ", i, cpu->regs[i]);
+        printf("R%-3d[%-3d] ", i, arf.r[i]);
     }
     printf("\n");
     printf("CC | Commited Instruction Address\n");
@@ -214,1017 +300,2202 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\n");
 
 }
+/* Returns TRUE if no slot of a front end group holds an instruction */
+static int
+group_empty(const CPU_Stage *group)
+{
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
+    {
+        if (group[slot].has_insn)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Predecodes a conditional branch that missed in the BTB. Its target is
+ * pc + imm, so the branch prediction unit can follow it at once: a backward branch is predicted
+ * taken and a forward one not taken. Returns the prediction.
+ */
+static int
+predecode_static_taken(APEX_CPU *cpu)
+{
+    switch (cpu->bpu.opcode)
+    {
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        cpu->static_predictions++;
+        if (cpu->bpu.imm < 0)
+        {
+            cpu->static_taken++;
+            cpu->bpu.predicted_decision = 1;
+        }
+        break;
+    }
+    }
+    return cpu->bpu.predicted_decision;
+}
+
+/* TRUE for BZ, BNZ, BP and BNP, the branches that read the flags */
+static int
+is_conditional_branch(int opcode)
+{
+    switch (opcode)
+    {
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* Micro-ops decode1 cracks an instruction with opcode into */
+static int
+uop_count(int opcode)
+{
+    return opcode == OPCODE_LOADP || opcode == OPCODE_STOREP ? 2 : 1;
+}
+
 /*
- * Fetch Stage of APEX Pipeline
+ * Cracks a decoded instruction into its micro-ops, returns how many
  *
- * Note: You are free to edit this function according to your implementation
+ * LOADP becomes a LOAD and STOREP a STORE, each followed by an ADDL of 4 to
+ * its base register. The ADDL has no flags and executes on the pointer adder
+ * beside an address unit, so the new base is ready without waiting for the
+ * memory access.
  */
-static void
-APEX_fetch(APEX_CPU *cpu)
+static int
+crack_instruction(const CPU_Stage *insn, CPU_Stage *uops)
 {
-    APEX_Instruction *current_ins;
+    uops[0] = *insn;
+    uops[0].uop = UOP_NONE;
+    if (uop_count(insn->opcode) == 1)
+    {
+        return 1;
+    }
 
-    if (cpu->fetch.has_insn && !cpu->stall)
+    uops[0].uop = UOP_MEMORY;
+    uops[1] = uops[0];
+    uops[1].uop = UOP_POINTER;
+    uops[1].cracked_from = insn->opcode;
+    uops[1].opcode = OPCODE_ADDL;
+    strcpy(uops[1].opcode_str, "ADDL");
+    uops[1].imm = 4;
+    if (insn->opcode == OPCODE_LOADP)
     {
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
-        {
-            cpu->fetch_from_next_cycle = FALSE;
+        uops[0].opcode = OPCODE_LOAD;
+        strcpy(uops[0].opcode_str, "LOAD");
+        uops[1].rd = insn->rs1;
+        uops[1].rs1 = insn->rs1;
+    }
+    else
+    {
+        uops[0].opcode = OPCODE_STORE;
+        strcpy(uops[0].opcode_str, "STORE");
+        uops[1].rd = insn->rs2;
+        uops[1].rs1 = insn->rs2;
+    }
+    return 2;
+}
 
-            /* Skip this cycle*/
-            return;
-        }
+/* TRUE for the compares a conditional branch fuses with */
+static int
+is_fusable_compare(const CPU_Stage *uop)
+{
+    if (uop->uop != UOP_NONE)
+    {
+        return FALSE;
+    }
+    switch (uop->opcode)
+    {
+    case OPCODE_CMP:
+    case OPCODE_CML:
+    case OPCODE_SUBL:
+        return TRUE;
+    }
+    return FALSE;
+}
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
+/*
+ * TRUE if branch fuses with the micro-op decode put in the group slot
+ * before it: a CMP, CML or SUBL right in front of a conditional branch
+ */
+static int
+fuses_with_branch(const APEX_CPU *cpu, int slot, const CPU_Stage *branch)
+{
+    const CPU_Stage *producer;
 
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
-        
-            int target_btb_index = is_btb_hit(cpu);
-            if (cpu->fetch.btb_hit)
-            {
-                int prediction_output = predict_branch(cpu);
-                if (prediction_output)
-                {
-                    cpu->pc = btb[target_btb_index].target_address;
-                }
-                else
-                {
-                    cpu->pc += 4;
-                }
-            }
-            else
-            {
-                cpu->pc += 4;
-            }
+    if (!cpu->config.macro_fusion || slot == 0)
+    {
+        return FALSE;
+    }
+    producer = &cpu->decode2_group[slot - 1];
+    if (!is_fusable_compare(producer) || producer->pc + 4 != branch->pc)
+    {
+        return FALSE;
+    }
+    return is_conditional_branch(branch->opcode);
+}
 
-            /* Copy data from fetch latch to decode latch*/
+/*
+ * Fuses branch into the compare in the group slot before it. The fused
+ * micro-op is the branch, with the sources, destination and literal of
+ * the compare, it waits in the BQ and executes on a branch unit.
+ */
+static void
+fuse_branch(APEX_CPU *cpu, int slot, const CPU_Stage *branch)
+{
+    CPU_Stage *fused = &cpu->decode2_group[slot - 1];
 
-            cpu->decode1 = cpu->fetch;
-        
+    fused->uop = UOP_FUSED;
+    fused->fused_with = fused->opcode;
+    fused->fused_imm = fused->imm;
+    fused->pc = branch->pc;
+    fused->opcode = branch->opcode;
+    strcpy(fused->opcode_str, branch->opcode_str);
+    fused->imm = branch->imm;
+    fused->btb_hit = branch->btb_hit;
+    fused->btb_probe_index = branch->btb_probe_index;
+    fused->predicted_decision = branch->predicted_decision;
+    fused->bp_info = branch->bp_info;
+}
 
-        if (ENABLE_DEBUG_MESSAGES)
+/*
+ * Appends the micro-ops of one instruction to the decode2 group at slot,
+ * fusing a conditional branch into the compare before it. The first
+ * instruction of a group goes after the compare held back from the group
+ * before, if any. Returns the next free slot.
+ */
+static int
+group_append(APEX_CPU *cpu, int slot, const CPU_Stage *uops, int count)
+{
+    if (slot == 0 && cpu->fusion_hold.has_insn)
+    {
+        cpu->decode2_group[slot++] = cpu->fusion_hold;
+        cpu->fusion_hold.has_insn = FALSE;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (fuses_with_branch(cpu, slot, &uops[i]))
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            fuse_branch(cpu, slot, &uops[i]);
         }
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
+        else
         {
-            cpu->fetch.has_insn = FALSE;
+            cpu->decode2_group[slot++] = uops[i];
         }
     }
+    return slot;
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Holds back the compare that ends a decode2 group of slot micro-ops when
+ * the instruction after it is a conditional branch, so the two fuse at the
+ * start of the next group instead of being renamed apart
  */
 static void
-APEX_decode1(APEX_CPU *cpu)
+group_hold_compare(APEX_CPU *cpu, int slot)
 {
-    if (cpu->decode1.has_insn)
-    {
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode1.opcode)
-        {
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        {
-            if (!cpu->decode1.btb_hit)
-            {
-                create_btb_entry(cpu);
-            }
-            break;
-        }
-        }
-        cpu->decode2 = cpu->decode1;
+    CPU_Stage *last;
+    int next;
 
-        // cpu->execute = cpu->decode;
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("Decode1/RF", &cpu->decode1);
-        }
+    if (!cpu->config.macro_fusion || slot == 0)
+    {
+        return;
+    }
+    last = &cpu->decode2_group[slot - 1];
+    next = get_code_memory_index_from_pc(last->pc + 4);
+    if (!is_fusable_compare(last) || next >= cpu->code_memory_size ||
+        !is_conditional_branch(cpu->code_memory[next].opcode))
+    {
+        return;
     }
+    cpu->fusion_hold = *last;
+    last->has_insn = FALSE;
+    cpu->fusion_held++;
 }
+
+/*
+ * Follows the instructions decode1 passes on, looking for a loop the loop
+ * buffer can replay: a backward conditional branch predicted taken whose
+ * body fits config.loop_buffer_size. Every iteration after that branch is
+ * captured, and once LOOP_LOCK_ITERATIONS in a row were decoded as the same
+ * straight run ending at the branch predicted taken, the buffer locks onto
+ * the loop. Blocks queued for fetch behind the branch are dropped then.
+ */
 static void
-APEX_decode2(APEX_CPU *cpu)
+loop_buffer_capture(APEX_CPU *cpu, const CPU_Stage *insn)
 {
-    if (cpu->decode2.has_insn)
+    if (cpu->config.loop_buffer_size == 0)
     {
-        register_renaming(cpu);
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode2.opcode)
-        {
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        case OPCODE_MUL:
-        case OPCODE_SUB:
-        case OPCODE_ADD:
-        case OPCODE_CMP:
-        {
-            if (prf_file[cpu->decode2.rs1].pr.valid)
-            {
-                cpu->decode2.src1_valid = 1;
-                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
-            }
-            if (prf_file[cpu->decode2.rs2].pr.valid)
-            {
-                cpu->decode2.src2_valid = 1;
-                cpu->decode2.rs2_value = prf_file[cpu->decode2.rs2].pr.value;
-            }
-            break;
-        }
+        return;
+    }
 
-        case OPCODE_JUMP:
-        case OPCODE_JALR:
-        {
+    if (cpu->loop_start != -1)
+    {
+        int in_body = insn->pc == cpu->loop_start + 4 * cpu->loop_count &&
+                      cpu->loop_count < cpu->config.loop_buffer_size;
 
-            break;
-        }
-        case OPCODE_HALT:
-        case OPCODE_NOP:
-        case OPCODE_BN:
-        case OPCODE_BNN:
+        switch (insn->opcode)
         {
-            /* MOVC doesn't have register operands */
+        case OPCODE_HALT:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+            in_body = FALSE;
             break;
         }
-        case OPCODE_CML:
-        case OPCODE_SUBL:
-        case OPCODE_ADDL:
+        if (in_body)
         {
-            if (prf_file[cpu->decode2.rs1].pr.valid)
+            cpu->loop_buffer[cpu->loop_count++] = *insn;
+            if (insn->pc != cpu->loop_branch_pc)
             {
-                cpu->decode2.src1_valid = 1;
-                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
+                return;
             }
-            break;
-        }
-        case OPCODE_LOADP:
-        case OPCODE_LOAD:
-        {
-            if (prf_file[cpu->decode2.rs1].pr.valid)
+            if (insn->predicted_decision && ++cpu->loop_iterations == LOOP_LOCK_ITERATIONS)
             {
-                cpu->decode2.src1_valid = 1;
-                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
+                cpu->loop_length = cpu->loop_count;
+                cpu->loop_next = 0;
+                cpu->loop_streaming = TRUE;
+                cpu->loop_locks++;
+                cpu->ftq_head = 0;
+                cpu->ftq_count = 0;
             }
-            break;
-        }
-        case OPCODE_STORE:
-        case OPCODE_STOREP:
-        {
-
-            break;
-        }
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        {
-            if (!cpu->decode2.btb_hit)
+            if (insn->predicted_decision)
             {
-                cpu->stall = TRUE;
+                cpu->loop_count = 0;
+                return;
             }
-            break;
-        }
         }
-        cpu->iq = cpu->decode2;
+        cpu->loop_start = -1;
+    }
 
-        // cpu->execute = cpu->decode;
-        if (ENABLE_DEBUG_MESSAGES)
+    switch (insn->opcode)
+    {
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        if (insn->predicted_decision && insn->imm < 0 && -insn->imm / 4 < cpu->config.loop_buffer_size)
         {
-            print_stage_content("Decode2/RF", &cpu->decode2);
+            cpu->loop_start = insn->pc + insn->imm;
+            cpu->loop_branch_pc = insn->pc;
+            cpu->loop_count = 0;
+            cpu->loop_iterations = 0;
         }
+        break;
+    }
     }
 }
-void rob_commit(APEX_CPU *cpu)
+
+/*
+ * Replays the locked loop into decode2, cracked and fused like decode1 would, up to
+ * config.frontend_width instructions per cycle and across the end of an
+ * iteration. Every copy of the branch
+ * is predicted taken again, its misprediction at the loop exit recovers
+ * like any other and unlocks the buffer.
+ */
+static void
+loop_buffer_replay(APEX_CPU *cpu)
 {
-    if (rob[rob_head].entry_bit)
+    int slot = 0;
+
+    if (!group_empty(cpu->decode2_group))
     {
-        if (rob[rob_head].instr_type == "HALT")
+        return;
+    }
+
+    for (int count = 0; count < cpu->config.frontend_width; count++)
+    {
+        const CPU_Stage *insn = &cpu->loop_buffer[cpu->loop_next];
+        CPU_Stage uops[MAX_UOPS_PER_INSN];
+
+        slot = group_append(cpu, slot, uops, crack_instruction(insn, uops));
+        cpu->loop_next = (cpu->loop_next + 1) % cpu->loop_length;
+        cpu->loop_replayed++;
+
+        if (ENABLE_DEBUG_MESSAGES)
         {
-            stop_simulator = TRUE;
+            print_stage_content("Loop buffer", insn);
         }
-        else if (rob[rob_head].instr_type == "NOP")
-        {
-            arf.commited_instr_address = rob[rob_head].pc_value;
-            rob[rob_head].entry_bit = 0;
-            rob_head = (rob_head + 1) % ROB_SIZE;
-            lsq[lsq_head].entry_bit = 0;
-            lsq_head = (lsq_head + 1) % LSQ_SIZE;
-        }
-        else if (rob[rob_head].instr_type == "STOREP")
+    }
+    group_hold_compare(cpu, slot);
+}
+
+/* Micro-op cache entry pc maps to */
+static UopCacheEntry *
+uop_cache_entry(APEX_CPU *cpu, int pc)
+{
+    return &cpu->uop_cache[get_code_memory_index_from_pc(pc) % cpu->config.uop_cache_size];
+}
+
+/* Returns the micro-ops of the instruction at pc, NULL on a miss or with the cache off */
+static const UopCacheEntry *
+uop_cache_lookup(APEX_CPU *cpu, int pc)
+{
+    UopCacheEntry *entry;
+
+    if (cpu->config.uop_cache_size == 0)
+    {
+        return NULL;
+    }
+    entry = uop_cache_entry(cpu, pc);
+    if (!entry->valid || entry->pc != pc)
+    {
+        return NULL;
+    }
+    return entry;
+}
+
+/* Keeps what decode1 made of an instruction, replacing whatever had its entry */
+static void
+uop_cache_fill(APEX_CPU *cpu, const CPU_Stage *insn)
+{
+    UopCacheEntry *entry;
+
+    if (cpu->config.uop_cache_size == 0)
+    {
+        return;
+    }
+    entry = uop_cache_entry(cpu, insn->pc);
+    if (entry->valid && entry->pc == insn->pc)
+    {
+        return;
+    }
+    entry->valid = TRUE;
+    entry->pc = insn->pc;
+    entry->count = crack_instruction(insn, entry->uop);
+    cpu->uop_fills++;
+}
+
+/*
+ * Work decode1 does for the instruction in its latch: a conditional branch
+ * that missed in the BTB gets an entry
+ */
+static void
+decode_instruction(APEX_CPU *cpu)
+{
+    switch (cpu->decode1.opcode)
+    {
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        if (!cpu->decode1.btb_hit)
         {
-            if (rob[rob_head].lsq_index == lsq_head)
-            {
-                if (lsq[rob[rob_head].lsq_index].mem_addr_valid_bit && lsq[rob[rob_head].lsq_index].src_data_valid_bit)
-                {
-                    // also update memory using mau
-                    cpu->memory.has_insn = TRUE;
-                    cpu->memory.rs1_value = lsq[rob[rob_head].lsq_index].src_value;
-                    cpu->memory.memory_address = lsq[rob[rob_head].lsq_index].mem_addr;
-                    cpu->memory.opcode = OPCODE_STOREP;
-                }
-            }
+            create_btb_entry(cpu);
         }
-        else if (rob[rob_head].instr_type == "STORE")
+        break;
+    }
+    }
+}
+
+/*
+ * Branch prediction unit, decoupled from fetch
+ *
+ * Predicts one fetch block per cycle from cpu->pc: up to
+ * config.frontend_width sequential instructions, ending early at a predicted
+ * taken branch or HALT. The unit is pipelined, so a block reaches the fetch
+ * target queue config.bp_latency - 1 cycles after it was predicted, and a
+ * slow predictor only costs fetch cycles after a redirect, while the queue
+ * is empty. Blocks queued behind others have their lines prefetched into
+ * l1i before fetch gets to them.
+ */
+static void
+APEX_bpu(APEX_CPU *cpu)
+{
+    APEX_Instruction *current_ins;
+    FTQEntry *entry;
+
+    if (!cpu->bpu.has_insn || cpu->loop_streaming)
+    {
+        return;
+    }
+    if (cpu->ftq_count == cpu->config.ftq_size)
+    {
+        cpu->ftq_full_cycles++;
+        return;
+    }
+
+    entry = &cpu->ftq[(cpu->ftq_head + cpu->ftq_count) % cpu->config.ftq_size];
+    entry->pc = cpu->pc;
+    entry->count = 0;
+    entry->fetched = 0;
+    entry->ready_cycle = cpu->clock + cpu->config.bp_latency - 1;
+
+    while (entry->count < cpu->config.frontend_width && cpu->bpu.has_insn)
+    {
+        FetchPrediction *prediction = &entry->slot[entry->count];
+
+        if (get_code_memory_index_from_pc(cpu->pc) >= cpu->code_memory_size)
         {
-            if (rob[rob_head].lsq_index == lsq_head)
-            {
-                if (lsq[rob[rob_head].lsq_index].mem_addr_valid_bit && lsq[rob[rob_head].lsq_index].src_data_valid_bit)
-                {
-                    // also update memory using mau
-                    cpu->memory.has_insn = TRUE;
-                    cpu->memory.rs1_value = lsq[rob[rob_head].lsq_index].src_value;
-                    cpu->memory.memory_address = lsq[rob[rob_head].lsq_index].mem_addr;
-                    cpu->memory.opcode = OPCODE_STORE;
-                }
-            }
+            break;
         }
-        else if (rob[rob_head].instr_type == "LOADP")
+
+        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
+        cpu->bpu.pc = cpu->pc;
+        cpu->bpu.opcode = current_ins->opcode;
+        cpu->bpu.imm = current_ins->imm;
+        cpu->bpu.predicted_decision = 0;
+        APEX_bpred_predict(&cpu->bpred, cpu->bpu.pc, &cpu->bpu.bp_info);
+
+        int target_btb_index = is_btb_hit(cpu);
+        cpu->stats.bp_lookups++;
+        if (cpu->bpu.btb_hit)
         {
-            if (rob[rob_head].lsq_index == lsq_head)
+            int prediction_output = predict_branch(cpu);
+            cpu->stats.bp_hits++;
+            if (prediction_output)
             {
-                if (!lsq[lsq_head].mem_addr_valid_bit)
-                {
-                    cpu->memory.rd = lsq[lsq_head].dest;
-                    cpu->memory.has_insn = TRUE;
-                }
-                else if (lsq[rob[rob_head].lsq_index].mem_addr_valid_bit && lsq[rob[rob_head].lsq_index].src_data_valid_bit)
-                {
-                    if (prf_file[rob[rob_head].dest_physical].pr.valid && prf_file[rob[rob_head].rs1_physical_for_loadp].pr.valid)
-                    {
-                        arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
-                        reg_free_list[rename_tail + 1] = rob[rob_head].prev;
-                        rename_tail += 1;
-                        arf.r[rob[rob_head].rs1_arch_for_loadp] = prf_file[rob[rob_head].rs1_physical_for_loadp].pr.value;
-                        reg_free_list[rename_tail + 1] = rob[rob_head].rs1_prev;
-                        rename_tail += 1;
-                        // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
-                        arf.commited_instr_address = rob[rob_head].pc_value;
-                        rob[rob_head].entry_bit = 0;
-                        rob_head = (rob_head + 1) % ROB_SIZE;
-                        lsq[lsq_head].entry_bit = 0;
-                        lsq_head = (lsq_head + 1) % LSQ_SIZE;
-                    }
-                }
+                cpu->stats.bp_predicted_taken++;
+                cpu->pc = btb[target_btb_index].target_address;
             }
-        }
-        else if (rob[rob_head].instr_type == "LOAD")
-        {
-            if (rob[rob_head].lsq_index == lsq_head)
+            else
             {
-                if (!lsq[lsq_head].mem_addr_valid_bit)
-                {
-                    cpu->memory.rd = lsq[lsq_head].dest;
-                    cpu->memory.has_insn = TRUE;
-                }
-                else if (lsq[rob[rob_head].lsq_index].mem_addr_valid_bit && lsq[rob[rob_head].lsq_index].src_data_valid_bit)
-                {
-                    if (prf_file[rob[rob_head].dest_physical].pr.valid)
-                    {
-                        arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
-                        reg_free_list[rename_tail + 1] = rob[rob_head].prev;
-                        rename_tail += 1;
-                        // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
-                        arf.commited_instr_address = rob[rob_head].pc_value;
-                        rob[rob_head].entry_bit = 0;
-                        rob_head = (rob_head + 1) % ROB_SIZE;
-                        lsq[lsq_head].entry_bit = 0;
-                        lsq_head = (lsq_head + 1) % LSQ_SIZE;
-                    }
-                }
+                cpu->pc += 4;
             }
         }
-        // R2R
-        else if (prf_file[rob[rob_head].dest_physical].pr.valid)
+        else if (predecode_static_taken(cpu))
         {
-            arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
-            reg_free_list[rename_tail + 1] = rob[rob_head].prev;
-            rename_tail += 1;
-            if(rob[rob_head].cc != -1)
-            {
-            arf.cc = prf_file[rob[rob_head].cc].cc.value;
-            cc_free_list[cc_rename_tail+ 1] = rob[rob_head].cc;
-            cc_rename_tail += 1;
-            }
-            // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
-            arf.commited_instr_address = rob[rob_head].pc_value;
-            rob[rob_head].entry_bit = 0;
-            rob_head = (rob_head + 1) % ROB_SIZE;
+            cpu->pc += cpu->bpu.imm;
         }
-    }
-}
-static void
-APEX_iq(APEX_CPU *cpu)
-{
-    if (cpu->iq.has_insn)
-    {
-        switch (cpu->iq.opcode)
-        {
-        case OPCODE_MOVC:
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_HALT:
-        case OPCODE_NOP:
-        case OPCODE_XOR:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_CMP:
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_CML:
+        else
         {
-            create_iq_entry(cpu, "INTFU", free_physical_reg_index);
-            create_rob_entry(cpu);
-            wakeup_iq(cpu);
-            break;
+            cpu->pc += 4;
         }
-        case OPCODE_MUL:
+
+        prediction->btb_hit = cpu->bpu.btb_hit;
+        prediction->btb_probe_index = cpu->bpu.btb_probe_index;
+        prediction->predicted_decision = cpu->bpu.predicted_decision;
+        prediction->bp_info = cpu->bpu.bp_info;
+        entry->count++;
+
+        /* Nothing after HALT is predicted until a redirect */
+        if (cpu->bpu.opcode == OPCODE_HALT)
         {
-            create_iq_entry(cpu, "MULFU", free_physical_reg_index);
-            create_rob_entry(cpu);
-            wakeup_iq(cpu);
-            break;
+            cpu->bpu.has_insn = FALSE;
         }
-        case OPCODE_STORE:
+        if (cpu->bpu.predicted_decision)
         {
-            create_rob_entry(cpu);
-            create_lsq_entry(cpu, "STORE");
-            create_iq_entry(cpu, "AFU", free_physical_reg_index);
-            wakeup_iq(cpu);
             break;
         }
-        case OPCODE_STOREP:
+    }
+
+    if (entry->count == 0)
+    {
+        return;
+    }
+    if (cpu->config.ftq_prefetch && cpu->ftq_count > 0)
+    {
+        APEX_icache_prefetch(&cpu->caches, entry->pc, cpu->clock);
+        APEX_icache_prefetch(&cpu->caches, entry->pc + 4 * (entry->count - 1), cpu->clock);
+    }
+    cpu->ftq_count++;
+    cpu->ftq_blocks++;
+}
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Fetches up to config.frontend_width instructions per cycle into the
+ * decode1 group, from the blocks at the head of the fetch target queue and
+ * with the predictions made for them. A predicted taken branch, HALT or a
+ * line still missing in the instruction cache ends the group.
+ *
+ * A group that starts with a hit in the micro-op cache takes the micro-ops
+ * from there instead and goes straight to decode2, up to the first miss. It waits for
+ * decode2 to be empty, and it does not need the instruction cache.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+    APEX_Instruction *current_ins;
+    int from_uop_cache = FALSE;
+    int uop_slot = 0;
+
+    /* The loop buffer feeds decode2 */
+    if (cpu->loop_streaming)
+    {
+        cpu->loop_gated_cycles++;
+        return;
+    }
+    if (cpu->fetch.has_insn && cpu->stall)
+    {
+        cpu->stats.stall_cycles[STALL_BRANCH_UNRESOLVED]++;
+    }
+    if (cpu->fetch.has_insn && !cpu->stall)
+    {
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
         {
-            create_rob_entry(cpu);
-            create_lsq_entry(cpu, "STOREP");
-            create_iq_entry(cpu, "AFU", free_physical_reg_index);
-            wakeup_iq(cpu);
-            break;
+            cpu->fetch_from_next_cycle = FALSE;
+            cpu->stats.stall_cycles[STALL_BRANCH_REDIRECT]++;
+
+            /* Skip this cycle*/
+            return;
         }
-        case OPCODE_LOAD:
+
+        /* Decode1 has not passed on the previous group yet */
+        if (!group_empty(cpu->decode1_group))
         {
-            create_rob_entry(cpu);
-            create_lsq_entry(cpu, "LOAD");
-            create_iq_entry(cpu, "AFU", free_physical_reg_index);
-            wakeup_iq(cpu);
-            break;
+            return;
         }
-        case OPCODE_LOADP:
+
+        if (cpu->ftq_count > 0 && cpu->ftq[cpu->ftq_head].ready_cycle <= cpu->clock)
         {
-            create_rob_entry(cpu);
-            create_lsq_entry(cpu, "LOADP");
-            create_iq_entry(cpu, "AFU", free_physical_reg_index);
-            wakeup_iq(cpu);
-            break;
+            const FTQEntry *head = &cpu->ftq[cpu->ftq_head];
+
+            from_uop_cache = uop_cache_lookup(cpu, head->pc + 4 * head->fetched) != NULL;
+            if (from_uop_cache && !group_empty(cpu->decode2_group))
+            {
+                return;
+            }
         }
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
+
+        for (int slot = 0; slot < cpu->config.frontend_width && cpu->fetch.has_insn; slot++)
         {
-            create_iq_entry(cpu, "AFU", free_physical_reg_index);
-            create_bq_entry(cpu);
-            wakeup_iq(cpu);
-            break;
-        }
-        }
-        if (!cpu->intFU.busy && ready_for_intFU_issue != -1)
-        {
-            cpu->intFU.has_insn = TRUE;
-            cpu->intFU.pc = cpu->iq.pc;
-            cpu->intFU.rs1 = issue_queue[ready_for_intFU_issue].src1_tag;
-            cpu->intFU.rs2 = issue_queue[ready_for_intFU_issue].src2_tag;
-            cpu->intFU.opcode = issue_queue[ready_for_intFU_issue].operation;
-            cpu->intFU.rd = issue_queue[ready_for_intFU_issue].dest;
-            cpu->intFU.imm = issue_queue[ready_for_intFU_issue].literal;
-            if (forwarding_bus[issue_queue[ready_for_intFU_issue].src1_tag].valid)
-            {
-                issue_queue[ready_for_intFU_issue].src1_value = forwarding_bus[issue_queue[ready_for_intFU_issue].src1_tag].data;
-            }
-            if (forwarding_bus[issue_queue[ready_for_intFU_issue].src2_tag].valid)
-            {
-                issue_queue[ready_for_intFU_issue].src2_value = forwarding_bus[issue_queue[ready_for_intFU_issue].src2_tag].data;
-            }
-            cpu->intFU.rs1_value = issue_queue[ready_for_intFU_issue].src1_value;
-            cpu->intFU.rs2_value = issue_queue[ready_for_intFU_issue].src2_value;
-            issue_queue[ready_for_intFU_issue].free = 0;
-            cpu->intFU.busy = TRUE;
-            cpu->intFU.cc = issue_queue[ready_for_intFU_issue].cc;
-        }
-        if (!cpu->mulFU.busy && ready_for_mulFU_issue != -1)
-        {
-            cpu->mulFU.has_insn = TRUE;
-            cpu->mulFU.pc = cpu->iq.pc;
-            cpu->mulFU.rs1 = issue_queue[ready_for_mulFU_issue].src1_tag;
-            cpu->mulFU.rs2 = issue_queue[ready_for_mulFU_issue].src2_tag;
-            cpu->mulFU.opcode = issue_queue[ready_for_mulFU_issue].operation;
-            cpu->mulFU.rd = issue_queue[ready_for_mulFU_issue].dest;
-            cpu->mulFU.imm = issue_queue[ready_for_mulFU_issue].literal;
-            if (forwarding_bus[issue_queue[ready_for_mulFU_issue].src1_tag].valid)
-            {
-                // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[ready_for_intFU_issue].src1_tag].data);
-                issue_queue[ready_for_mulFU_issue].src1_value = forwarding_bus[issue_queue[ready_for_mulFU_issue].src1_tag].data;
-            }
-            if (forwarding_bus[issue_queue[ready_for_mulFU_issue].src2_tag].valid)
-            {
-                issue_queue[ready_for_mulFU_issue].src2_value = forwarding_bus[issue_queue[ready_for_mulFU_issue].src2_tag].data;
-            }
-            cpu->mulFU.rs1_value = issue_queue[ready_for_mulFU_issue].src1_value;
-            cpu->mulFU.rs2_value = issue_queue[ready_for_mulFU_issue].src2_value;
-            issue_queue[ready_for_mulFU_issue].free = 0;
-            cpu->mulFU.busy = TRUE;
-            cpu->mulFU.cc = issue_queue[ready_for_mulFU_issue].cc;
-        }
-         if(!cpu->bfu.busy && ready_for_bfu_issue != -1)
-         {
-            cpu->bfu.has_insn = TRUE;
-            cpu->bfu.pc = cpu->afu.pc;
-            cpu->bfu.cc= bq[ready_for_bfu_issue].tag;
-            cpu->bfu.cc_value= bq[ready_for_bfu_issue].value;
-            cpu->bfu.opcode = bq[ready_for_bfu_issue].instr_type;
-            cpu->bfu.predicted_decision = cpu->afu.predicted_decision;
-            cpu->bfu.btb_probe_index = cpu->afu.btb_probe_index;
-            cpu->bfu.busy = TRUE;
-            
-         }
-        if (!cpu->afu.busy && ready_for_afu_issue != -1)
-        {
-            cpu->afu.has_insn = TRUE;
-            cpu->afu.pc = cpu->iq.pc;
-            if (issue_queue[ready_for_afu_issue].operation == OPCODE_STOREP || issue_queue[ready_for_afu_issue].operation == OPCODE_STORE)
-            {
-                cpu->afu.rs1 = issue_queue[ready_for_afu_issue].src1_tag;
-                cpu->afu.rs2 = issue_queue[ready_for_afu_issue].src2_tag;
-                cpu->afu.opcode = issue_queue[ready_for_afu_issue].operation;
-                cpu->afu.rd = issue_queue[ready_for_afu_issue].dest;
-                cpu->afu.imm = issue_queue[ready_for_afu_issue].literal;
-                if (forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].valid)
+            FTQEntry *entry = &cpu->ftq[cpu->ftq_head];
+            const FetchPrediction *prediction;
+            int pc;
+
+            if (cpu->ftq_count == 0 || entry->ready_cycle > cpu->clock)
+            {
+                if (slot == 0)
                 {
-                    // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[ready_for_intFU_issue].src1_tag].data);
-                    lsq[issue_queue[ready_for_afu_issue].dest].src_data_valid_bit = 1;
-                    lsq[issue_queue[ready_for_afu_issue].dest].src_value = forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].data;
-                    issue_queue[ready_for_afu_issue].src1_value = forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].data;
+                    cpu->ftq_empty_cycles++;
                 }
-                if (forwarding_bus[issue_queue[ready_for_afu_issue].src2_tag].valid)
+                break;
+            }
+            pc = entry->pc + 4 * entry->fetched;
+            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(pc)];
+
+            if (from_uop_cache)
+            {
+                const UopCacheEntry *uops = uop_cache_lookup(cpu, pc);
+
+                if (!uops)
                 {
-                    //printf("Matched rs2 value from fw bus:%d\n", forwarding_bus[issue_queue[ready_for_afu_issue].src2_tag].data);
-                    issue_queue[ready_for_afu_issue].src2_value = forwarding_bus[issue_queue[ready_for_afu_issue].src2_tag].data;
+                    break;
                 }
-                //printf("rs1[%d]:%d,rs2[%d]:%d\n", issue_queue[ready_for_afu_issue].src1_tag, issue_queue[ready_for_afu_issue].src1_value, issue_queue[ready_for_afu_issue].src2_tag, issue_queue[ready_for_afu_issue].src2_value);
-                cpu->afu.rs1_value = issue_queue[ready_for_afu_issue].src1_value;
-                cpu->afu.rs2_value = issue_queue[ready_for_afu_issue].src2_value;
-                issue_queue[ready_for_afu_issue].free = 0;
-                cpu->afu.increment_reg_for_storep_loadp = cpu->iq.rd;
-            }
-            else if(issue_queue[ready_for_afu_issue].operation == OPCODE_LOADP || issue_queue[ready_for_afu_issue].operation == OPCODE_LOAD)
-            {
-                cpu->afu.rs1 = issue_queue[ready_for_afu_issue].src1_tag;
-                cpu->afu.opcode = issue_queue[ready_for_afu_issue].operation;
-                cpu->afu.rd = issue_queue[ready_for_afu_issue].dest;
-                cpu->afu.imm = issue_queue[ready_for_afu_issue].literal;
-                if (forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].valid)
+            }
+            /* The group ends at a line that has not arrived in the instruction cache */
+            else if (!APEX_icache_fetch(&cpu->caches, pc, cpu->clock))
+            {
+                if (slot == 0)
                 {
-                    // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[ready_for_intFU_issue].src1_tag].data);
-                    lsq[issue_queue[ready_for_afu_issue].dest].src_data_valid_bit = 1;
-                    lsq[issue_queue[ready_for_afu_issue].dest].src_value = forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].data;
-                    issue_queue[ready_for_afu_issue].src1_value = forwarding_bus[issue_queue[ready_for_afu_issue].src1_tag].data;
+                    cpu->stats.stall_cycles[STALL_ICACHE]++;
                 }
-                //printf("rs1[%d]:%d", issue_queue[ready_for_afu_issue].src1_tag, issue_queue[ready_for_afu_issue].src1_value);
-                cpu->afu.rs1_value = issue_queue[ready_for_afu_issue].src1_value;
-                issue_queue[ready_for_afu_issue].free = 0;
-                if(issue_queue[ready_for_afu_issue].operation == OPCODE_LOADP)
-                    cpu->afu.increment_reg_for_storep_loadp = cpu->iq.increment_reg_for_storep_loadp;
+                break;
             }
-            else if(issue_queue[ready_for_afu_issue].operation == OPCODE_BZ || issue_queue[ready_for_afu_issue].operation == OPCODE_BNZ || issue_queue[ready_for_afu_issue].operation == OPCODE_BP || issue_queue[ready_for_afu_issue].operation == OPCODE_BNP)
+
+            /* Store current PC in fetch latch */
+            cpu->fetch.pc = pc;
+
+            /* Index into code memory using this pc and copy all instruction fields
+             * into fetch latch  */
+            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
+            cpu->fetch.opcode = current_ins->opcode;
+            cpu->fetch.rd = current_ins->rd;
+            cpu->fetch.rs1 = current_ins->rs1;
+            cpu->fetch.rs2 = current_ins->rs2;
+            cpu->fetch.imm = current_ins->imm;
+
+            prediction = &entry->slot[entry->fetched];
+            cpu->fetch.btb_hit = prediction->btb_hit;
+            cpu->fetch.btb_probe_index = prediction->btb_probe_index;
+            cpu->fetch.predicted_decision = prediction->predicted_decision;
+            cpu->fetch.bp_info = prediction->bp_info;
+            if (++entry->fetched == entry->count)
             {
-                cpu->afu.opcode = issue_queue[ready_for_afu_issue].operation;
-                cpu->afu.imm = issue_queue[ready_for_afu_issue].literal;
-                cpu->afu.rd = issue_queue[ready_for_afu_issue].dest;
-                issue_queue[ready_for_afu_issue].free = 0;
-                cpu->afu.pc = cpu->iq.pc;
-                cpu->afu.predicted_decision = cpu->iq.predicted_decision;
-                cpu->afu.btb_probe_index = cpu->iq.btb_probe_index;
+                cpu->ftq_head = (cpu->ftq_head + 1) % cpu->config.ftq_size;
+                cpu->ftq_count--;
             }
-            cpu->afu.busy = TRUE;
-        }
 
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("IQ", &cpu->iq);
+            if (cpu->config.uop_cache_size)
+            {
+                cpu->uop_lookups++;
+            }
+            if (from_uop_cache)
+            {
+                const UopCacheEntry *uops = uop_cache_lookup(cpu, pc);
+                CPU_Stage uop[MAX_UOPS_PER_INSN];
+
+                /* Decoded and cracked already, only the BTB allocation of decode1 is left */
+                cpu->uop_hits++;
+                cpu->decode1 = cpu->fetch;
+                decode_instruction(cpu);
+                for (int i = 0; i < uops->count; i++)
+                {
+                    uop[i] = uops->uop[i];
+                    uop[i].btb_hit = cpu->decode1.btb_hit;
+                    uop[i].btb_probe_index = cpu->decode1.btb_probe_index;
+                    uop[i].predicted_decision = cpu->decode1.predicted_decision;
+                    uop[i].bp_info = cpu->decode1.bp_info;
+                }
+                uop_slot = group_append(cpu, uop_slot, uop, uops->count);
+                loop_buffer_capture(cpu, &cpu->decode1);
+            }
+            else
+            {
+                /* Copy data from fetch latch to decode latch*/
+                cpu->decode1_group[slot] = cpu->fetch;
+            }
+
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Fetch", &cpu->fetch);
+            }
+            /* Stop fetching new instructions if HALT is fetched */
+            if (cpu->fetch.opcode == OPCODE_HALT)
+            {
+                cpu->fetch.has_insn = FALSE;
+            }
+            /* Instructions after a taken branch belong to the next group */
+            if (cpu->fetch.predicted_decision)
+            {
+                break;
+            }
         }
+        group_hold_compare(cpu, uop_slot);
     }
 }
-void create_bq_entry(APEX_CPU *cpu)
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode1(APEX_CPU *cpu)
 {
-    switch(cpu->iq.opcode)
+    int uop_slot = 0;
+
+    if (cpu->loop_streaming)
     {
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        {
-            for (int i = 0; i < BQ_SIZE; i++)
-            {
-                if (!bq[i].valid)
-                {
-                    bq[i].valid = 1;
-                    bq[i].instr_type = cpu->iq.opcode;
-                    if(cpu->iq.btb_hit)
-                    {
-                        
-                    }
-                    else
-                    {
-                    if (cpu->decode1.opcode == OPCODE_BNZ || cpu->decode1.opcode == OPCODE_BP)
-                    {
-                        bq[i].prev_outcome[0] = 1;
-                        bq[i].prev_outcome[1] = 1;
-                    }
-                    else // BZ and BNP case
-                    {
-                        bq[i].prev_outcome[0] = 0;
-                        bq[i].prev_outcome[1] = 0;
-                    }
-                    bq[i].tag = rename_table[Rename_Table_SIZE -1];
-                    if(forwarding_bus[bq[i].tag].valid && forwarding_bus[bq[i].tag].data_broadcasted)
-                    {
-                        bq[i].value = forwarding_bus[bq[i].tag].data;
-                    }
-                    bq[i].target_address = -1;
-                    }
-                    bq[i].elapsed_clock = dispatch_counter;
-                    //cpu->decode1.btb_probe_index = i;
-                    break;
-                }
-            }
-            break;
-        }
+        loop_buffer_replay(cpu);
+        return;
     }
-}
-void create_lsq_entry(APEX_CPU *cpu, char *lsq_type)
-{
-    lsq[lsq_tail].entry_bit = 1;
-    if (lsq_type == "STOREP" || lsq_type == "STORE")
+
+    /* The group moves on once decode2 is empty, a cracked instruction takes
+     * two slots of decode2 but counts once against the width. A compare and
+     * the conditional branch after it take one slot, also when the compare
+     * ends one group and the branch starts the next */
+    if (!group_empty(cpu->decode2_group))
     {
-        lsq[lsq_tail].load_store_bit = 0;
-        lsq[lsq_tail].mem_addr_valid_bit = 0;
-        if (prf_file[cpu->iq.rs1].pr.valid)
+        return;
+    }
+
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
+    {
+        CPU_Stage uops[MAX_UOPS_PER_INSN];
+
+        if (!cpu->decode1_group[slot].has_insn)
         {
-            lsq[lsq_tail].src_data_valid_bit = 1;
-            lsq[lsq_tail].src_value = prf_file[cpu->iq.rs1].pr.value;
+            continue;
         }
-        else
+        cpu->decode1 = cpu->decode1_group[slot];
+        decode_instruction(cpu);
+        uop_slot = group_append(cpu, uop_slot, uops, crack_instruction(&cpu->decode1, uops));
+        cpu->decode1_group[slot].has_insn = FALSE;
+        uop_cache_fill(cpu, &cpu->decode1);
+        loop_buffer_capture(cpu, &cpu->decode1);
+
+        // cpu->execute = cpu->decode;
+        if (ENABLE_DEBUG_MESSAGES)
         {
-            lsq[lsq_tail].src_data_valid_bit = 0;
+            print_stage_content("Decode1/RF", &cpu->decode1);
         }
-        lsq[lsq_tail].src_tag = cpu->iq.rs1;
-        lsq_tail = (lsq_tail + 1) % LSQ_SIZE;
     }
-    else if (lsq_type == "LOADP" || lsq_type == "LOAD")
+    group_hold_compare(cpu, uop_slot);
+}
+
+/* Number of physical registers register_renaming takes for an instruction */
+static int
+physical_regs_needed(int opcode)
+{
+    switch (opcode)
     {
-        lsq[lsq_tail].load_store_bit = 1;
-        lsq[lsq_tail].mem_addr_valid_bit = 0;
-        lsq[lsq_tail].dest = cpu->iq.rd;
-        lsq[lsq_tail].src_data_valid_bit = 1;
-        lsq[lsq_tail].rob_index = rob_tail - 1;
-        lsq_tail = (lsq_tail + 1) % LSQ_SIZE;
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    case OPCODE_MOVC:
+    case OPCODE_LOAD:
+        return 1;
     }
+    return 0;
 }
-void 
-register_renaming(APEX_CPU *cpu)
+
+/* Number of flag registers register_renaming takes for an instruction */
+static int
+cc_regs_needed(int opcode)
 {
-    switch (cpu->decode2.opcode)
+    switch (opcode)
     {
     case OPCODE_ADD:
     case OPCODE_SUB:
     case OPCODE_MUL:
+    case OPCODE_DIV:
     case OPCODE_AND:
     case OPCODE_OR:
     case OPCODE_XOR:
-    {
-        free_physical_reg_index = get_free_pr_index();
-        free_cc_physical_reg_index = get_free_cc_index();
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
-        update_rename_table_entry(cpu, free_physical_reg_index);
-        cpu->decode2.rd = free_physical_reg_index;
-        //printf("rename_table size :%d",rename_table[Rename_Table_SIZE]);
-        prev_cc = rename_table[16];
-        rename_table[16] = free_cc_physical_reg_index;
-        cpu->decode2.cc = free_cc_physical_reg_index;
-        // printf("Arch - Sources are: %d %d\n", cpu->decode2.rs1, cpu->decode2.rs2);
-        // printf("Rename table entries are :%d, %d\n", rename_table[cpu->decode2.rs1],rename_table[cpu->decode2.rs2]);
-        // printf("Renamed instruction is : %s,P%d,P%d,P%d\n", cpu->decode2.opcode_str,cpu->decode2.rd, cpu->decode2.rs1,cpu->decode2.rs2);
-        break;
-    }
     case OPCODE_ADDL:
     case OPCODE_SUBL:
-    {
-        free_physical_reg_index = get_free_pr_index();
-        //free_cc_physical_reg_index = get_free_cc_index();
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        update_rename_table_entry(cpu, free_physical_reg_index);
-        cpu->decode2.rd = free_physical_reg_index;
-        prev_cc = rename_table[16];
-        rename_table[Free_List_SIZE-1] = free_cc_physical_reg_index;
-        cpu->decode2.cc = free_cc_physical_reg_index;
-        // printf("Arch - Sources are: %d %d\n", cpu->decode2.rs1, cpu->decode2.rs2);
-        // printf("Rename table entries are :%d, %d\n", rename_table[cpu->decode2.rs1],rename_table[cpu->decode2.rs2]);
-        // printf("Renamed instruction is : %s,P%d,P%d,P%d\n", cpu->decode2.opcode_str,cpu->decode2.rd, cpu->decode2.rs1,cpu->decode2.rs2);
-        break;
-    }
     case OPCODE_CML:
-    {
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        free_cc_physical_reg_index = get_free_cc_index();
-        prev_cc = rename_table[16];
-        rename_table[Free_List_SIZE-1] = free_cc_physical_reg_index;
-        cpu->decode2.cc = free_cc_physical_reg_index;
-        break;
-    }
     case OPCODE_CMP:
-    {
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
-        free_cc_physical_reg_index = get_free_cc_index();
-        prev_cc = rename_table[16];
-        rename_table[Free_List_SIZE-1] = free_cc_physical_reg_index;
-        cpu->decode2.cc = free_cc_physical_reg_index;
-        break;
+        return 1;
     }
-    case OPCODE_MOVC:
+    return 0;
+}
+
+/*
+ * Gives the flags of the fused branch that produced the latest flags the
+ * register cc. The fused branch is renamed earlier in this group, waits in
+ * the BQ, resolved already or retired. Only while it waits does cc wait for
+ * its broadcast, the branch unit writes it when the fused branch executes.
+ */
+static void
+fused_flags_to_register(APEX_CPU *cpu, int cc)
+{
+    for (int slot = MAX_GROUP_SLOTS - 1; slot >= 0; slot--)
     {
-        free_physical_reg_index = get_free_pr_index();
-        update_rename_table_entry(cpu, free_physical_reg_index);
-        cpu->decode2.rd = free_physical_reg_index;
-        cpu->decode2.cc = -1;
-        break;
+        if (cpu->iq_group[slot].has_insn && cpu->iq_group[slot].uop == UOP_FUSED)
+        {
+            cpu->iq_group[slot].cc = cc;
+            return;
+        }
     }
-    case OPCODE_STOREP:
+    for (int i = rob_tail; i != rob_head;)
     {
-        free_physical_reg_index = get_free_pr_index();
-        cpu->decode2.increment_reg_for_storep_loadp = cpu->decode2.rs2;
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
-        update_rename_table_entry(cpu, free_physical_reg_index);
-        cpu->decode2.rd = free_physical_reg_index;
-        cpu->decode2.cc = -1;
-        break;
+        i = (i + ROB_SIZE - 1) % ROB_SIZE;
+        if (!rob[i].entry_bit || rob[i].uop != UOP_FUSED)
+        {
+            continue;
+        }
+        if (rob[i].resolved)
+        {
+            prf_file[cc].cc.valid = 1;
+            prf_file[cc].cc.value = rob[i].cc_value;
+            return;
+        }
+        for (int j = 0; j < BQ_SIZE; j++)
+        {
+            if (bq[j].valid && bq[j].rob_index == i)
+            {
+                bq[j].tag = cc;
+            }
+        }
+        return;
     }
-    case OPCODE_STORE:
+    prf_file[cc].cc.valid = 1;
+    prf_file[cc].cc.value = arf.cc;
+}
+
+/*
+ * Decode2 renames the whole group in one cycle
+ *
+ * Slots are renamed in program order, so a source written by an older slot
+ * of the same group already sees that slot's new mapping, and since a freshly
+ * allocated register is not valid the consumer waits for its broadcast.
+ *
+ * A fused branch takes no flag register. The first later branch that
+ * reads its flags takes one for them instead.
+ */
+static void
+APEX_decode2(APEX_CPU *cpu)
+{
+    int regs_needed = 0;
+    int ccs_needed = 0;
+    int flags_fused = rename_table[Rename_Table_SIZE - 1] == CC_FUSED;
+
+    if (group_empty(cpu->decode2_group) || !group_empty(cpu->iq_group))
     {
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
-        cpu->decode2.cc = -1;
-        break;
+        return;
     }
-    case OPCODE_LOADP:
+
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
     {
-        free_physical_reg_index = get_free_pr_index();
-        int free_physical_reg_index_rs1 = get_free_pr_index();
-        cpu->decode2.increment_reg_for_storep_loadp = cpu->decode2.rs1;
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        update_rename_table_entry(cpu, free_physical_reg_index_rs1);
-        cpu->decode2.rd = free_physical_reg_index;
-        cpu->decode2.cc = -1;
-        break;
+        const CPU_Stage *stage = &cpu->decode2_group[slot];
+
+        if (!stage->has_insn)
+        {
+            continue;
+        }
+        if (stage->uop == UOP_FUSED)
+        {
+            regs_needed += stage->fused_with == OPCODE_SUBL;
+            flags_fused = TRUE;
+            continue;
+        }
+        if (flags_fused && is_conditional_branch(stage->opcode))
+        {
+            ccs_needed++;
+            flags_fused = FALSE;
+        }
+        regs_needed += physical_regs_needed(stage->opcode);
+        if (stage->uop != UOP_POINTER && cc_regs_needed(stage->opcode))
+        {
+            ccs_needed++;
+            flags_fused = FALSE;
+        }
     }
-    case OPCODE_LOAD:
+    if (regs_needed > free_pr_count() || ccs_needed > free_cc_count())
     {
-        free_physical_reg_index = get_free_pr_index();
-        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
-        update_rename_table_entry(cpu, free_physical_reg_index);
-        cpu->decode2.rd = free_physical_reg_index;
-        cpu->decode2.cc = -1;
-        break;
-    }
+        cpu->stats.stall_cycles[STALL_RENAME_FULL]++;
+        return;
     }
-}
-void wakeup_iq(APEX_CPU *cpu)
-{
-    // ready_for_intFU_issue[] = malloc(sizeof(int));
-    // int ready_for_mulU_issue[] = malloc(sizeof(int));
-    // int ready_for_aFU_issue[] = malloc(sizeof(int));
-    ready_for_intFU_issue = -1;
-    ready_for_mulFU_issue = -1;
-    ready_for_afu_issue = -1;
-    ready_for_bfu_issue = -1;
-    int intFU_min = INT16_MAX;
-    int mulFU_min = INT16_MAX;
-    int aFU_min = INT16_MAX;
-    int bfu_min = INT16_MAX;
-    for (int i = 0; i < 100; i++)
-    {   
-        if (forwarding_bus[i].valid)
+
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
+    {
+        if (!cpu->decode2_group[slot].has_insn)
         {
-            forwarding_bus[i].tag_broadcasted = 1;
+            continue;
         }
-        if (cc_forwarding_bus[i].valid)
+        cpu->decode2 = cpu->decode2_group[slot];
+
+        register_renaming(cpu);
+        cpu->decode2.prev = prev;
+        cpu->decode2.prev_cc = prev_cc;
+        if (cpu->decode2.uop == UOP_MEMORY)
         {
-            cc_forwarding_bus[i].tag_broadcasted = 1;
+            cpu->cracked++;
         }
-    }
-    for (int i = 0; i < IQ_SIZE; i++)
-    {
-        if (issue_queue[i].free)
+        if (cpu->decode2.uop == UOP_FUSED)
         {
-            if (forwarding_bus[issue_queue[i].src1_tag].valid)
+            cpu->fused++;
+        }
+        /* Read operands from register file based on the instruction type */
+        switch (cpu->decode2.opcode)
+        {
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_SUB:
+        case OPCODE_ADD:
+        case OPCODE_CMP:
+        {
+            if (prf_file[cpu->decode2.rs1].pr.valid)
             {
-                issue_queue[i].src1_valid_bit = 1;
+                cpu->decode2.src1_valid = 1;
+                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
             }
-            if (forwarding_bus[issue_queue[i].src2_tag].valid)
+            if (prf_file[cpu->decode2.rs2].pr.valid)
             {
-                issue_queue[i].src2_valid_bit = 1;
+                cpu->decode2.src2_valid = 1;
+                cpu->decode2.rs2_value = prf_file[cpu->decode2.rs2].pr.value;
             }
+            break;
         }
-    }
-    for (int i = 0; i < IQ_SIZE; i++)
-    {
-        // printf("Issue_queue: IQ_free[%d]| IQ[%s] ",issue_queue[0].free,issue_queue[0].fu_type);
-        if (!cpu->intFU.busy)
+
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
         {
-            // printf("INTFU is free..\n");
-            if (issue_queue[i].free && issue_queue[i].fu_type == "INTFU")
-            {
-                // printf("free[%d], FUType: %s\n", issue_queue[i].free, issue_queue[i].fu_type);
-                // printf("src1_valid[%d], src2_valid[%d],dispatc_count[%d]", issue_queue[i].src1_valid_bit, issue_queue[1].src2_valid_bit,issue_queue[i].dispatch_time );
-                if ((issue_queue[i].src1_valid_bit && issue_queue[i].src2_valid_bit) && issue_queue[i].dispatch_time < intFU_min)
-                {
-                    // printf("ready for issue: %d\n",issue_queue[i].operation);
-                    intFU_min = issue_queue[i].dispatch_time;
-                    ready_for_intFU_issue = i;
-                }
-            }
+
+            break;
         }
-        if (!cpu->mulFU.busy)
+        case OPCODE_HALT:
+        case OPCODE_NOP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
         {
-            if (issue_queue[i].free && issue_queue[i].fu_type == "MULFU")
-            {
-                if (issue_queue[i].src1_valid_bit && issue_queue[i].src2_valid_bit && issue_queue[i].dispatch_time < mulFU_min)
-                {
-                    mulFU_min = issue_queue[i].dispatch_time;
-                    ready_for_mulFU_issue = i;
-                }
-            }
+            /* MOVC doesn't have register operands */
+            break;
         }
-        if (!cpu->afu.busy)
+        case OPCODE_CML:
+        case OPCODE_SUBL:
+        case OPCODE_ADDL:
         {
-            if (issue_queue[i].free && issue_queue[i].fu_type == "AFU")
+            if (prf_file[cpu->decode2.rs1].pr.valid)
             {
-                if (issue_queue[i].src1_valid_bit && issue_queue[i].src2_valid_bit && issue_queue[i].dispatch_time < aFU_min)
-                {
-                    aFU_min = issue_queue[i].dispatch_time;
-                    ready_for_afu_issue = i;
-                }
+                cpu->decode2.src1_valid = 1;
+                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
             }
+            break;
         }
-         if (!cpu->bfu.busy)
+        case OPCODE_LOAD:
         {
-            if (bq[i].valid && bq[i].target_address != -1)
+            if (prf_file[cpu->decode2.rs1].pr.valid)
             {
-                if (bq[i].elapsed_clock < aFU_min)
-                {
-                    aFU_min = bq[i].elapsed_clock;
-                    ready_for_bfu_issue = i;
-                }
+                cpu->decode2.src1_valid = 1;
+                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
             }
+            break;
+        }
+        case OPCODE_STORE:
+        {
+
+            break;
+        }
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        {
+            if (cpu->decode2.uop != UOP_FUSED)
+            {
+                break;
+            }
+            if (prf_file[cpu->decode2.rs1].pr.valid)
+            {
+                cpu->decode2.src1_valid = 1;
+                cpu->decode2.rs1_value = prf_file[cpu->decode2.rs1].pr.value;
+            }
+            /* CML and SUBL compare with their literal */
+            if (cpu->decode2.fused_with != OPCODE_CMP)
+            {
+                cpu->decode2.src2_valid = 1;
+            }
+            else if (prf_file[cpu->decode2.rs2].pr.valid)
+            {
+                cpu->decode2.src2_valid = 1;
+                cpu->decode2.rs2_value = prf_file[cpu->decode2.rs2].pr.value;
+            }
+            break;
+        }
+        }
+        cpu->iq_group[slot] = cpu->decode2;
+        cpu->decode2_group[slot].has_insn = FALSE;
+
+        // cpu->execute = cpu->decode;
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Decode2/RF", &cpu->decode2);
         }
     }
-}
-void update_rename_table_entry(APEX_CPU *cpu, int physical_reg)
-{
-    // printf("Arch reg:%d\n",cpu->decode2.rd);
-    if (cpu->decode2.opcode == OPCODE_STOREP)
-    {
-        cpu->decode2.arch_reg = cpu->decode2.increment_reg_for_storep_loadp;
-        prev = rename_table[cpu->decode2.increment_reg_for_storep_loadp];
-        rename_table[cpu->decode2.increment_reg_for_storep_loadp] = physical_reg;
-    }
-    else if (cpu->decode2.opcode == OPCODE_LOADP)
-    {
-        // for rd
-        cpu->decode2.arch_reg = cpu->decode2.rd;
-        prev = rename_table[cpu->decode2.rd];
-        rename_table[cpu->decode2.rd] = free_physical_reg_index;
-        // for rs1
-        cpu->decode2.arch_reg_for_loadp = cpu->decode2.increment_reg_for_storep_loadp;
-        cpu->decode2.prev_rs1_for_loadp = rename_table[cpu->decode2.increment_reg_for_storep_loadp];
-        rename_table[cpu->decode2.increment_reg_for_storep_loadp] = physical_reg;
-        cpu->decode2.increment_reg_for_storep_loadp = physical_reg;
-    }
-    else if (cpu->decode2.opcode == OPCODE_LOAD)
+}
+
+/* Bytes the store buffer coalesces into one entry, the l1d line or a single word */
+static int
+store_buffer_line_bytes(const APEX_CPU *cpu)
+{
+    return cpu->caches.enabled ? cpu->config.l1d.line_size : 4;
+}
+
+/* Bit of the word at address within its store buffer entry */
+static unsigned long long
+store_buffer_word(const APEX_CPU *cpu, int address)
+{
+    return 1ULL << (((unsigned int)address % store_buffer_line_bytes(cpu)) / 4);
+}
+
+/*
+ * Adds a store to address to the store buffer, into the entry already
+ * holding its line if there is one. The oldest entry is left alone once
+ * its write to the cache has started.
+ *
+ * Returns FALSE if the buffer is full and no entry takes the store.
+ */
+static int
+store_buffer_insert(APEX_CPU *cpu, int address)
+{
+    int line = (unsigned int)address / store_buffer_line_bytes(cpu);
+
+    for (int i = store_buffer_cycles_left ? 1 : 0; i < store_buffer_count; i++)
     {
-        cpu->decode2.arch_reg = cpu->decode2.rd;
-        prev = rename_table[cpu->decode2.rd];
-        rename_table[cpu->decode2.rd] = free_physical_reg_index;
+        if (store_buffer[i].line == line)
+        {
+            store_buffer[i].words |= store_buffer_word(cpu, address);
+            cpu->stats.store_buffer_coalesced++;
+            return TRUE;
+        }
     }
-    else
+    if (store_buffer_count == cpu->config.store_buffer_size)
     {
-        cpu->decode2.arch_reg = cpu->decode2.rd;
-        prev = rename_table[cpu->decode2.rd];
-        rename_table[cpu->decode2.rd] = physical_reg;
+        return FALSE;
     }
-    // store prev for ROB entry
-    //  if(cc_index != -1)
-    //  {
-    //      rename_table[REG_FILE_SIZE] = cc_index;
-    //  }
+    store_buffer[store_buffer_count].line = line;
+    store_buffer[store_buffer_count].words = store_buffer_word(cpu, address);
+    store_buffer[store_buffer_count].pc = rob[rob_head].pc_value;
+    store_buffer_count++;
+    return TRUE;
 }
-int get_free_pr_index()
+
+/* Returns TRUE if a store to the word at address waits in the store buffer */
+static int
+store_buffer_holds(const APEX_CPU *cpu, int address)
 {
-    // for(int i =0; i<Free_List_SIZE; i++)
-    // {
-    //     // printf("P0 validity in free list: %d\n",reg_free_list[0]);
-    //     // printf("P1 validity in free list: %d\n",reg_free_list[1]);
-    //     // printf("P2 validity in free list: %d\n",reg_free_list[2]);
-    //     // printf("P3 validity in free list: %d\n",reg_free_list[3]);
-    //     if(reg_free_list[i] == 0)
-    //     {
-    //         reg_free_list[i] = 1;
-    //         //printf("free pr index: %d\n",i);
-    //         //printf("P4 validity in free list: %d\n",reg_free_list[4]);
-    //         return i;
-    //     }
-    // }
-    int free_index = reg_free_list[0];
-    
-for (int i = 0; i < rename_tail - 1; i++) {
-    reg_free_list[i] = reg_free_list[i + 1];
+    int line = (unsigned int)address / store_buffer_line_bytes(cpu);
+
+    for (int i = 0; i < store_buffer_count; i++)
+    {
+        if (store_buffer[i].line == line && (store_buffer[i].words & store_buffer_word(cpu, address)))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
 }
-rename_tail-= 1;  
-return free_index;
+
+/*
+ * Retires the store at the ROB head into the store buffer
+ *
+ * Memory takes the value right away, the buffer only holds the line until
+ * its write reaches the data cache. The store stays at the head while the
+ * buffer is full.
+ */
+static void
+retire_to_store_buffer(APEX_CPU *cpu)
+{
+    int address = sq[sq_head].mem_addr;
+
+    if (!store_buffer_insert(cpu, address))
+    {
+        cpu->stats.store_buffer_full_cycles++;
+        return;
+    }
+    cpu->data_memory[address] = sq[sq_head].src_value;
+    cpu->stats.mem_writes++;
+    count_retired(cpu, rob_head);
+    arf.commited_instr_address = rob[rob_head].pc_value;
+    rob[rob_head].entry_bit = 0;
+    rob_head = (rob_head + 1) % ROB_SIZE;
+    sq[sq_head].entry_bit = 0;
+    sq_head = (sq_head + 1) % cpu->config.sq_size;
 }
-int get_free_cc_index()
+
+/*
+ * Writes the oldest store buffer entry to the data cache in the
+ * background, one line at a time. Like the MAU the write takes a cycle of
+ * its own on top of the data cache.
+ */
+static void
+drain_store_buffer(APEX_CPU *cpu)
 {
-    int cc_free_index = cc_free_list[0];
-    for (int k = 0; k < CC_PSize - 1; k++)
+    if (!store_buffer_count)
     {
-        cc_free_list[k] = cc_free_list[k + 1];
+        return;
+    }
+    if (!store_buffer_cycles_left)
+    {
+        long long ready_cycle;
+
+        store_buffer_cycles_left = APEX_dcache_access(&cpu->caches, store_buffer[0].pc,
+                                                      store_buffer[0].line * store_buffer_line_bytes(cpu),
+                                                      TRUE, cpu->clock, &ready_cycle) + 1;
+        cpu->stats.store_buffer_drains++;
+    }
+    store_buffer_cycles_left--;
+    if (!store_buffer_cycles_left)
+    {
+        store_buffer_count--;
+        memmove(&store_buffer[0], &store_buffer[1], store_buffer_count * sizeof(store_buffer[0]));
     }
-    cc_rename_tail -= 1;
-    return cc_free_index;
 }
-void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
+
+void rob_commit(APEX_CPU *cpu)
 {
-    dispatch_counter++;
-    for (int i = 0; i < IQ_SIZE; i++)
+    if (rob[rob_head].entry_bit)
     {
-        if (!issue_queue[i].free)
+        if (rob[rob_head].instr_type == "HALT")
         {
-            issue_queue[i].free = 1;
-            issue_queue[i].fu_type = fu_type;
-            issue_queue[i].dest = cpu->iq.rd;
-            switch (cpu->iq.opcode)
-            {
-            case OPCODE_MOVC:
+            if (!stop_simulator)
             {
-                issue_queue[i].src1_valid_bit = 1;
-                issue_queue[i].src2_valid_bit = 1;
-                issue_queue[i].dest_type = 1;
-                issue_queue[i].operation = cpu->iq.opcode;
-                issue_queue[i].literal = cpu->iq.imm;
-                break;
+                count_retired(cpu, rob_head);
+                stop_simulator = TRUE;
             }
-            case OPCODE_ADD:
-            case OPCODE_XOR:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_CMP:
+        }
+        else if (rob[rob_head].instr_type == "BRANCH")
+        {
+            if (rob[rob_head].uop == UOP_FUSED && rob[rob_head].resolved)
             {
-                issue_queue[i].src1_tag = cpu->iq.rs1;
-                issue_queue[i].src2_tag = cpu->iq.rs2;
-                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
-                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
-                issue_queue[i].literal = 0;
-                issue_queue[i].dest_type = 1;
-                if (cpu->iq.src1_valid)
-                {
-                    issue_queue[i].src1_value = cpu->iq.rs1_value;
-                }
-                else if (!cpu->iq.src1_valid)
-                {
-                    if (forwarding_bus[cpu->iq.rs1].valid)
-                    {
-                        issue_queue[i].src1_valid_bit = 1;
-                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
-                    }
-                }
-                if (cpu->iq.src2_valid)
-                {
-                    issue_queue[i].src2_value = cpu->iq.rs2_value;
-                }
-                else if (!cpu->iq.src2_valid)
+                /* The compare half retires with the branch */
+                if (rob[rob_head].fused_with == OPCODE_SUBL)
                 {
-                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    if (!prf_file[rob[rob_head].dest_physical].pr.valid)
                     {
-                        issue_queue[i].src2_valid_bit = 1;
-                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                        return;
                     }
+                    arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
+                    release_physical_reg(rob[rob_head].prev);
                 }
-                issue_queue[i].operation = cpu->iq.opcode;
-                issue_queue[i].cc = cpu->iq.cc;
-                break;
+                arf.cc = rob[rob_head].cc_value;
+                release_cc_reg(rob[rob_head].prev_cc);
             }
-            case OPCODE_SUB:
+            if (rob[rob_head].resolved)
             {
-                issue_queue[i].src1_tag = cpu->iq.rs1;
-                issue_queue[i].src2_tag = cpu->iq.rs2;
-                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
-                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
-                issue_queue[i].dest_type = 1;
-                issue_queue[i].literal = 0;
-                if (cpu->iq.src1_valid)
-                {
-                    issue_queue[i].src1_value = cpu->iq.rs1_value;
-                }
-                else if (!cpu->iq.src1_valid)
+                count_retired(cpu, rob_head);
+                arf.commited_instr_address = rob[rob_head].pc_value;
+                rob[rob_head].entry_bit = 0;
+                rob_head = (rob_head + 1) % ROB_SIZE;
+            }
+        }
+        else if (rob[rob_head].instr_type == "NOP")
+        {
+            count_retired(cpu, rob_head);
+            arf.commited_instr_address = rob[rob_head].pc_value;
+            rob[rob_head].entry_bit = 0;
+            rob_head = (rob_head + 1) % ROB_SIZE;
+        }
+        else if (rob[rob_head].instr_type == "STORE")
+        {
+            if (rob[rob_head].lsq_index == sq_head)
+            {
+                if (sq[rob[rob_head].lsq_index].mem_addr_valid_bit && sq[rob[rob_head].lsq_index].src_data_valid_bit)
                 {
-                    if (forwarding_bus[cpu->iq.rs1].valid)
+                    if (cpu->config.store_buffer_size)
                     {
-                        issue_queue[i].src1_valid_bit = 1;
-                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
+                        retire_to_store_buffer(cpu);
                     }
-                }
-                if (cpu->iq.src2_valid)
-                {
-                    issue_queue[i].src2_value = cpu->iq.rs2_value;
-                }
-                else if (!cpu->iq.src2_valid)
-                {
-                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    else
                     {
-                        issue_queue[i].src2_valid_bit = 1;
-                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                        // also update memory using mau
+                        cpu->memory.has_insn = TRUE;
+                        cpu->memory.rs1_value = sq[rob[rob_head].lsq_index].src_value;
+                        cpu->memory.memory_address = sq[rob[rob_head].lsq_index].mem_addr;
+                        cpu->memory.pc = rob[rob_head].pc_value;
+                        cpu->memory.opcode = OPCODE_STORE;
                     }
                 }
-                issue_queue[i].operation = cpu->iq.opcode;
-                issue_queue[i].cc = cpu->iq.cc;
-                break;
             }
-            case OPCODE_MUL:
+        }
+        else if (rob[rob_head].instr_type == "LOAD")
+        {
+            if (rob[rob_head].lsq_index == lq_head)
             {
-                issue_queue[i].src1_tag = cpu->iq.rs1;
-                issue_queue[i].src2_tag = cpu->iq.rs2;
-                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
-                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
-                issue_queue[i].dest_type = 1;
-                issue_queue[i].literal = 0;
-                if (cpu->iq.src1_valid)
-                {
-                    issue_queue[i].src1_value = cpu->iq.rs1_value;
-                }
-                else if (!cpu->iq.src1_valid)
+                /* The load unit has broadcast the value once mem_addr_valid_bit is set */
+                if (lq[rob[rob_head].lsq_index].mem_addr_valid_bit && lq[rob[rob_head].lsq_index].src_data_valid_bit)
                 {
-                    if (forwarding_bus[cpu->iq.rs1].valid)
-                    {
-                        issue_queue[i].src1_valid_bit = 1;
-                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
-                    }
-                }
-                if (cpu->iq.src2_valid)
-                {
-                    issue_queue[i].src2_value = cpu->iq.rs2_value;
-                }
-                else if (!cpu->iq.src2_valid)
-                {
-                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    if (prf_file[rob[rob_head].dest_physical].pr.valid)
                     {
-                        issue_queue[i].src2_valid_bit = 1;
-                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                        count_retired(cpu, rob_head);
+                        arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
+                        release_physical_reg(rob[rob_head].prev);
+                        // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
+                        arf.commited_instr_address = rob[rob_head].pc_value;
+                        rob[rob_head].entry_bit = 0;
+                        rob_head = (rob_head + 1) % ROB_SIZE;
+                        lq[lq_head].entry_bit = 0;
+                        lq_head = (lq_head + 1) % cpu->config.lq_size;
                     }
                 }
-                issue_queue[i].operation = cpu->iq.opcode;
-                issue_queue[i].cc = cpu->iq.cc;
-                break;
             }
-            case OPCODE_HALT:
-            case OPCODE_NOP:
+        }
+        // CMP and CML only write the flags
+        else if (rob[rob_head].instr_type == "FLAGS")
+        {
+            if (prf_file[rob[rob_head].cc].cc.valid)
             {
-                issue_queue[i].src1_tag = 0;
-                issue_queue[i].src2_tag = 0;
-                issue_queue[i].src1_valid_bit = 1;
-                issue_queue[i].src2_valid_bit = 1;
+                count_retired(cpu, rob_head);
+                arf.cc = prf_file[rob[rob_head].cc].cc.value;
+                release_cc_reg(rob[rob_head].prev_cc);
+                arf.commited_instr_address = rob[rob_head].pc_value;
+                rob[rob_head].entry_bit = 0;
+                rob_head = (rob_head + 1) % ROB_SIZE;
+            }
+        }
+        // R2R
+        else if (prf_file[rob[rob_head].dest_physical].pr.valid)
+        {
+            count_retired(cpu, rob_head);
+            arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
+            release_physical_reg(rob[rob_head].prev);
+            if(rob[rob_head].cc != -1)
+            {
+            arf.cc = prf_file[rob[rob_head].cc].cc.value;
+            release_cc_reg(rob[rob_head].prev_cc);
+            }
+            // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
+            arf.commited_instr_address = rob[rob_head].pc_value;
+            rob[rob_head].entry_bit = 0;
+            rob_head = (rob_head + 1) % ROB_SIZE;
+        }
+    }
+}
+/* Hands IQ entry index to an integer or multiply unit */
+static void
+issue_alu(CPU_Stage *fu, int index)
+{
+    fu->has_insn = TRUE;
+    fu->pc = issue_queue[index].pc;
+    fu->rs1 = issue_queue[index].src1_tag;
+    fu->rs2 = issue_queue[index].src2_tag;
+    fu->opcode = issue_queue[index].operation;
+    fu->rd = issue_queue[index].dest;
+    fu->imm = issue_queue[index].literal;
+    if (forwarding_bus[issue_queue[index].src1_tag].valid)
+    {
+        issue_queue[index].src1_value = forwarding_bus[issue_queue[index].src1_tag].data;
+    }
+    if (forwarding_bus[issue_queue[index].src2_tag].valid)
+    {
+        issue_queue[index].src2_value = forwarding_bus[issue_queue[index].src2_tag].data;
+    }
+    fu->rs1_value = issue_queue[index].src1_value;
+    fu->rs2_value = issue_queue[index].src2_value;
+    issue_queue[index].free = 0;
+    fu->busy = TRUE;
+    fu->cc = issue_queue[index].cc;
+    fu->dispatch_time = issue_queue[index].dispatch_time;
+}
+
+/* Hands IQ entry index to an address unit */
+static void
+issue_agu(CPU_Stage *fu, int index)
+{
+    fu->has_insn = TRUE;
+    fu->pc = issue_queue[index].pc;
+    if (issue_queue[index].operation == OPCODE_STORE)
+    {
+        fu->rs1 = issue_queue[index].src1_tag;
+        fu->rs2 = issue_queue[index].src2_tag;
+        fu->opcode = issue_queue[index].operation;
+        fu->rd = issue_queue[index].dest;
+        fu->imm = issue_queue[index].literal;
+        if (forwarding_bus[issue_queue[index].src1_tag].valid)
+        {
+            // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[index].src1_tag].data);
+            issue_queue[index].src1_value = forwarding_bus[issue_queue[index].src1_tag].data;
+        }
+        /* Store data is ready once the store issues */
+        sq[issue_queue[index].dest].src_data_valid_bit = 1;
+        sq[issue_queue[index].dest].src_value = issue_queue[index].src1_value;
+        if (forwarding_bus[issue_queue[index].src2_tag].valid)
+        {
+            //printf("Matched rs2 value from fw bus:%d\n", forwarding_bus[issue_queue[index].src2_tag].data);
+            issue_queue[index].src2_value = forwarding_bus[issue_queue[index].src2_tag].data;
+        }
+        //printf("rs1[%d]:%d,rs2[%d]:%d\n", issue_queue[index].src1_tag, issue_queue[index].src1_value, issue_queue[index].src2_tag, issue_queue[index].src2_value);
+        fu->rs1_value = issue_queue[index].src1_value;
+        fu->rs2_value = issue_queue[index].src2_value;
+        issue_queue[index].free = 0;
+    }
+    else if (issue_queue[index].operation == OPCODE_LOAD)
+    {
+        fu->rs1 = issue_queue[index].src1_tag;
+        fu->opcode = issue_queue[index].operation;
+        fu->rd = issue_queue[index].dest;
+        fu->imm = issue_queue[index].literal;
+        if (forwarding_bus[issue_queue[index].src1_tag].valid)
+        {
+            // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[index].src1_tag].data);
+            lq[issue_queue[index].dest].src_data_valid_bit = 1;
+            lq[issue_queue[index].dest].src_value = forwarding_bus[issue_queue[index].src1_tag].data;
+            issue_queue[index].src1_value = forwarding_bus[issue_queue[index].src1_tag].data;
+        }
+        //printf("rs1[%d]:%d", issue_queue[index].src1_tag, issue_queue[index].src1_value);
+        fu->rs1_value = issue_queue[index].src1_value;
+        issue_queue[index].free = 0;
+    }
+    fu->busy = TRUE;
+    fu->dispatch_time = issue_queue[index].dispatch_time;
+}
+
+/* Hands a branch whose flags are known from BQ entry index to a branch unit */
+static void
+issue_branch(CPU_Stage *fu, int index)
+{
+    fu->uop = bq[index].uop;
+    if (bq[index].uop == UOP_FUSED)
+    {
+        if (forwarding_bus[bq[index].src1_tag].valid)
+        {
+            bq[index].src1_value = forwarding_bus[bq[index].src1_tag].data;
+        }
+        if (forwarding_bus[bq[index].src2_tag].valid)
+        {
+            bq[index].src2_value = forwarding_bus[bq[index].src2_tag].data;
+        }
+        fu->fused_with = bq[index].fused_with;
+        fu->rs1_value = bq[index].src1_value;
+        fu->rs2_value = bq[index].src2_value;
+        fu->imm = bq[index].literal;
+        fu->rd = bq[index].dest_physical;
+    }
+    else
+    {
+        bq[index].value = prf_file[bq[index].tag].cc.value;
+    }
+    fu->has_insn = TRUE;
+    fu->pc = bq[index].pc;
+    fu->cc = bq[index].tag;
+    fu->cc_value = bq[index].value;
+    fu->opcode = bq[index].instr_type;
+    fu->memory_address = bq[index].target_address;
+    fu->predicted_decision = bq[index].predicted_decision;
+    fu->btb_probe_index = bq[index].btb_probe_index;
+    fu->bp_info = bq[index].bp_info;
+    fu->busy = TRUE;
+    fu->dispatch_time = bq[index].elapsed_clock;
+    fu->bq_index = index;
+    bq[index].issued = 1;
+}
+
+/* Returns the first idle unit of a pool, -1 if every unit is busy */
+static int
+free_unit(const CPU_Stage *pool, int units)
+{
+    for (int unit = 0; unit < units; unit++)
+    {
+        if (!pool[unit].busy)
+        {
+            return unit;
+        }
+    }
+    return -1;
+}
+
+/* Function unit type an IQ entry issues to */
+static int
+fu_type_of(const IQ *entry)
+{
+    if (strcmp(entry->fu_type, "MULFU") == 0)
+    {
+        return FU_MUL;
+    }
+    if (strcmp(entry->fu_type, "DIVFU") == 0)
+    {
+        return FU_DIV;
+    }
+    if (strcmp(entry->fu_type, "AFU") == 0)
+    {
+        return FU_AGU;
+    }
+    return FU_INT;
+}
+
+/* Returns the first idle unit of the given type, -1 if there is none */
+static int
+free_unit_of_type(const APEX_CPU *cpu, int type)
+{
+    switch (type)
+    {
+    case FU_MUL:
+        return free_unit(cpu->mulFU, cpu->config.mul_units);
+    case FU_DIV:
+        return free_unit(cpu->divFU, cpu->config.div_units);
+    case FU_AGU:
+        return free_unit(cpu->afu, cpu->config.agu_units);
+    case FU_BRANCH:
+        return free_unit(cpu->bfu, cpu->config.branch_units);
+    case FU_POINTER:
+        return free_unit(cpu->pfu, cpu->config.agu_units);
+    }
+    return free_unit(cpu->intFU, cpu->config.int_units);
+}
+
+/* TRUE once the flags of BQ entry index are known, or the sources of a fused one */
+static int
+bq_ready(int index)
+{
+    if (bq[index].uop == UOP_FUSED)
+    {
+        return bq[index].src1_valid_bit && bq[index].src2_valid_bit;
+    }
+    return prf_file[bq[index].tag].cc.valid;
+}
+
+/*
+ * Returns the unit type the IQ entry issues to this cycle, -1 if none of its
+ * units is idle. The pointer update of a cracked LOADP or STOREP goes to the
+ * adder beside an address unit, or to an integer unit when those are busy.
+ */
+static int
+issue_unit_type(const APEX_CPU *cpu, const IQ *entry)
+{
+    int type = fu_type_of(entry);
+
+    if (entry->uop == UOP_POINTER && free_unit_of_type(cpu, FU_POINTER) != -1)
+    {
+        return FU_POINTER;
+    }
+    if (free_unit_of_type(cpu, type) != -1)
+    {
+        return type;
+    }
+    return -1;
+}
+
+/*
+ * Finds the oldest instruction whose operands are ready and whose unit type
+ * has an idle unit. Branches waiting in the BQ compete by dispatch order.
+ *
+ * Returns the IQ index, or -1 and the BQ index in bq_index for a branch.
+ * Both are -1 if nothing can issue.
+ */
+static int
+select_oldest_ready(const APEX_CPU *cpu, int *bq_index)
+{
+    int oldest = -1;
+    int age = INT_MAX;
+
+    *bq_index = -1;
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (issue_queue[i].free && issue_queue[i].src1_valid_bit && issue_queue[i].src2_valid_bit &&
+            issue_queue[i].dispatch_time < age && issue_unit_type(cpu, &issue_queue[i]) != -1)
+        {
+            age = issue_queue[i].dispatch_time;
+            oldest = i;
+        }
+    }
+    for (int i = 0; i < BQ_SIZE; i++)
+    {
+        if (bq[i].valid && !bq[i].issued && bq_ready(i) && bq[i].elapsed_clock < age &&
+            free_unit_of_type(cpu, FU_BRANCH) != -1)
+        {
+            age = bq[i].elapsed_clock;
+            oldest = -1;
+            *bq_index = i;
+        }
+    }
+    return oldest;
+}
+
+/*
+ * Issues up to config.issue_width of the oldest ready instructions, at most
+ * one to every idle function unit
+ */
+static void
+issue_ready(APEX_CPU *cpu)
+{
+    int index, bq_index;
+
+    for (int issued = 0; issued < cpu->config.issue_width; issued++)
+    {
+        index = select_oldest_ready(cpu, &bq_index);
+        if (bq_index != -1)
+        {
+            issue_branch(&cpu->bfu[free_unit_of_type(cpu, FU_BRANCH)], bq_index);
+            cpu->fu_issued[FU_BRANCH]++;
+        }
+        else if (index != -1)
+        {
+            int type = issue_unit_type(cpu, &issue_queue[index]);
+            int unit = free_unit_of_type(cpu, type);
+
+            switch (type)
+            {
+            case FU_INT:
+                issue_alu(&cpu->intFU[unit], index);
+                break;
+            case FU_MUL:
+                issue_alu(&cpu->mulFU[unit], index);
+                break;
+            case FU_DIV:
+                issue_alu(&cpu->divFU[unit], index);
+                break;
+            case FU_AGU:
+                issue_agu(&cpu->afu[unit], index);
+                break;
+            case FU_POINTER:
+                issue_alu(&cpu->pfu[unit], index);
+                break;
+            }
+            cpu->fu_issued[type]++;
+        }
+        else
+        {
+            return;
+        }
+    }
+
+    /* Width ran out with work left that had a unit to go to */
+    if (select_oldest_ready(cpu, &bq_index) != -1 || bq_index != -1)
+    {
+        cpu->issue_width_limited++;
+    }
+}
+
+/* Returns the BQ entry the next branch dispatches to, -1 if the BQ is full */
+static int
+free_bq_entry()
+{
+    for (int i = 0; i < BQ_SIZE; i++)
+    {
+        if (!bq[i].valid)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns TRUE if the IQ, ROB, LSQ and BQ have room for the instruction, slots
+ * dispatch in program order so a full structure holds back the rest of the group
+ */
+static int
+dispatch_resources_available(const CPU_Stage *stage)
+{
+    int iq_has_room = FALSE;
+
+    switch (stage->opcode)
+    {
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        /* Branches wait in the BQ alone, predecode already gave their target */
+        return free_bq_entry() != -1 && !rob[rob_tail].entry_bit;
+    }
+    }
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (!issue_queue[i].free)
+        {
+            iq_has_room = TRUE;
+            break;
+        }
+    }
+    if (!iq_has_room)
+    {
+        return FALSE;
+    }
+    switch (stage->opcode)
+    {
+    case OPCODE_LOAD:
+    {
+        if (lq[lq_tail].entry_bit)
+        {
+            return FALSE;
+        }
+        break;
+    }
+    case OPCODE_STORE:
+    {
+        if (sq[sq_tail].entry_bit)
+        {
+            return FALSE;
+        }
+        break;
+    }
+    }
+    return !rob[rob_tail].entry_bit;
+}
+
+/*
+ * Picks up source operands that were written to the PRF while the
+ * instruction waited in its group, their broadcast has already gone by
+ */
+static void
+read_ready_sources(CPU_Stage *stage)
+{
+    if (!stage->src1_valid && prf_file[stage->rs1].pr.valid)
+    {
+        stage->src1_valid = 1;
+        stage->rs1_value = prf_file[stage->rs1].pr.value;
+    }
+    if (!stage->src2_valid && prf_file[stage->rs2].pr.valid)
+    {
+        stage->src2_valid = 1;
+        stage->rs2_value = prf_file[stage->rs2].pr.value;
+    }
+}
+
+/*
+ * Dispatches the iq group in program order, then wakes up and issues the
+ * oldest ready instructions to the free function units
+ */
+static void
+APEX_iq(APEX_CPU *cpu)
+{
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
+    {
+        if (!cpu->iq_group[slot].has_insn)
+        {
+            continue;
+        }
+        if (!dispatch_resources_available(&cpu->iq_group[slot]))
+        {
+            cpu->stats.stall_cycles[STALL_DISPATCH_FULL]++;
+            break;
+        }
+        read_ready_sources(&cpu->iq_group[slot]);
+        cpu->iq = cpu->iq_group[slot];
+
+        switch (cpu->iq.opcode)
+        {
+        case OPCODE_MOVC:
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_HALT:
+        case OPCODE_NOP:
+        case OPCODE_XOR:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_CMP:
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_CML:
+        {
+            create_iq_entry(cpu, "INTFU", free_physical_reg_index);
+            create_rob_entry(cpu);
+            break;
+        }
+        case OPCODE_MUL:
+        {
+            create_iq_entry(cpu, "MULFU", free_physical_reg_index);
+            create_rob_entry(cpu);
+            break;
+        }
+        case OPCODE_DIV:
+        {
+            create_iq_entry(cpu, "DIVFU", free_physical_reg_index);
+            create_rob_entry(cpu);
+            break;
+        }
+        case OPCODE_STORE:
+        {
+            create_rob_entry(cpu);
+            create_lsq_entry(cpu, "STORE");
+            create_iq_entry(cpu, "AFU", free_physical_reg_index);
+            break;
+        }
+        case OPCODE_LOAD:
+        {
+            create_rob_entry(cpu);
+            create_lsq_entry(cpu, "LOAD");
+            create_iq_entry(cpu, "AFU", free_physical_reg_index);
+            break;
+        }
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        {
+            create_rob_entry(cpu);
+            create_bq_entry(cpu);
+            break;
+        }
+        }
+        cpu->iq_group[slot].has_insn = FALSE;
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("IQ", &cpu->iq);
+        }
+    }
+    write_bus_to_prf();
+    wakeup_iq(cpu);
+    issue_ready(cpu);
+}
+void create_bq_entry(APEX_CPU *cpu)
+{
+    switch(cpu->iq.opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        {
+            int i = free_bq_entry();
+
+            bq[i].valid = 1;
+            bq[i].issued = 0;
+            bq[i].instr_type = cpu->iq.opcode;
+            bq[i].pc = cpu->iq.pc;
+            bq[i].predicted_decision = cpu->iq.predicted_decision;
+            bq[i].btb_probe_index = cpu->iq.btb_probe_index;
+            bq[i].bp_info = cpu->iq.bp_info;
+            bq[i].tag = cpu->iq.cc;
+            bq[i].target_address = cpu->iq.pc + cpu->iq.imm;
+            bq[i].elapsed_clock = ++dispatch_counter;
+            bq[i].checkpoint = cpu->iq.checkpoint;
+            bq[i].rob_index = (rob_tail + ROB_SIZE - 1) % ROB_SIZE;
+            bq[i].lq_tail = lq_tail;
+            bq[i].sq_tail = sq_tail;
+            bq[i].uop = cpu->iq.uop;
+            if (cpu->iq.uop == UOP_FUSED)
+            {
+                /* Sources of the compare, woken up like those of an IQ entry */
+                bq[i].fused_with = cpu->iq.fused_with;
+                bq[i].literal = cpu->iq.fused_imm;
+                bq[i].dest_physical = cpu->iq.rd;
+                bq[i].src1_tag = cpu->iq.rs1;
+                bq[i].src1_valid_bit = cpu->iq.src1_valid;
+                bq[i].src1_value = cpu->iq.rs1_value;
+                bq[i].src2_tag = cpu->iq.rs2;
+                bq[i].src2_valid_bit = cpu->iq.src2_valid;
+                bq[i].src2_value = cpu->iq.rs2_value;
+                if (!bq[i].src1_valid_bit && forwarding_bus[bq[i].src1_tag].valid)
+                {
+                    bq[i].src1_valid_bit = 1;
+                    bq[i].src1_value = forwarding_bus[bq[i].src1_tag].data;
+                }
+                if (!bq[i].src2_valid_bit && forwarding_bus[bq[i].src2_tag].valid)
+                {
+                    bq[i].src2_valid_bit = 1;
+                    bq[i].src2_value = forwarding_bus[bq[i].src2_tag].data;
+                }
+            }
+            break;
+        }
+    }
+}
+void create_lsq_entry(APEX_CPU *cpu, char *lsq_type)
+{
+    if (lsq_type == "STORE")
+    {
+        sq[sq_tail].entry_bit = 1;
+        sq[sq_tail].pc = cpu->iq.pc;
+        sq[sq_tail].load_store_bit = 0;
+        sq[sq_tail].mem_addr_valid_bit = 0;
+        if (prf_file[cpu->iq.rs1].pr.valid)
+        {
+            sq[sq_tail].src_data_valid_bit = 1;
+            sq[sq_tail].src_value = prf_file[cpu->iq.rs1].pr.value;
+        }
+        else
+        {
+            sq[sq_tail].src_data_valid_bit = 0;
+        }
+        sq[sq_tail].src_tag = cpu->iq.rs1;
+        sq[sq_tail].rob_index = (rob_tail + ROB_SIZE - 1) % ROB_SIZE;
+        sq_tail = (sq_tail + 1) % cpu->config.sq_size;
+    }
+    else if (lsq_type == "LOAD")
+    {
+        lq[lq_tail].entry_bit = 1;
+        lq[lq_tail].pc = cpu->iq.pc;
+        lq[lq_tail].load_store_bit = 1;
+        lq[lq_tail].mem_addr_valid_bit = 0;
+        lq[lq_tail].load_addr_ready = 0;
+        lq[lq_tail].load_issued = 0;
+        lq[lq_tail].forwarded = 0;
+        lq[lq_tail].set_wait = 0;
+        lq[lq_tail].dest = cpu->iq.rd;
+        lq[lq_tail].src_data_valid_bit = 1;
+        lq[lq_tail].rob_index = (rob_tail + ROB_SIZE - 1) % ROB_SIZE;
+        lq_tail = (lq_tail + 1) % cpu->config.lq_size;
+    }
+}
+void 
+register_renaming(APEX_CPU *cpu)
+{
+    switch (cpu->decode2.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    {
+        free_physical_reg_index = get_free_pr_index();
+        free_cc_physical_reg_index = get_free_cc_index();
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
+        update_rename_table_entry(cpu, free_physical_reg_index);
+        cpu->decode2.rd = free_physical_reg_index;
+        //printf("rename_table size :%d",rename_table[Rename_Table_SIZE]);
+        prev_cc = rename_table[16];
+        rename_table[16] = free_cc_physical_reg_index;
+        cpu->decode2.cc = free_cc_physical_reg_index;
+        // printf("Arch - Sources are: %d %d\n", cpu->decode2.rs1, cpu->decode2.rs2);
+        // printf("Rename table entries are :%d, %d\n", rename_table[cpu->decode2.rs1],rename_table[cpu->decode2.rs2]);
+        // printf("Renamed instruction is : %s,P%d,P%d,P%d\n", cpu->decode2.opcode_str,cpu->decode2.rd, cpu->decode2.rs1,cpu->decode2.rs2);
+        break;
+    }
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    {
+        if (cpu->decode2.uop == UOP_POINTER)
+        {
+            /* Adds to the base its memory micro-op read, even if that one just wrote the register */
+            free_physical_reg_index = get_free_pr_index();
+            cpu->decode2.rs1 = cpu->pointer_base;
+            update_rename_table_entry(cpu, free_physical_reg_index);
+            cpu->decode2.rd = free_physical_reg_index;
+            cpu->decode2.cc = -1;
+            break;
+        }
+        free_physical_reg_index = get_free_pr_index();
+        free_cc_physical_reg_index = get_free_cc_index();
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        update_rename_table_entry(cpu, free_physical_reg_index);
+        cpu->decode2.rd = free_physical_reg_index;
+        prev_cc = rename_table[16];
+        rename_table[Rename_Table_SIZE-1] = free_cc_physical_reg_index;
+        cpu->decode2.cc = free_cc_physical_reg_index;
+        // printf("Arch - Sources are: %d %d\n", cpu->decode2.rs1, cpu->decode2.rs2);
+        // printf("Rename table entries are :%d, %d\n", rename_table[cpu->decode2.rs1],rename_table[cpu->decode2.rs2]);
+        // printf("Renamed instruction is : %s,P%d,P%d,P%d\n", cpu->decode2.opcode_str,cpu->decode2.rd, cpu->decode2.rs1,cpu->decode2.rs2);
+        break;
+    }
+    case OPCODE_CML:
+    {
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        prev = -1;
+        free_cc_physical_reg_index = get_free_cc_index();
+        prev_cc = rename_table[16];
+        rename_table[Rename_Table_SIZE-1] = free_cc_physical_reg_index;
+        cpu->decode2.cc = free_cc_physical_reg_index;
+        break;
+    }
+    case OPCODE_CMP:
+    {
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
+        prev = -1;
+        free_cc_physical_reg_index = get_free_cc_index();
+        prev_cc = rename_table[16];
+        rename_table[Rename_Table_SIZE-1] = free_cc_physical_reg_index;
+        cpu->decode2.cc = free_cc_physical_reg_index;
+        break;
+    }
+    case OPCODE_MOVC:
+    {
+        free_physical_reg_index = get_free_pr_index();
+        update_rename_table_entry(cpu, free_physical_reg_index);
+        cpu->decode2.rd = free_physical_reg_index;
+        cpu->decode2.cc = -1;
+        break;
+    }
+    case OPCODE_STORE:
+    {
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
+        cpu->pointer_base = cpu->decode2.rs2;
+        cpu->decode2.cc = -1;
+        break;
+    }
+    case OPCODE_LOAD:
+    {
+        free_physical_reg_index = get_free_pr_index();
+        cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+        cpu->pointer_base = cpu->decode2.rs1;
+        update_rename_table_entry(cpu, free_physical_reg_index);
+        cpu->decode2.rd = free_physical_reg_index;
+        cpu->decode2.cc = -1;
+        break;
+    }
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        if (cpu->decode2.uop == UOP_FUSED)
+        {
+            /* The compare half, its flags go to the ROB entry instead of a flag register */
+            cpu->decode2.rs1 = rename_table[cpu->decode2.rs1];
+            if (cpu->decode2.fused_with == OPCODE_CMP)
+            {
+                cpu->decode2.rs2 = rename_table[cpu->decode2.rs2];
+            }
+            if (cpu->decode2.fused_with == OPCODE_SUBL)
+            {
+                free_physical_reg_index = get_free_pr_index();
+                update_rename_table_entry(cpu, free_physical_reg_index);
+                cpu->decode2.rd = free_physical_reg_index;
+            }
+            prev_cc = rename_table[Rename_Table_SIZE-1];
+            rename_table[Rename_Table_SIZE-1] = CC_FUSED;
+            cpu->decode2.cc = -1;
+        }
+        else
+        {
+            if (rename_table[Rename_Table_SIZE-1] == CC_FUSED)
+            {
+                free_cc_physical_reg_index = get_free_cc_index();
+                fused_flags_to_register(cpu, free_cc_physical_reg_index);
+                rename_table[Rename_Table_SIZE-1] = free_cc_physical_reg_index;
+            }
+            /* The flags of the latest producer */
+            cpu->decode2.cc = rename_table[Rename_Table_SIZE-1];
+        }
+        /* The map younger instructions start from */
+        memcpy(cpu->decode2.checkpoint.rename_table, rename_table, sizeof(rename_table));
+        cpu->decode2.checkpoint.reg_free_head = rename_head;
+        cpu->decode2.checkpoint.cc_free_head = cc_rename_head;
+        break;
+    }
+    }
+}
+/*
+ * Wakeup: marks the IQ sources, and those of fused branches in the BQ,
+ * broadcast this cycle as ready, selection is done by issue_ready
+ */
+void wakeup_iq(APEX_CPU *cpu)
+{
+    for (int i = 0; i < MAX_PHYS_REGS; i++)
+    {   
+        if (forwarding_bus[i].valid)
+        {
+            forwarding_bus[i].tag_broadcasted = 1;
+        }
+        if (cc_forwarding_bus[i].valid)
+        {
+            cc_forwarding_bus[i].tag_broadcasted = 1;
+        }
+    }
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (issue_queue[i].free)
+        {
+            /* Capture the value with the tag, the bus is only valid for this cycle */
+            if (forwarding_bus[issue_queue[i].src1_tag].valid)
+            {
+                issue_queue[i].src1_valid_bit = 1;
+                issue_queue[i].src1_value = forwarding_bus[issue_queue[i].src1_tag].data;
+            }
+            if (forwarding_bus[issue_queue[i].src2_tag].valid)
+            {
+                issue_queue[i].src2_valid_bit = 1;
+                issue_queue[i].src2_value = forwarding_bus[issue_queue[i].src2_tag].data;
+            }
+        }
+    }
+    for (int i = 0; i < BQ_SIZE; i++)
+    {
+        if (bq[i].valid && bq[i].uop == UOP_FUSED)
+        {
+            if (forwarding_bus[bq[i].src1_tag].valid)
+            {
+                bq[i].src1_valid_bit = 1;
+                bq[i].src1_value = forwarding_bus[bq[i].src1_tag].data;
+            }
+            if (forwarding_bus[bq[i].src2_tag].valid)
+            {
+                bq[i].src2_valid_bit = 1;
+                bq[i].src2_value = forwarding_bus[bq[i].src2_tag].data;
+            }
+        }
+    }
+}
+void update_rename_table_entry(APEX_CPU *cpu, int physical_reg)
+{
+    // printf("Arch reg:%d\n",cpu->decode2.rd);
+    if (cpu->decode2.opcode == OPCODE_LOAD)
+    {
+        cpu->decode2.arch_reg = cpu->decode2.rd;
+        prev = rename_table[cpu->decode2.rd];
+        rename_table[cpu->decode2.rd] = free_physical_reg_index;
+    }
+    else
+    {
+        cpu->decode2.arch_reg = cpu->decode2.rd;
+        prev = rename_table[cpu->decode2.rd];
+        rename_table[cpu->decode2.rd] = physical_reg;
+    }
+    // store prev for ROB entry
+    //  if(cc_index != -1)
+    //  {
+    //      rename_table[REG_FILE_SIZE] = cc_index;
+    //  }
+}
+int get_free_pr_index()
+{
+    // for(int i =0; i<Free_List_SIZE; i++)
+    // {
+    //     // printf("P0 validity in free list: %d\n",reg_free_list[0]);
+    //     // printf("P1 validity in free list: %d\n",reg_free_list[1]);
+    //     // printf("P2 validity in free list: %d\n",reg_free_list[2]);
+    //     // printf("P3 validity in free list: %d\n",reg_free_list[3]);
+    //     if(reg_free_list[i] == 0)
+    //     {
+    //         reg_free_list[i] = 1;
+    //         //printf("free pr index: %d\n",i);
+    //         //printf("P4 validity in free list: %d\n",reg_free_list[4]);
+    //         return i;
+    //     }
+    // }
+    int free_index = reg_free_list[rename_head];
+
+rename_head = (rename_head + 1) % free_list_slots;
+/* The new mapping is not ready until its producer broadcasts */
+prf_file[free_index].pr.valid = 0;
+forwarding_bus[free_index].tag_broadcasted = 0;
+forwarding_bus[free_index].data_broadcasted = 0;
+return free_index;
+}
+int get_free_cc_index()
+{
+    int cc_free_index = cc_free_list[cc_rename_head];
+    cc_rename_head = (cc_rename_head + 1) % cc_free_list_slots;
+    prf_file[cc_free_index].cc.valid = 0;
+    cc_forwarding_bus[cc_free_index].tag_broadcasted = 0;
+    cc_forwarding_bus[cc_free_index].data_broadcasted = 0;
+    return cc_free_index;
+}
+
+/* Returns a superseded mapping to the tail of the free list */
+void release_physical_reg(int reg)
+{
+    if (reg < 0 || reg == RESET_PHYSICAL_REG)
+    {
+        return;
+    }
+    rename_tail = (rename_tail + 1) % free_list_slots;
+    reg_free_list[rename_tail] = reg;
+}
+
+void release_cc_reg(int cc)
+{
+    if (cc < 0 || cc == RESET_PHYSICAL_REG)
+    {
+        return;
+    }
+    cc_rename_tail = (cc_rename_tail + 1) % cc_free_list_slots;
+    cc_free_list[cc_rename_tail] = cc;
+}
+void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
+{
+    dispatch_counter++;
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (!issue_queue[i].free)
+        {
+            issue_queue[i].free = 1;
+            issue_queue[i].fu_type = fu_type;
+            issue_queue[i].dest = cpu->iq.rd;
+            issue_queue[i].pc = cpu->iq.pc;
+            issue_queue[i].uop = cpu->iq.uop;
+            switch (cpu->iq.opcode)
+            {
+            case OPCODE_MOVC:
+            {
+                issue_queue[i].src1_valid_bit = 1;
+                issue_queue[i].src2_valid_bit = 1;
+                issue_queue[i].dest_type = 1;
+                issue_queue[i].operation = cpu->iq.opcode;
+                issue_queue[i].literal = cpu->iq.imm;
+                break;
+            }
+            case OPCODE_ADD:
+            case OPCODE_XOR:
+            case OPCODE_AND:
+            case OPCODE_OR:
+            case OPCODE_CMP:
+            {
+                issue_queue[i].src1_tag = cpu->iq.rs1;
+                issue_queue[i].src2_tag = cpu->iq.rs2;
+                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
+                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
+                issue_queue[i].literal = 0;
+                issue_queue[i].dest_type = 1;
+                if (cpu->iq.src1_valid)
+                {
+                    issue_queue[i].src1_value = cpu->iq.rs1_value;
+                }
+                else if (!cpu->iq.src1_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs1].valid)
+                    {
+                        issue_queue[i].src1_valid_bit = 1;
+                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
+                    }
+                }
+                if (cpu->iq.src2_valid)
+                {
+                    issue_queue[i].src2_value = cpu->iq.rs2_value;
+                }
+                else if (!cpu->iq.src2_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    {
+                        issue_queue[i].src2_valid_bit = 1;
+                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                    }
+                }
+                issue_queue[i].operation = cpu->iq.opcode;
+                issue_queue[i].cc = cpu->iq.cc;
+                break;
+            }
+            case OPCODE_SUB:
+            {
+                issue_queue[i].src1_tag = cpu->iq.rs1;
+                issue_queue[i].src2_tag = cpu->iq.rs2;
+                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
+                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
+                issue_queue[i].dest_type = 1;
+                issue_queue[i].literal = 0;
+                if (cpu->iq.src1_valid)
+                {
+                    issue_queue[i].src1_value = cpu->iq.rs1_value;
+                }
+                else if (!cpu->iq.src1_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs1].valid)
+                    {
+                        issue_queue[i].src1_valid_bit = 1;
+                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
+                    }
+                }
+                if (cpu->iq.src2_valid)
+                {
+                    issue_queue[i].src2_value = cpu->iq.rs2_value;
+                }
+                else if (!cpu->iq.src2_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    {
+                        issue_queue[i].src2_valid_bit = 1;
+                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                    }
+                }
+                issue_queue[i].operation = cpu->iq.opcode;
+                issue_queue[i].cc = cpu->iq.cc;
+                break;
+            }
+            case OPCODE_MUL:
+            case OPCODE_DIV:
+            {
+                issue_queue[i].src1_tag = cpu->iq.rs1;
+                issue_queue[i].src2_tag = cpu->iq.rs2;
+                issue_queue[i].src1_valid_bit = cpu->iq.src1_valid;
+                issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
+                issue_queue[i].dest_type = 1;
+                issue_queue[i].literal = 0;
+                if (cpu->iq.src1_valid)
+                {
+                    issue_queue[i].src1_value = cpu->iq.rs1_value;
+                }
+                else if (!cpu->iq.src1_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs1].valid)
+                    {
+                        issue_queue[i].src1_valid_bit = 1;
+                        issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
+                    }
+                }
+                if (cpu->iq.src2_valid)
+                {
+                    issue_queue[i].src2_value = cpu->iq.rs2_value;
+                }
+                else if (!cpu->iq.src2_valid)
+                {
+                    if (forwarding_bus[cpu->iq.rs2].valid)
+                    {
+                        issue_queue[i].src2_valid_bit = 1;
+                        issue_queue[i].src2_value = forwarding_bus[cpu->iq.rs2].data;
+                    }
+                }
+                issue_queue[i].operation = cpu->iq.opcode;
+                issue_queue[i].cc = cpu->iq.cc;
+                break;
+            }
+            case OPCODE_HALT:
+            case OPCODE_NOP:
+            {
+                issue_queue[i].src1_tag = 0;
+                issue_queue[i].src2_tag = 0;
+                issue_queue[i].src1_valid_bit = 1;
+                issue_queue[i].src2_valid_bit = 1;
                 issue_queue[i].literal = 0;
                 issue_queue[i].dest_type = 1;
                 issue_queue[i].dest = 0;
                 issue_queue[i].operation = cpu->iq.opcode;
                 break;
             }
-            case OPCODE_STOREP:
             case OPCODE_STORE:
             {
                 issue_queue[i].src1_tag = cpu->iq.rs1;
@@ -1233,7 +2504,7 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                 issue_queue[i].src2_valid_bit = cpu->iq.src2_valid;
                 issue_queue[i].literal = cpu->iq.imm;
                 issue_queue[i].dest_type = 0;
-                issue_queue[i].dest = lsq_tail - 1;
+                issue_queue[i].dest = rob[(rob_tail + ROB_SIZE - 1) % ROB_SIZE].lsq_index;
                 if (cpu->iq.src1_valid)
                 {
                     issue_queue[i].src1_value = cpu->iq.rs1_value;
@@ -1244,8 +2515,8 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                     {
                         issue_queue[i].src1_valid_bit = 1;
                         issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
-                        lsq[issue_queue[i].dest].src_data_valid_bit = 1;
-                        lsq[issue_queue[i].dest].src_value = forwarding_bus[cpu->iq.rs1].data;
+                        sq[issue_queue[i].dest].src_data_valid_bit = 1;
+                        sq[issue_queue[i].dest].src_value = forwarding_bus[cpu->iq.rs1].data;
                     }
                 }
                 if (cpu->iq.src2_valid)
@@ -1263,7 +2534,6 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                 issue_queue[i].operation = cpu->iq.opcode;
                 break;
             }
-            case OPCODE_LOADP:
             case OPCODE_LOAD:
             {
                 issue_queue[i].src1_tag = cpu->iq.rs1;
@@ -1272,7 +2542,7 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                 issue_queue[i].src2_valid_bit = 1;
                 issue_queue[i].literal = cpu->iq.imm;
                 issue_queue[i].dest_type = 0;
-                issue_queue[i].dest = lsq_tail - 1;
+                issue_queue[i].dest = rob[(rob_tail + ROB_SIZE - 1) % ROB_SIZE].lsq_index;
                 if (cpu->iq.src1_valid)
                 {
                     issue_queue[i].src1_value = cpu->iq.rs1_value;
@@ -1283,8 +2553,8 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                     {
                         issue_queue[i].src1_valid_bit = 1;
                         issue_queue[i].src1_value = forwarding_bus[cpu->iq.rs1].data;
-                        lsq[issue_queue[i].dest].src_data_valid_bit = 1;
-                        lsq[issue_queue[i].dest].src_value = forwarding_bus[cpu->iq.rs1].data;
+                        lq[issue_queue[i].dest].src_data_valid_bit = 1;
+                        lq[issue_queue[i].dest].src_value = forwarding_bus[cpu->iq.rs1].data;
                     }
                 }
                 issue_queue[i].operation = cpu->iq.opcode;
@@ -1316,442 +2586,1008 @@ void create_iq_entry(APEX_CPU *cpu, char *fu_type, int physical_reg)
                 issue_queue[i].cc = cpu->iq.cc;
                 break;
             }
-             case OPCODE_BZ:
-             case OPCODE_BNZ:
-             case OPCODE_BP:
-             case OPCODE_BNP:
+            }
+            issue_queue[i].dispatch_time = dispatch_counter;
+            break;
+        }
+    }
+}
+
+/*
+ * Moves values broadcast in the previous cycle from the forwarding buses
+ * into the physical register file, called once per cycle before wakeup
+ */
+void write_bus_to_prf()
+{
+    for (int i = 0; i < MAX_PHYS_REGS; i++)
+    {
+        if (forwarding_bus[i].valid && forwarding_bus[i].tag_broadcasted)
+        {
+            forwarding_bus[i].data_broadcasted = 1;
+            prf_file[forwarding_bus[i].tag].pr.valid = 1;
+            prf_file[forwarding_bus[i].tag].pr.value = forwarding_bus[i].data;
+            forwarding_bus[i].valid = 0;
+        }
+        if (cc_forwarding_bus[i].valid && cc_forwarding_bus[i].tag_broadcasted)
+        {
+            cc_forwarding_bus[i].data_broadcasted = 1;
+            prf_file[cc_forwarding_bus[i].tag].cc.valid = 1;
+            prf_file[cc_forwarding_bus[i].tag].cc.value = cc_forwarding_bus[i].data;
+            for(int i =0; i<BQ_SIZE;i++)
+            {
+            if(bq[i].valid && bq[i].uop != UOP_FUSED)
+            {
+                if (cc_forwarding_bus[bq[i].tag].data_broadcasted)
+                {
+                    // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[i].src1_tag].data);
+                    bq[i].value = cc_forwarding_bus[bq[i].tag].data;
+                }
+            }
+            }
+            cc_forwarding_bus[i].valid = 0;
+        }
+    }
+    pull_value_from_bus();
+}
+void pull_value_from_bus()
+{
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (issue_queue[i].free && issue_queue[i].src1_valid_bit)
+        {
+            if (forwarding_bus[issue_queue[i].src1_tag].data_broadcasted)
+            {
+                // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[i].src1_tag].data);
+                issue_queue[i].src1_value = forwarding_bus[issue_queue[i].src1_tag].data;
+            }
+            if (forwarding_bus[issue_queue[i].src2_tag].data_broadcasted)
+            {
+                issue_queue[i].src2_value = forwarding_bus[issue_queue[i].src2_tag].data;
+            }
+        }
+    }
+}
+void create_rob_entry(APEX_CPU *cpu)
+{
+    rob[rob_tail].opcode = cpu->iq.uop == UOP_POINTER ? cpu->iq.cracked_from : cpu->iq.opcode;
+    rob[rob_tail].uop = cpu->iq.uop;
+    switch (cpu->iq.opcode)
+    {
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_MOVC:
+    case OPCODE_XOR:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_ADDL:
+    case OPCODE_SUBL:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "R2R";
+        rob[rob_tail].prev = cpu->iq.prev;
+        rob[rob_tail].pc_value = cpu->iq.pc;
+        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
+        rob[rob_tail].dest_physical = cpu->iq.rd;
+        rob[rob_tail].cc = cpu->iq.cc;
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    /* Compares only produce flags, so they supersede no GPR mapping */
+    case OPCODE_CMP:
+    case OPCODE_CML:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "FLAGS";
+        rob[rob_tail].prev = -1;
+        rob[rob_tail].pc_value = cpu->iq.pc;
+        rob[rob_tail].cc = cpu->iq.cc;
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    case OPCODE_BZ:
+    case OPCODE_BNZ:
+    case OPCODE_BP:
+    case OPCODE_BNP:
+    {
+        /* Holds back younger instructions from commit until the branch resolves */
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "BRANCH";
+        rob[rob_tail].pc_value = cpu->iq.pc;
+        rob[rob_tail].resolved = 0;
+        if (cpu->iq.uop == UOP_FUSED)
+        {
+            rob[rob_tail].fused_with = cpu->iq.fused_with;
+            rob[rob_tail].prev = cpu->iq.prev;
+            rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+            rob[rob_tail].dest_arch = cpu->iq.arch_reg;
+            rob[rob_tail].dest_physical = cpu->iq.rd;
+        }
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    case OPCODE_HALT:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "HALT";
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    case OPCODE_NOP:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "NOP";
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    case OPCODE_STORE:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "STORE";
+        rob[rob_tail].prev = cpu->iq.prev;
+        rob[rob_tail].pc_value = cpu->iq.pc;
+        rob[rob_tail].dest_arch = 0;
+        rob[rob_tail].dest_physical = 0;
+        rob[rob_tail].lsq_index = sq_tail;
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    case OPCODE_LOAD:
+    {
+        rob[rob_tail].entry_bit = 1;
+        rob[rob_tail].instr_type = "LOAD";
+        rob[rob_tail].prev = cpu->iq.prev;
+        rob[rob_tail].pc_value = cpu->iq.pc;
+        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
+        rob[rob_tail].dest_physical = cpu->iq.rd;
+        rob[rob_tail].lsq_index = lq_tail;
+        rob[rob_tail].prev_cc = cpu->iq.prev_cc;
+        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        break;
+    }
+    }
+}
+/*
+ * Flags value of a result: 1 if positive, 0 if zero and -1 if negative.
+ * BZ and BP test for 0 and 1, so a negative result reads as not zero and
+ * not positive.
+ */
+static int
+flags_of(int result)
+{
+    return result > 0 ? 1 : (result == 0 ? 0 : -1);
+}
+
+/* Executes the instruction held by one integer unit and broadcasts its result */
+static void
+execute_int_unit(APEX_CPU *cpu, CPU_Stage *fu)
+{
+    switch (fu->opcode)
+    {
+    case OPCODE_MOVC:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->imm;
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        printf("Forwarding bus : %d | %d | %d\n", forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_ADD:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value + fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        //printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_ADDL:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value + fu->imm;
+        /* The pointer update of a cracked LOADP or STOREP has no flags */
+        if (fu->cc == -1)
+        {
+            fu->busy = FALSE;
+            fu->has_insn = FALSE;
+            break;
+        }
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_SUB:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value - fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_SUBL:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value - fu->imm;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_AND:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value & fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        printf("Forwarding bus : %d | %d | %d\n", forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_OR:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value | fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_XOR:
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value ^ fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        printf("Forwarding bus for XOR : %d | %d | %d\n", forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_CMP:
+    {
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(fu->rs1_value - fu->rs2_value);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        printf("Forwarding bus for XOR : %d | %d | %d\n", forwarding_bus[fu->rd].valid, forwarding_bus[fu->rd].tag, forwarding_bus[fu->rd].data);
+        break;
+    }
+    case OPCODE_CML:
+    {
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(fu->rs1_value - fu->imm);
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        printf("Forwarding bus for CML : %d | %d | %d\n", cc_forwarding_bus[fu->cc].valid, cc_forwarding_bus[fu->cc].tag, cc_forwarding_bus[fu->cc].data);
+        break;
+    }
+    case OPCODE_HALT:
+    case OPCODE_NOP:
+    {
+        fu->busy = FALSE;
+        fu->has_insn = FALSE;
+        break;
+    }
+    }
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        print_stage_content("INT_FU", fu);
+    }
+}
+
+/*
+ * Advances one multiplier, a config.mul_latency stage pipeline that accepts
+ * a new multiply every cycle. The product is broadcast at the end of the
+ * last stage, so dependents see exactly mul_latency cycles.
+ */
+static void
+execute_mul_unit(APEX_CPU *cpu, int unit)
+{
+    CPU_Stage *pipe = cpu->mul_pipe[unit];
+    CPU_Stage *fu;
+    int last = cpu->config.mul_latency - 1;
+
+    for (int stage = last; stage > 0; stage--)
+    {
+        pipe[stage] = pipe[stage - 1];
+    }
+    pipe[0] = cpu->mulFU[unit];
+    cpu->mulFU[unit].has_insn = FALSE;
+    cpu->mulFU[unit].busy = FALSE;
+
+    fu = &pipe[last];
+    if (fu->has_insn)
+    {
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = fu->rs1_value * fu->rs2_value;
+        cc_forwarding_bus[fu->cc].valid = 1;
+        cc_forwarding_bus[fu->cc].tag = fu->cc;
+        cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+    }
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        for (int stage = 0; stage <= last; stage++)
+        {
+            if (pipe[stage].has_insn)
             {
-                issue_queue[i].src1_valid_bit = 1;
-                issue_queue[i].src2_valid_bit = 1;
-                issue_queue[i].dest_type = 1;
-                issue_queue[i].operation = cpu->iq.opcode;
-                issue_queue[i].literal = cpu->iq.imm;
-                issue_queue[i].dest = rename_table[Rename_Table_SIZE -1];
-                
-                break;
+                print_stage_content("MUL_FU", &pipe[stage]);
             }
-            }
-            issue_queue[i].dispatch_time = dispatch_counter;
-            break;
         }
     }
-    for (int i = 0; i < 100; i++)
+    fu->has_insn = FALSE;
+}
+
+/*
+ * Advances one divider. The divider is not pipelined, its DIV holds the unit
+ * for APEX_div_latency cycles and broadcasts the quotient in the last one.
+ */
+static void
+execute_div_unit(APEX_CPU *cpu, int unit)
+{
+    CPU_Stage *fu = &cpu->divFU[unit];
+
+    if (!cpu->div_cycles_left[unit])
     {
-        
-        if (forwarding_bus[i].valid && forwarding_bus[i].tag_broadcasted)
+        cpu->div_cycles_left[unit] = APEX_div_latency(&cpu->config, fu->rs1_value, fu->rs2_value);
+        cpu->stats.div_ops++;
+        if (cpu->div_cycles_left[unit] < cpu->config.div_latency)
         {
-            forwarding_bus[i].data_broadcasted = 1;
-            prf_file[forwarding_bus[i].tag].pr.valid = 1;
-            prf_file[forwarding_bus[i].tag].pr.value = forwarding_bus[i].data;
-            forwarding_bus[i].valid = 0;
+            cpu->stats.div_early_outs++;
         }
-        if (cc_forwarding_bus[i].valid && cc_forwarding_bus[i].tag_broadcasted)
+    }
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        print_stage_content("DIV_FU", fu);
+    }
+
+    cpu->div_cycles_left[unit]--;
+    if (cpu->div_cycles_left[unit])
+    {
+        return;
+    }
+
+    forwarding_bus[fu->rd].valid = 1;
+    forwarding_bus[fu->rd].tag = fu->rd;
+    forwarding_bus[fu->rd].data = APEX_div_result(fu->rs1_value, fu->rs2_value);
+    cc_forwarding_bus[fu->cc].valid = 1;
+    cc_forwarding_bus[fu->cc].tag = fu->cc;
+    cc_forwarding_bus[fu->cc].data = flags_of(forwarding_bus[fu->rd].data);
+    fu->busy = FALSE;
+    fu->has_insn = FALSE;
+}
+
+/* Removes an instruction younger than the given dispatch age from a function unit */
+static void
+squash_unit(CPU_Stage *fu, int age)
+{
+    if (fu->has_insn && fu->dispatch_time > age)
+    {
+        fu->has_insn = FALSE;
+        fu->busy = FALSE;
+    }
+}
+
+/*
+ * Recovers from the mispredicted branch in bq[index] in a single cycle
+ *
+ * The rename table and the heads of both free lists go back to the
+ * checkpoint the branch took in decode2, which returns every register
+ * renamed after it to the free lists. Only instructions younger than the
+ * branch are squashed: the ROB and LSQ tails go back to where they were at
+ * its dispatch, and the IQ, BQ, function units and front end drop whatever
+ * was dispatched after it or not dispatched yet. Older instructions keep
+ * executing. Fetch restarts at pc in the next cycle.
+ */
+static void
+recover_branch(APEX_CPU *cpu, int index, int pc)
+{
+    const BQ *branch = &bq[index];
+    int age = branch->elapsed_clock;
+    int rob_restart = (branch->rob_index + 1) % ROB_SIZE;
+
+    /* Values younger instructions put on the buses this cycle are never written */
+    for (int i = branch->checkpoint.reg_free_head; i != rename_head; i = (i + 1) % free_list_slots)
+    {
+        forwarding_bus[reg_free_list[i]].valid = 0;
+    }
+    for (int i = branch->checkpoint.cc_free_head; i != cc_rename_head; i = (i + 1) % cc_free_list_slots)
+    {
+        cc_forwarding_bus[cc_free_list[i]].valid = 0;
+        /* A fused branch left no longer writes the flag register a squashed branch gave it */
+        for (int j = 0; j < BQ_SIZE; j++)
         {
-            cc_forwarding_bus[i].data_broadcasted = 1;
-            prf_file[cc_forwarding_bus[i].tag].cc.valid = 1;
-            prf_file[cc_forwarding_bus[i].tag].cc.value = cc_forwarding_bus[i].data;
-            for(int i =0; i<BQ_SIZE;i++)
-            {
-            if(bq[i].valid)
+            if (bq[j].valid && bq[j].uop == UOP_FUSED && bq[j].tag == cc_free_list[i])
             {
-                if (cc_forwarding_bus[bq[i].tag].data_broadcasted)
-                {
-                    // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[i].src1_tag].data);
-                    bq[i].value = cc_forwarding_bus[bq[i].tag].data;
-                }
-            }
+                bq[j].tag = -1;
             }
-            cc_forwarding_bus[i].valid = 0;
         }
     }
-    pull_value_from_bus();
+    memcpy(rename_table, branch->checkpoint.rename_table, sizeof(rename_table));
+    rename_head = branch->checkpoint.reg_free_head;
+    cc_rename_head = branch->checkpoint.cc_free_head;
+
+    while (rob_tail != rob_restart)
+    {
+        rob_tail = (rob_tail + ROB_SIZE - 1) % ROB_SIZE;
+        rob[rob_tail].entry_bit = 0;
+        rob[rob_tail].instr_type = NULL;
+        cpu->squashed++;
+    }
+    while (lq_tail != branch->lq_tail)
+    {
+        lq_tail = (lq_tail + cpu->config.lq_size - 1) % cpu->config.lq_size;
+        lq[lq_tail].entry_bit = 0;
+    }
+    while (sq_tail != branch->sq_tail)
+    {
+        sq_tail = (sq_tail + cpu->config.sq_size - 1) % cpu->config.sq_size;
+        sq[sq_tail].entry_bit = 0;
+    }
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        if (issue_queue[i].free && issue_queue[i].dispatch_time > age)
+        {
+            issue_queue[i].free = 0;
+        }
+    }
+    for (int i = 0; i < BQ_SIZE; i++)
+    {
+        if (bq[i].valid && bq[i].elapsed_clock > age)
+        {
+            bq[i].valid = 0;
+        }
+    }
+
+    /* Everything in a unit also has a ROB entry, so only the front end adds to the count below */
+    for (int unit = 0; unit < MAX_FU_UNITS; unit++)
+    {
+        squash_unit(&cpu->intFU[unit], age);
+        squash_unit(&cpu->mulFU[unit], age);
+        squash_unit(&cpu->afu[unit], age);
+        squash_unit(&cpu->bfu[unit], age);
+        squash_unit(&cpu->pfu[unit], age);
+        for (int stage = 0; stage < MAX_MUL_LATENCY; stage++)
+        {
+            squash_unit(&cpu->mul_pipe[unit][stage], age);
+        }
+        if (cpu->divFU[unit].has_insn && cpu->divFU[unit].dispatch_time > age)
+        {
+            cpu->div_cycles_left[unit] = 0;
+        }
+        squash_unit(&cpu->divFU[unit], age);
+    }
+    for (int slot = 0; slot < MAX_GROUP_SLOTS; slot++)
+    {
+        cpu->squashed += cpu->decode1_group[slot].has_insn + cpu->decode2_group[slot].has_insn +
+                         cpu->iq_group[slot].has_insn;
+        cpu->decode1_group[slot].has_insn = FALSE;
+        cpu->decode2_group[slot].has_insn = FALSE;
+        cpu->iq_group[slot].has_insn = FALSE;
+    }
+    cpu->squashed += cpu->fusion_hold.has_insn;
+    cpu->fusion_hold.has_insn = FALSE;
+
+    cpu->recoveries++;
+    cpu->stats.bp_mispredicts++;
+    cpu->pc = pc;
+    cpu->fetch_from_next_cycle = TRUE;
+    /* Blocks predicted down the wrong path are dropped */
+    cpu->ftq_head = 0;
+    cpu->ftq_count = 0;
+    /* The loop buffer unlocks, and what it captured may be from the wrong path */
+    cpu->loop_streaming = FALSE;
+    cpu->loop_start = -1;
+    /* A HALT fetched down the wrong path stopped fetch */
+    cpu->fetch.has_insn = TRUE;
+    cpu->bpu.has_insn = TRUE;
 }
-void pull_value_from_bus()
+
+/*
+ * Does the compare half of the fused branch held by a branch unit: the
+ * flags go to its ROB entry, and to the flag register a later branch gave
+ * them if there is one. A SUBL broadcasts its result.
+ */
+static void
+execute_fused_compare(CPU_Stage *fu, const BQ *branch)
 {
-    for (int i = 0; i < IQ_SIZE; i++)
+    int result = fu->rs1_value - (fu->fused_with == OPCODE_CMP ? fu->rs2_value : fu->imm);
+
+    if (fu->fused_with == OPCODE_SUBL)
     {
-        if (issue_queue[i].free && issue_queue[i].src1_valid_bit)
+        forwarding_bus[fu->rd].valid = 1;
+        forwarding_bus[fu->rd].tag = fu->rd;
+        forwarding_bus[fu->rd].data = result;
+    }
+    fu->cc_value = flags_of(result);
+    rob[branch->rob_index].cc_value = fu->cc_value;
+    if (branch->tag >= 0)
+    {
+        cc_forwarding_bus[branch->tag].valid = 1;
+        cc_forwarding_bus[branch->tag].tag = branch->tag;
+        cc_forwarding_bus[branch->tag].data = fu->cc_value;
+    }
+}
+
+/*
+ * Resolves the branch held by one branch unit
+ *
+ * Fetch went on at pc + 4 after a branch predicted not taken, and at the
+ * target after one the BTB or predecode predicted taken.
+ * If the flags say otherwise the branch recovers from its checkpoint.
+ */
+static void
+execute_branch_unit(APEX_CPU *cpu, CPU_Stage *fu)
+{
+    int taken = FALSE;
+    int index = fu->bq_index;
+
+    if (fu->uop == UOP_FUSED)
+    {
+        execute_fused_compare(fu, &bq[index]);
+    }
+    switch(fu->opcode)
+    {
+        case OPCODE_BZ:
         {
-            if (forwarding_bus[issue_queue[i].src1_tag].data_broadcasted)
-            {
-                // printf("Taking src1 value from bus: %d\n",forwarding_bus[issue_queue[i].src1_tag].data);
-                issue_queue[i].src1_value = forwarding_bus[issue_queue[i].src1_tag].data;
-            }
-            if (forwarding_bus[issue_queue[i].src2_tag].data_broadcasted)
-            {
-                issue_queue[i].src2_value = forwarding_bus[issue_queue[i].src2_tag].data;
-            }
+            taken = fu->cc_value == 0;
+            break;
+        }
+        case OPCODE_BNZ:
+        {
+            taken = fu->cc_value != 0;
+            break;
+        }
+        case OPCODE_BP:
+        {
+            taken = fu->cc_value == 1;
+            break;
+        }
+        case OPCODE_BNP:
+        {
+            taken = fu->cc_value != 1;
+            break;
         }
     }
+    cpu->stats.branches++;
+    cpu->stats.branches_taken += taken;
+
+    /* The entry may have been replaced since fetch looked it up */
+    if (btb[fu->btb_probe_index].valid && btb[fu->btb_probe_index].inst_address == fu->pc)
+    {
+        update_btb_entry(cpu, fu->btb_probe_index, taken ? 'T' : 'N');
+        btb[fu->btb_probe_index].target_address = fu->memory_address;
+        btb[fu->btb_probe_index].resolved = 1;
+    }
+    if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+    {
+        APEX_bpred_update(&cpu->bpred, fu->pc, &fu->bp_info, taken);
+    }
+
+    fu->busy = FALSE;
+    fu->has_insn = FALSE;
+    rob[bq[index].rob_index].resolved = 1;
+    if (taken != fu->predicted_decision)
+    {
+        recover_branch(cpu, index, taken ? fu->memory_address : fu->pc + 4);
+    }
+    bq[index].valid = 0;
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        print_stage_content("BRANCH_FU", fu);
+    }
 }
-void create_rob_entry(APEX_CPU *cpu)
+
+/* Computes the memory address held by one address unit */
+static void
+execute_agu_unit(APEX_CPU *cpu, CPU_Stage *fu)
 {
-    switch (cpu->iq.opcode)
+    switch (fu->opcode)
     {
-    case OPCODE_ADD:
-    case OPCODE_SUB:
-    case OPCODE_MUL:
-    case OPCODE_MOVC:
-    case OPCODE_XOR:
-    case OPCODE_AND:
-    case OPCODE_OR:
-    case OPCODE_CMP:
-    case OPCODE_CML:
-    case OPCODE_ADDL:
-    case OPCODE_SUBL:
+    case OPCODE_STORE:
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "R2R";
-        rob[rob_tail].prev = prev;
-        rob[rob_tail].pc_value = cpu->iq.pc;
-        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
-        rob[rob_tail].dest_physical = cpu->iq.rd;
-        rob[rob_tail].cc = cpu->iq.cc;
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        // cpu->memory.opcode = fu->opcode;
+        sq[fu->rd].mem_addr = fu->rs2_value + fu->imm;
+        sq[fu->rd].mem_addr_valid_bit = 1;
+        fu->busy = FALSE;
         break;
     }
-    case OPCODE_HALT:
+    case OPCODE_LOAD:
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "HALT";
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
+        lq[fu->rd].mem_addr = fu->rs1_value + fu->imm;
+        lq[fu->rd].load_addr_ready = 1;
+        fu->busy = FALSE;
         break;
     }
-    case OPCODE_NOP:
+    }
+    fu->has_insn = FALSE;
+    if (ENABLE_DEBUG_MESSAGES)
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "NOP";
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
-        break;
+        print_stage_content("AFU", fu);
     }
-    case OPCODE_STOREP:
+}
+
+/* Position of rob[index] counted from the oldest instruction, orders the LQ against the SQ */
+static int
+rob_age(int index)
+{
+    return (index - rob_head + ROB_SIZE) % ROB_SIZE;
+}
+
+/* TRUE if the store in sq[store] comes before the load in lq[load] in program order */
+static int
+store_before_load(int store, int load)
+{
+    return rob_age(sq[store].rob_index) < rob_age(lq[load].rob_index);
+}
+
+/*
+ * Returns the SQ index of the youngest store older than the load in
+ * lq[index] that is known to write its address, -1 if there is none
+ */
+static int
+older_store_to_load_addr(const APEX_CPU *cpu, int index)
+{
+    int store = -1;
+    int i = sq_head;
+
+    for (int n = 0; n < cpu->config.sq_size && sq[i].entry_bit && store_before_load(i, index);
+         n++, i = (i + 1) % cpu->config.sq_size)
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "STOREP";
-        rob[rob_tail].prev = prev;
-        rob[rob_tail].pc_value = cpu->iq.pc;
-        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
-        rob[rob_tail].dest_physical = cpu->iq.rd;
-        rob[rob_tail].lsq_index = lsq_tail;
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
-        break;
+        if (sq[i].mem_addr_valid_bit && sq[i].mem_addr == lq[index].mem_addr)
+        {
+            store = i;
+        }
     }
-    case OPCODE_STORE:
+    return store;
+}
+
+/* Returns TRUE if a store older than the load in lq[index] has no address yet */
+static int
+older_store_unknown(const APEX_CPU *cpu, int index)
+{
+    int i = sq_head;
+
+    for (int n = 0; n < cpu->config.sq_size && sq[i].entry_bit && store_before_load(i, index);
+         n++, i = (i + 1) % cpu->config.sq_size)
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "STORE";
-        rob[rob_tail].prev = prev;
-        rob[rob_tail].pc_value = cpu->iq.pc;
-        rob[rob_tail].dest_arch = 0;
-        rob[rob_tail].dest_physical = 0;
-        rob[rob_tail].lsq_index = lsq_tail;
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
-        break;
+        if (!sq[i].mem_addr_valid_bit)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Store set table entry of the load or store at pc */
+static int *
+ssit_entry(const APEX_CPU *cpu, int pc)
+{
+    return &ssit[((unsigned int)pc / 4) % cpu->config.ssit_size];
+}
+
+/*
+ * Returns TRUE if an older store without an address is in the store set of
+ * the load in lq[index], the load is then predicted to depend on it
+ */
+static int
+waits_on_store_set(const APEX_CPU *cpu, int index)
+{
+    int set = *ssit_entry(cpu, lq[index].pc);
+    int i = sq_head;
+
+    if (!set)
+    {
+        return FALSE;
+    }
+    for (int n = 0; n < cpu->config.sq_size && sq[i].entry_bit && store_before_load(i, index);
+         n++, i = (i + 1) % cpu->config.sq_size)
+    {
+        if (!sq[i].mem_addr_valid_bit && *ssit_entry(cpu, sq[i].pc) == set)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Puts a load and the store it was caught reading ahead of into one store
+ * set. A new set is numbered after the load's table entry, and two sets
+ * merge into the one with the smaller number.
+ */
+static void
+train_store_sets(const APEX_CPU *cpu, int load_pc, int store_pc)
+{
+    int *load_set = ssit_entry(cpu, load_pc);
+    int *store_set = ssit_entry(cpu, store_pc);
+
+    if (!*load_set && !*store_set)
+    {
+        *load_set = (int)(load_set - ssit) + 1;
+        *store_set = *load_set;
     }
-    case OPCODE_LOADP:
+    else if (!*load_set)
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "LOADP";
-        rob[rob_tail].prev = prev;
-        rob[rob_tail].rs1_prev = cpu->iq.prev_rs1_for_loadp;
-        rob[rob_tail].pc_value = cpu->iq.pc;
-        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
-        rob[rob_tail].dest_physical = cpu->iq.rd;
-        rob[rob_tail].rs1_arch_for_loadp = cpu->iq.arch_reg_for_loadp;
-        rob[rob_tail].rs1_physical_for_loadp = cpu->iq.increment_reg_for_storep_loadp;
-        rob[rob_tail].lsq_index = lsq_tail;
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
-        break;
+        *load_set = *store_set;
     }
-    case OPCODE_LOAD:
+    else if (!*store_set || *load_set < *store_set)
     {
-        rob[rob_tail].entry_bit = 1;
-        rob[rob_tail].instr_type = "LOAD";
-        rob[rob_tail].prev = prev;
-        rob[rob_tail].pc_value = cpu->iq.pc;
-        rob[rob_tail].dest_arch = cpu->iq.arch_reg;
-        rob[rob_tail].dest_physical = cpu->iq.rd;
-        rob[rob_tail].lsq_index = lsq_tail;
-        rob[rob_tail].prev_cc = prev_cc;
-        rob_tail = (rob_tail + 1) % ROB_SIZE;
-        break;
+        *store_set = *load_set;
     }
+    else
+    {
+        *load_set = *store_set;
     }
 }
+
+/*
+ * Finds loads that read memory, or took a forwarded value, before an older
+ * store to the same address got its address, and sends them back to issue
+ * again. Their value is never broadcast before every older store address
+ * is known, so nothing has consumed it yet and no flush is needed.
+ */
 static void
-APEX_FU(APEX_CPU *cpu)
+replay_violating_loads(APEX_CPU *cpu)
 {
-    rob_commit(cpu);
-    // printf("Entering the stage....");
-    if (cpu->intFU.has_insn || cpu->mulFU.has_insn)
+    int index = lq_head;
+
+    for (int n = 0; n < cpu->config.lq_size && lq[index].entry_bit; n++, index = (index + 1) % cpu->config.lq_size)
     {
-        switch (cpu->intFU.opcode)
-        {
-        case OPCODE_MOVC:
-        {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.imm;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            printf("Forwarding bus : %d | %d | %d\n", forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
-        }
-        case OPCODE_ADD:
+        if (lq[index].load_issued && !lq[index].mem_addr_valid_bit)
         {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value + cpu->intFU.rs2_value;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            int store = older_store_to_load_addr(cpu, index);
+            int source = lq[index].forward_store;
+
+            /* A forwarding store that has committed since is older than every store left */
+            if (store >= 0 && (!lq[index].forwarded || rob_age(source) >= rob_age(lq[index].rob_index) ||
+                               rob_age(sq[store].rob_index) > rob_age(source)))
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                cpu->stats.memdep_violations++;
+                cpu->stats.memdep_replays++;
+                train_store_sets(cpu, lq[index].pc, sq[store].pc);
+                lq[index].load_issued = 0;
+                lq[index].forwarded = 0;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            //printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
         }
-        case OPCODE_ADDL:
+    }
+}
+
+/*
+ * Load port of the LQ, loads read the data cache as soon as their address
+ * is known instead of waiting for the ROB head
+ *
+ * Stores write at commit through the MAU, or retire into the store buffer
+ * and take their value from it in a single cycle while their word waits
+ * there. Without store sets a load
+ * starts once every older store in the SQ has its address. With them it
+ * also starts ahead of older stores without an address, unless one of them
+ * is in its store set, but its value waits until all of those addresses
+ * are known. If an older store with a known address writes the loaded
+ * word, the load takes the value of the youngest such store as soon as
+ * that store has its data, in a single cycle and without a cache access.
+ * Otherwise it reads the data cache. One load starts per cycle, and with
+ * MSHRs in l1d later loads that hit go on while earlier misses are
+ * outstanding.
+ *
+ * With no squash path the store sets only overlap the cache access of a
+ * load, its dependents still wait, so they stay off by default.
+ */
+static void
+execute_load_unit(APEX_CPU *cpu)
+{
+    int index;
+
+    replay_violating_loads(cpu);
+
+    index = lq_head;
+    for (int n = 0; n < cpu->config.lq_size && lq[index].entry_bit; n++, index = (index + 1) % cpu->config.lq_size)
+    {
+        if (lq[index].load_issued && !lq[index].mem_addr_valid_bit &&
+            lq[index].data_ready_cycle <= cpu->clock && !older_store_unknown(cpu, index))
         {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value + cpu->intFU.imm;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            int dest = lq[index].dest;
+
+            forwarding_bus[dest].valid = 1;
+            forwarding_bus[dest].tag = dest;
+            if (lq[index].forwarded)
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                forwarding_bus[dest].data = lq[index].forward_value;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
-        }
-        case OPCODE_SUB:
-        {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value - cpu->intFU.rs2_value;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            else
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                cpu->stats.mem_reads++;
+                forwarding_bus[dest].data = cpu->data_memory[lq[index].mem_addr];
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
+            lq[index].mem_addr_valid_bit = 1;
         }
-        case OPCODE_SUBL:
+    }
+
+    if (cpu->clock < load_port_free_cycle)
+    {
+        return;
+    }
+
+    index = lq_head;
+    for (int n = 0; n < cpu->config.lq_size && lq[index].entry_bit; n++, index = (index + 1) % cpu->config.lq_size)
+    {
+        if (!lq[index].load_issued && lq[index].load_addr_ready)
         {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value - cpu->intFU.imm;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            int store;
+
+            if (older_store_unknown(cpu, index))
+            {
+                /* Without store sets no load younger than that store may read memory */
+                if (!cpu->config.store_sets)
+                {
+                    return;
+                }
+                if (waits_on_store_set(cpu, index))
+                {
+                    lq[index].set_wait = 1;
+                    continue;
+                }
+            }
+
+            store = older_store_to_load_addr(cpu, index);
+            if (lq[index].set_wait && store < 0)
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                cpu->stats.memdep_false_deps++;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
-        }
-        case OPCODE_AND:
-        {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value & cpu->intFU.rs2_value;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            lq[index].set_wait = 0;
+
+            if (store < 0 && store_buffer_holds(cpu, lq[index].mem_addr))
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                cpu->stats.store_buffer_forwarded_loads++;
+                load_port_free_cycle = cpu->clock + 1;
+                lq[index].load_issued = 1;
+                lq[index].forwarded = 1;
+                lq[index].forward_value = cpu->data_memory[lq[index].mem_addr];
+                /* A retired store is older than every store left in the SQ */
+                lq[index].forward_store = lq[index].rob_index;
+                lq[index].data_ready_cycle = cpu->clock + 1;
+                return;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            printf("Forwarding bus : %d | %d | %d\n", forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
-        }
-        case OPCODE_OR:
-        {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value | cpu->intFU.rs2_value;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            if (store < 0)
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                long long ready_cycle;
+                int latency = APEX_dcache_access(&cpu->caches, lq[index].pc, lq[index].mem_addr, FALSE,
+                                                 cpu->clock, &ready_cycle);
+
+                /* Like the MAU, the port takes a cycle of its own on top of the data cache */
+                cpu->stats.stall_cycles[STALL_MEMORY] += latency - 1;
+                load_port_free_cycle = cpu->clock + latency;
+                lq[index].load_issued = 1;
+                lq[index].data_ready_cycle = (int)ready_cycle + 1;
+                return;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            // printf("Forwarding bus : %d | %d | %d\n",forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
-        }
-        case OPCODE_XOR:
-        {
-            forwarding_bus[cpu->intFU.rd].valid = 1;
-            forwarding_bus[cpu->intFU.rd].tag = cpu->intFU.rd;
-            forwarding_bus[cpu->intFU.rd].data = cpu->intFU.rs1_value ^ cpu->intFU.rs2_value;
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(forwarding_bus[cpu->intFU.rd].data > 0)
+            if (sq[store].src_data_valid_bit)
             {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
+                cpu->stats.mem_forwarded_loads++;
+                load_port_free_cycle = cpu->clock + 1;
+                lq[index].load_issued = 1;
+                lq[index].forwarded = 1;
+                lq[index].forward_value = sq[store].src_value;
+                lq[index].forward_store = sq[store].rob_index;
+                lq[index].data_ready_cycle = cpu->clock + 1;
+                return;
             }
-            else if(forwarding_bus[cpu->intFU.rd].data == 0)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            printf("Forwarding bus for XOR : %d | %d | %d\n", forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
-            break;
         }
-        case OPCODE_CMP:
+    }
+}
+
+static void
+APEX_FU(APEX_CPU *cpu)
+{
+    /* Retire as wide as the front end, stopping at the first entry that cannot leave.
+     * The micro-ops of a cracked instruction retire together in one slot */
+    for (int slot = 0; slot < cpu->config.frontend_width; slot++)
+    {
+        int head = rob_head;
+        int uop = rob[head].uop;
+
+        rob_commit(cpu);
+        if (rob_head == head)
         {
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(cpu->intFU.rs1_value > cpu->intFU.rs2_value)
-            {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
-            }
-            else if(cpu->intFU.rs1_value == cpu->intFU.rs2_value)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            printf("Forwarding bus for XOR : %d | %d | %d\n", forwarding_bus[cpu->intFU.rd].valid, forwarding_bus[cpu->intFU.rd].tag, forwarding_bus[cpu->intFU.rd].data);
             break;
         }
-        case OPCODE_CML:
+        if (uop == UOP_MEMORY)
         {
-            cc_forwarding_bus[cpu->intFU.cc].valid = 1;
-            cc_forwarding_bus[cpu->intFU.cc].tag = cpu->intFU.cc;
-            if(cpu->intFU.rs1_value > cpu->intFU.imm)
-            {
-                cc_forwarding_bus[cpu->intFU.cc].data = 1;
-            }
-            else if(cpu->intFU.rs1_value == cpu->intFU.imm)
-                cc_forwarding_bus[cpu->intFU.cc].data = 0;
-            cpu->intFU.busy = FALSE;
-            cpu->intFU.has_insn = FALSE;
-            printf("Forwarding bus for CML : %d | %d | %d\n", cc_forwarding_bus[cpu->intFU.cc].valid, cc_forwarding_bus[cpu->intFU.cc].tag, cc_forwarding_bus[cpu->intFU.cc].data);
-            break;
+            slot--;
         }
-        case OPCODE_HALT:
-        case OPCODE_NOP:
+    }
+    // printf("Entering the stage....");
+    for (int unit = 0; unit < cpu->config.int_units; unit++)
+    {
+        if (cpu->intFU[unit].has_insn)
         {
-            cpu->intFU.busy = FALSE;
-            break;
+            execute_int_unit(cpu, &cpu->intFU[unit]);
         }
+    }
+    for (int unit = 0; unit < cpu->config.agu_units; unit++)
+    {
+        if (cpu->pfu[unit].has_insn)
+        {
+            execute_int_unit(cpu, &cpu->pfu[unit]);
         }
-        if (ENABLE_DEBUG_MESSAGES)
+    }
+    for (int unit = 0; unit < cpu->config.mul_units; unit++)
+    {
+        execute_mul_unit(cpu, unit);
+    }
+    for (int unit = 0; unit < cpu->config.div_units; unit++)
+    {
+        if (cpu->divFU[unit].has_insn)
         {
-            print_stage_content("INT_FU", &cpu->intFU);
-        }
-        if (cpu->mulFU.has_insn)
-        {
-            mul_counter++;
-            // if(mul_counter == 2)
-            // {
-            //    forwarding_bus[cpu->mulFU.rd].valid = 1;
-            //     forwarding_bus[cpu->mulFU.rd].tag= cpu->mulFU.rd;
-            //     forwarding_bus[cpu->mulFU.rd].data= cpu->mulFU.rs1_value * cpu->mulFU.rs2_value;
-            //     printf("Forwarding bus mul: %d | %d | %d\n",forwarding_bus[cpu->mulFU.rd].valid, forwarding_bus[cpu->mulFU.rd].tag, forwarding_bus[cpu->mulFU.rd].data);
-            // }
-            if (mul_counter == 3)
-            {
-                forwarding_bus[cpu->mulFU.rd].valid = 1;
-                forwarding_bus[cpu->mulFU.rd].tag = cpu->mulFU.rd;
-                forwarding_bus[cpu->mulFU.rd].data = cpu->mulFU.rs1_value * cpu->mulFU.rs2_value;
-                cc_forwarding_bus[cpu->mulFU.cc].valid = 1;
-                cc_forwarding_bus[cpu->mulFU.cc].tag = cpu->mulFU.cc;
-                if(forwarding_bus[cpu->mulFU.rd].data > 0)
-                {
-                    cc_forwarding_bus[cpu->mulFU.cc].data = 1;
-                }
-                else if(forwarding_bus[cpu->mulFU.rd].data == 0)
-                    cc_forwarding_bus[cpu->mulFU.cc].data = 0;
-                // printf("Forwarding bus mul: %d | %d | %d\n",forwarding_bus[cpu->mulFU.rd].valid, forwarding_bus[cpu->mulFU.rd].tag, forwarding_bus[cpu->mulFU.rd].data);
-                cpu->mulFU.busy = FALSE;
-                mul_counter = 0;
-            }
-            if (ENABLE_DEBUG_MESSAGES)
-            {
-                print_stage_content("MUL_FU", &cpu->mulFU);
-            }
+            execute_div_unit(cpu, unit);
         }
     }
     if (cpu->memory.has_insn)
     {
-        mau_counter++;
-        if (mau_counter == 2)
+        /* The MAU takes a cycle of its own on top of the data cache */
+        if (!mau_cycles_left)
+        {
+            long long ready_cycle;
+            int latency = APEX_dcache_access(&cpu->caches, cpu->memory.pc, cpu->memory.memory_address,
+                                             cpu->memory.opcode == OPCODE_STORE,
+                                             cpu->clock, &ready_cycle);
+
+            cpu->stats.stall_cycles[STALL_MEMORY] += latency - 1;
+            mau_cycles_left = latency + 1;
+        }
+        mau_cycles_left--;
+        if (!mau_cycles_left)
         {
             switch (cpu->memory.opcode)
             {
-            case OPCODE_STOREP:
-            {
-                cpu->data_memory[lsq[lsq_head].mem_addr] = cpu->memory.rs1_value;
-                mau_counter = 0;
-                arf.r[rob[rob_head].dest_arch] = prf_file[rob[rob_head].dest_physical].pr.value;
-                reg_free_list[rename_tail + 1] = rob[rob_head].prev;
-                rename_tail += 1;
-                // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
-                arf.commited_instr_address = rob[rob_head].pc_value;
-                rob[rob_head].entry_bit = 0;
-                rob_head = (rob_head + 1) % ROB_SIZE;
-                lsq[lsq_head].entry_bit = 0;
-                lsq_head = (lsq_head + 1) % LSQ_SIZE;
-                // lsq_head = (lsq_head +1) % LSQ_SIZE;
-                cpu->memory.busy = FALSE;
-                cpu->memory.has_insn = FALSE;
-                break;
-            }
             case OPCODE_STORE:
             {
-                cpu->data_memory[lsq[lsq_head].mem_addr] = cpu->memory.rs1_value;
-                mau_counter = 0;
+                cpu->data_memory[sq[sq_head].mem_addr] = cpu->memory.rs1_value;
+                cpu->stats.mem_writes++;
+                count_retired(cpu, rob_head);
                 // reg_free_list[rob[rob_head].prev] = 0; --> this needs to be done but need to add to end of free list TODO
                 arf.commited_instr_address = rob[rob_head].pc_value;
                 rob[rob_head].entry_bit = 0;
                 rob_head = (rob_head + 1) % ROB_SIZE;
-                lsq[lsq_head].entry_bit = 0;
-                lsq_head = (lsq_head + 1) % LSQ_SIZE;
-                // lsq_head = (lsq_head +1) % LSQ_SIZE;
-                cpu->memory.busy = FALSE;
-                cpu->memory.has_insn = FALSE;
-                break;
-            }
-            case OPCODE_LOADP:
-            case OPCODE_LOAD:
-            {
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                forwarding_bus[cpu->memory.rd].valid = 1;
-                forwarding_bus[cpu->memory.rd].tag = cpu->memory.rd;
-                forwarding_bus[cpu->memory.rd].data = cpu->memory.result_buffer;
-                lsq[lsq_head].mem_addr_valid_bit = 1;
-                mau_counter = 0;
+                sq[sq_head].entry_bit = 0;
+                sq_head = (sq_head + 1) % cpu->config.sq_size;
                 cpu->memory.busy = FALSE;
                 cpu->memory.has_insn = FALSE;
                 break;
@@ -1763,90 +3599,20 @@ APEX_FU(APEX_CPU *cpu)
                 print_stage_content("MAU", &cpu->memory);
             }
     }
-    if(cpu->bfu.has_insn)
+    drain_store_buffer(cpu);
+    execute_load_unit(cpu);
+    for (int unit = 0; unit < cpu->config.branch_units; unit++)
     {
-        switch(cpu->bfu.opcode)
+        if (cpu->bfu[unit].has_insn)
         {
-            case OPCODE_BNZ:
-            {
-                if(cpu->bfu.cc_value == 0)
-                {
-                    update_btb_entry(cpu, 'T');
-                }
-                if(cpu->bfu.predicted_decision)
-                {
-                    cpu->pc = cpu->bfu.memory_address;
-                    cpu->stall = FALSE;
-                    cpu->bfu.busy = FALSE;
-                }
-            }
+            execute_branch_unit(cpu, &cpu->bfu[unit]);
         }
     }
-    if (cpu->afu.has_insn)
+    for (int unit = 0; unit < cpu->config.agu_units; unit++)
     {
-        switch (cpu->afu.opcode)
-        {
-        case OPCODE_STOREP:
-        {
-            // cpu->memory.opcode = cpu->afu.opcode;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].valid = 1;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].tag = cpu->afu.increment_reg_for_storep_loadp;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].data = cpu->afu.rs2_value + 4;
-            lsq[cpu->afu.rd].mem_addr = cpu->afu.rs2_value + cpu->afu.imm;
-            lsq[cpu->afu.rd].mem_addr_valid_bit = 1;
-            cpu->afu.busy = FALSE;
-            break;
-        }
-        case OPCODE_STORE:
-        {
-            // cpu->memory.opcode = cpu->afu.opcode;
-            lsq[cpu->afu.rd].mem_addr = cpu->afu.rs2_value + cpu->afu.imm;
-            lsq[cpu->afu.rd].mem_addr_valid_bit = 1;
-            cpu->afu.busy = FALSE;
-            break;
-        }
-        case OPCODE_LOADP:
-        {
-            cpu->memory.memory_address = cpu->afu.rs1_value + cpu->afu.imm;
-            cpu->memory.opcode = OPCODE_LOADP;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].valid = 1;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].tag = cpu->afu.increment_reg_for_storep_loadp;
-            forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].data = cpu->afu.rs1_value + 4;
-            //printf("Increment reg is %d:%d\n", cpu->afu.increment_reg_for_storep_loadp, forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].data);
-            // cpu->memory.increment_reg_for_storep_loadp = cpu->afu.increment_reg_for_storep_loadp;
-            cpu->memory.rd = cpu->afu.rd;
-            cpu->afu.busy = FALSE;
-            break;
-        }
-        case OPCODE_LOAD:
+        if (cpu->afu[unit].has_insn)
         {
-            cpu->memory.memory_address = cpu->afu.rs1_value + cpu->afu.imm;
-            cpu->memory.opcode = OPCODE_LOADP;
-            //printf("Increment reg is %d:%d\n", cpu->afu.increment_reg_for_storep_loadp, forwarding_bus[cpu->afu.increment_reg_for_storep_loadp].data);
-            cpu->memory.rd = cpu->afu.rd;
-            cpu->afu.busy = FALSE;
-            break;
-        }
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        {
-            cpu->bfu.memory_address = cpu->afu.pc + cpu->afu.imm;
-            for(int i =0;i< BQ_SIZE;i++)
-            {
-                if(bq[i].tag == cpu->afu.rd)
-                {
-                    bq[i].target_address = cpu->bfu.memory_address;
-                }
-            }
-            cpu->afu.busy = FALSE;
-            break;
-        }
-        }
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            print_stage_content("AFU", &cpu->afu);
+            execute_agu_unit(cpu, &cpu->afu[unit]);
         }
     }
 }
@@ -1970,6 +3736,7 @@ APEX_memory(APEX_CPU *cpu)
         case OPCODE_JALR:
         case OPCODE_MOVC:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         {
             ////data_forwarding(cpu);
             /* No work for ADD */
@@ -2041,6 +3808,7 @@ APEX_writeback(APEX_CPU *cpu)
         {
         case OPCODE_SUB:
         case OPCODE_MUL:
+        case OPCODE_DIV:
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         case OPCODE_AND:
@@ -2121,30 +3889,36 @@ void init_btb()
         btb[i].prev_outcome[0] = 0;
         btb[i].prev_outcome[1] = 0;
         btb[i].target_address = -1;
+        btb[i].resolved = 0;
     }
 }
 int predict_branch(APEX_CPU *cpu)
 {
-    int i = cpu->fetch.btb_probe_index;
-    if (btb[i].valid && btb[i].inst_address == cpu->fetch.pc)
+    int i = cpu->bpu.btb_probe_index;
+    if (btb[i].valid && btb[i].inst_address == cpu->bpu.pc)
     {
+        if (cpu->bpred.kind != BP_PREDICTOR_BTB)
+        {
+            /* The BTB only gave the target, the direction comes from the predictor */
+            cpu->bpu.predicted_decision = cpu->bpu.bp_info.taken;
+            return cpu->bpu.predicted_decision;
+        }
         if ((btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 1) || (btb[i].prev_outcome[0] == 1 && btb[i].prev_outcome[1] == 0))
         {
 
-            cpu->fetch.predicted_decision = 1;
+            cpu->bpu.predicted_decision = 1;
             return 1;
         }
         else
         {
-            cpu->fetch.predicted_decision = 0;
+            cpu->bpu.predicted_decision = 0;
             return 0;
         }
     }
     return -1;
 }
-void update_btb_entry(APEX_CPU *cpu, char pred)
+void update_btb_entry(APEX_CPU *cpu, int btb_index, char pred)
 {
-    int btb_index = cpu->bfu.btb_probe_index;
     if (btb[btb_index].prev_outcome[0] == 1 && btb[btb_index].prev_outcome[1] == 1)
     {
         if (pred == 'N')
@@ -2187,30 +3961,48 @@ void update_btb_entry(APEX_CPU *cpu, char pred)
         }
     }
 }
+/*
+ * An entry decode allocated only counts as a hit once a branch at its PC
+ * has resolved. Until then, and for good if that branch was squashed,
+ * the branch is predicted statically.
+ */
 int is_btb_hit(APEX_CPU *cpu)
 {
     for (int i = 0; i < 4; i++)
     {
-        if (btb[i].valid && cpu->fetch.pc == btb[i].inst_address)
+        if (btb[i].valid && btb[i].resolved && cpu->bpu.pc == btb[i].inst_address)
         {
             // BTB hit
-            cpu->fetch.btb_hit = TRUE;
-            cpu->fetch.btb_probe_index = i;
+            cpu->bpu.btb_hit = TRUE;
+            cpu->bpu.btb_probe_index = i;
             return i;
         }
     }
-    cpu->fetch.btb_hit = FALSE;
+    cpu->bpu.btb_hit = FALSE;
     return -1;
 }
+
+/* Allocates a BTB entry in decode, with the PC relative target predecode already knows */
 void create_btb_entry(APEX_CPU *cpu)
 {
     int i = 0;
+    /* An earlier copy of the branch may have allocated it and not resolved yet */
+    for (i = 0; i < BTB_SIZE; i++)
+    {
+        if (btb[i].valid && btb[i].inst_address == cpu->decode1.pc)
+        {
+            cpu->decode1.btb_probe_index = i;
+            return;
+        }
+    }
     for (i = 0; i < BTB_SIZE; i++)
     {
         if (!btb[i].valid)
         {
             btb[i].valid = 1;
+            btb[i].resolved = 0;
             btb[i].inst_address = cpu->decode1.pc;
+            btb[i].target_address = cpu->decode1.pc + cpu->decode1.imm;
             if (cpu->decode1.opcode == OPCODE_BNZ || cpu->decode1.opcode == OPCODE_BP)
             {
                 btb[i].prev_outcome[0] = 1;
@@ -2233,7 +4025,9 @@ void create_btb_entry(APEX_CPU *cpu)
             btb[i] = btb[i + 1];
         }
         btb[i].valid = 1;
+        btb[i].resolved = 0;
         btb[i].inst_address = cpu->decode1.pc;
+        btb[i].target_address = cpu->decode1.pc + cpu->decode1.imm;
         if (cpu->decode1.opcode == OPCODE_BNZ || cpu->decode1.opcode == OPCODE_BP)
         {
             btb[i].prev_outcome[0] = 1;
@@ -2248,13 +4042,48 @@ void create_btb_entry(APEX_CPU *cpu)
     }
 }
 
+/*
+ * Picks the physical and flag register file sizes for the front end width
+ *
+ * Unset sizes grow with the width so a wider group does not starve rename.
+ * A size too small for every architectural mapping plus one group, two
+ * registers per LOADP, would deadlock rename, so it is raised and reported.
+ */
+static void
+size_register_files(APEX_Config *config)
+{
+    int min_phys_regs = REG_FILE_SIZE + 1 + 2 * config->frontend_width;
+    int min_flag_regs = 2 + config->frontend_width;
+
+    if (!config->phys_regs)
+    {
+        config->phys_regs = Free_List_SIZE + PHYS_REGS_PER_SLOT * (config->frontend_width - 1);
+    }
+    if (!config->flag_regs)
+    {
+        config->flag_regs = CC_PSize + FLAG_REGS_PER_SLOT * (config->frontend_width - 1);
+    }
+    if (config->phys_regs < min_phys_regs)
+    {
+        fprintf(stderr, "APEX_CPU: phys_regs raised to %d for frontend_width %d\n",
+                min_phys_regs, config->frontend_width);
+        config->phys_regs = min_phys_regs;
+    }
+    if (config->flag_regs < min_flag_regs)
+    {
+        fprintf(stderr, "APEX_CPU: flag_regs raised to %d for frontend_width %d\n",
+                min_flag_regs, config->frontend_width);
+        config->flag_regs = min_flag_regs;
+    }
+}
+
 /*
  * This function creates and initializes APEX cpu.
  *
  * Note: You are free to edit this function according to your implementation
  */
 APEX_CPU *
-APEX_cpu_init(const char *filename)
+APEX_cpu_init(const char *filename, const char *config_file)
 {
     int i;
     APEX_CPU *cpu;
@@ -2276,24 +4105,55 @@ APEX_cpu_init(const char *filename)
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->reg_valid, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    // memset(reg_free_list, 0,sizeof(int) *Free_List_SIZE);
-    for (int i = 0; i < Free_List_SIZE; i++)
+    /* Every register starts out mapped to the reset register, which holds zero */
+    prf_file[RESET_PHYSICAL_REG].pr.valid = 1;
+    prf_file[RESET_PHYSICAL_REG].cc.valid = 1;
+    cpu->single_step = DISABLE_SINGLE_STEP;
+    cpu->status = TRUE;
+    APEX_config_init(&cpu->config);
+    if (config_file && !APEX_config_load(&cpu->config, config_file))
+    {
+        free(cpu);
+        return NULL;
+    }
+    size_register_files(&cpu->config);
+    for (int i = 0; i < cpu->config.phys_regs - 1; i++)
     {
-        reg_free_list[i] = i;
+        reg_free_list[i] = i + 1;
     }
-    
-    //memset(cc_free_list, 0, sizeof(int) * CC_PSize);
-    for (int i = 0; i < CC_PSize; i++)
+    rename_tail = cpu->config.phys_regs - 2;
+    free_list_slots = cpu->config.phys_regs;
+    for (int i = 0; i < cpu->config.flag_regs - 1; i++)
     {
-        cc_free_list[i] = i;
+        cc_free_list[i] = i + 1;
     }
-    cpu->single_step = DISABLE_SINGLE_STEP;
-    cpu->status = TRUE;
+    cc_rename_tail = cpu->config.flag_regs - 2;
+    cc_free_list_slots = cpu->config.flag_regs;
+    if (!APEX_caches_init(&cpu->caches, &cpu->config))
+    {
+        free(cpu);
+        return NULL;
+    }
+    if (!APEX_bpred_init(&cpu->bpred, &cpu->config))
+    {
+        APEX_caches_free(&cpu->caches);
+        free(cpu);
+        return NULL;
+    }
+    cpu->stats.occupancy_capacity[OCC_ROB] = ROB_SIZE;
+    cpu->stats.occupancy_capacity[OCC_IQ] = IQ_SIZE;
+    cpu->stats.occupancy_capacity[OCC_LSQ] = cpu->config.lq_size + cpu->config.sq_size;
+    cpu->stats.occupancy_capacity[OCC_LQ] = cpu->config.lq_size;
+    cpu->stats.occupancy_capacity[OCC_SQ] = cpu->config.sq_size;
+    cpu->stats.occupancy_capacity[OCC_STORE_BUFFER] = cpu->config.store_buffer_size;
+    cpu->stats.occupancy_capacity[OCC_BQ] = BQ_SIZE;
     /* Parse input file and create code memory */
     cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
     init_btb();
     if (!cpu->code_memory)
     {
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
         free(cpu);
         return NULL;
     }
@@ -2318,8 +4178,115 @@ APEX_cpu_init(const char *filename)
 
     /* To start fetch stage */
     cpu->fetch.has_insn = TRUE;
+    cpu->bpu.has_insn = TRUE;
+    cpu->loop_start = -1;
+    APEX_stats_interval_open(&cpu->interval, &cpu->config, &cpu->stats);
     return cpu;
 }
+/* Samples the per-cycle counters at the end of every simulated cycle */
+static void
+sample_cycle_stats(APEX_CPU *cpu)
+{
+    int rob_count = 0, iq_count = 0, lq_count = 0, sq_count = 0, bq_count = 0;
+
+    for (int i = 0; i < ROB_SIZE; i++)
+    {
+        rob_count += rob[i].entry_bit;
+    }
+    for (int i = 0; i < IQ_SIZE; i++)
+    {
+        iq_count += issue_queue[i].free;
+    }
+    for (int i = 0; i < cpu->config.lq_size; i++)
+    {
+        lq_count += lq[i].entry_bit;
+    }
+    for (int i = 0; i < cpu->config.sq_size; i++)
+    {
+        sq_count += sq[i].entry_bit;
+    }
+    for (int i = 0; i < BQ_SIZE; i++)
+    {
+        bq_count += bq[i].valid;
+    }
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_ROB, rob_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_IQ, iq_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_LSQ, lq_count + sq_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_LQ, lq_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_SQ, sq_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_STORE_BUFFER, store_buffer_count);
+    APEX_stats_sample_occupancy(&cpu->stats, OCC_BQ, bq_count);
+
+    for (int unit = 0; unit < MAX_FU_UNITS; unit++)
+    {
+        cpu->fu_busy_cycles[FU_INT] += cpu->intFU[unit].busy;
+        cpu->fu_busy_cycles[FU_MUL] += cpu->mulFU[unit].busy;
+        cpu->fu_busy_cycles[FU_DIV] += cpu->divFU[unit].busy;
+        cpu->stats.div_busy_cycles += cpu->divFU[unit].busy;
+        cpu->fu_busy_cycles[FU_AGU] += cpu->afu[unit].busy;
+        cpu->fu_busy_cycles[FU_BRANCH] += cpu->bfu[unit].busy;
+        cpu->fu_busy_cycles[FU_POINTER] += cpu->pfu[unit].busy;
+    }
+}
+
+/* Writes every counter to the statistics file at the end of a run */
+static void
+dump_stats(APEX_CPU *cpu, int cycles)
+{
+    static const char *fu_type_names[FU_NUM_TYPES] = {"int", "mul", "div", "agu", "branch", "pointer"};
+    const int units[FU_NUM_TYPES] = {cpu->config.int_units, cpu->config.mul_units,
+                                     cpu->config.div_units, cpu->config.agu_units,
+                                     cpu->config.branch_units, cpu->config.agu_units};
+    APEX_StatsWriter writer;
+
+    if (!APEX_stats_open(&writer, &cpu->config, APEX_MODEL_NAME))
+    {
+        return;
+    }
+    APEX_stats_put(&writer, "cycles", cycles);
+    APEX_stats_put(&writer, "insn_completed", cpu->insn_completed);
+    APEX_stats_put(&writer, "config.frontend_width", cpu->config.frontend_width);
+    APEX_stats_put(&writer, "config.phys_regs", cpu->config.phys_regs);
+    APEX_stats_put(&writer, "config.flag_regs", cpu->config.flag_regs);
+    APEX_stats_put_common(&writer, &cpu->stats);
+
+    for (int type = 0; type < FU_NUM_TYPES; type++)
+    {
+        char name[64];
+
+        snprintf(name, sizeof(name), "fu.%s.units", fu_type_names[type]);
+        APEX_stats_put(&writer, name, units[type]);
+        snprintf(name, sizeof(name), "fu.%s.issued", fu_type_names[type]);
+        APEX_stats_put(&writer, name, cpu->fu_issued[type]);
+        snprintf(name, sizeof(name), "fu.%s.busy_cycles", fu_type_names[type]);
+        APEX_stats_put(&writer, name, cpu->fu_busy_cycles[type]);
+    }
+    APEX_stats_put(&writer, "issue.width", cpu->config.issue_width);
+    APEX_stats_put(&writer, "issue.width_limited", cpu->issue_width_limited);
+    APEX_stats_put(&writer, "recovery.count", cpu->recoveries);
+    APEX_stats_put(&writer, "recovery.squashed", cpu->squashed);
+    APEX_stats_put(&writer, "bp.static.predictions", cpu->static_predictions);
+    APEX_stats_put(&writer, "bp.static.taken", cpu->static_taken);
+    APEX_stats_put(&writer, "ftq.blocks", cpu->ftq_blocks);
+    APEX_stats_put(&writer, "ftq.full_cycles", cpu->ftq_full_cycles);
+    APEX_stats_put(&writer, "ftq.empty_cycles", cpu->ftq_empty_cycles);
+    APEX_stats_put(&writer, "loop.locks", cpu->loop_locks);
+    APEX_stats_put(&writer, "loop.replayed", cpu->loop_replayed);
+    APEX_stats_put(&writer, "loop.gated_cycles", cpu->loop_gated_cycles);
+    APEX_stats_put(&writer, "uop_cache.lookups", cpu->uop_lookups);
+    APEX_stats_put(&writer, "uop_cache.hits", cpu->uop_hits);
+    APEX_stats_put(&writer, "uop_cache.fills", cpu->uop_fills);
+    /* Counters are integers, so the hit rate is kept to three decimals */
+    APEX_stats_put(&writer, "uop_cache.hit_rate_x1000",
+                   cpu->uop_lookups ? cpu->uop_hits * 1000 / cpu->uop_lookups : 0);
+    APEX_stats_put(&writer, "uop.cracked", cpu->cracked);
+    APEX_stats_put(&writer, "fusion.pairs", cpu->fused);
+    APEX_stats_put(&writer, "fusion.held", cpu->fusion_held);
+    APEX_caches_put_stats(&writer, &cpu->caches, cpu->insn_completed);
+    APEX_bpred_put_stats(&writer, &cpu->bpred);
+    APEX_stats_close(&writer);
+}
+
 static void print_mem(const APEX_CPU *cpu, int address)
 {
     if (address != 0)
@@ -2363,7 +4330,14 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if (rob[rob_head].instr_type == "HALT")
                 {
                     /* Stop simulation if ROB head contains HALT*/
+                    if (!stop_simulator)
+                    {
+                        count_retired(cpu, rob_head);
+                        stop_simulator = TRUE;
+                    }
                     printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
+                    APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                    dump_stats(cpu, cpu->clock + 1);
                     break;
                 }
 
@@ -2371,13 +4345,17 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             APEX_iq(cpu);
             APEX_decode2(cpu);
             APEX_decode1(cpu);
+            APEX_bpu(cpu);
             APEX_fetch(cpu);
             print_reg_file(cpu);
+            sample_cycle_stats(cpu);
                 cpu->clock++;
+                APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
                 if (no_of_cycles == cpu->clock)
                 {
                     print_reg_file(cpu);
                     printf("APEX_CPU: Simulation Stopped after = %d cycles  instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     return;
                 }
             }
@@ -2395,7 +4373,14 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             if (rob[rob_head].instr_type == "HALT")
             {
                 /* Stop simulation if ROB head contains HALT*/
+                if (!stop_simulator)
+                {
+                    count_retired(cpu, rob_head);
+                    stop_simulator = TRUE;
+                }
                 printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock + 1, cpu->insn_completed);
+                APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock + 1);
+                dump_stats(cpu, cpu->clock + 1);
                 break;
             }
 
@@ -2403,8 +4388,10 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
             APEX_iq(cpu);
             APEX_decode2(cpu);
             APEX_decode1(cpu);
+            APEX_bpu(cpu);
             APEX_fetch(cpu);
             print_reg_file(cpu);
+            sample_cycle_stats(cpu);
             if (cpu->single_step)
             {
                 printf("Press any key to advance CPU Clock or <q> to quit:\n");
@@ -2413,11 +4400,13 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
                 if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
                 {
                     printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                    dump_stats(cpu, cpu->clock);
                     break;
                 }
             }
 
             cpu->clock++;
+            APEX_stats_interval_tick(&cpu->interval, &cpu->stats, cpu->clock);
         }
 
         else if (command == 5)
@@ -2437,5 +4426,12 @@ void APEX_cpu_run(APEX_CPU *cpu, int command)
  */
 void APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu)
+    {
+        /* A run stopped before HALT may have been resumed, so the time series ends here */
+        APEX_stats_interval_close(&cpu->interval, &cpu->stats, cpu->clock);
+        APEX_caches_free(&cpu->caches);
+        APEX_bpred_free(&cpu->bpred);
+    }
     free(cpu);
 }
\ No newline at end of file
@@ -9,7 +9,18 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include "apex_bpred.h"
+#include "apex_cache.h"
+#include "apex_config.h"
+#include "apex_divider.h"
 #include "apex_macros.h"
+#include "apex_stats.h"
+
+/* Model name reported in the statistics dump */
+#define APEX_MODEL_NAME "out_of_order"
+
+/* Iterations in a row a loop has to be decoded the same way before the loop buffer replays it */
+#define LOOP_LOCK_ITERATIONS 2
 
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
@@ -22,6 +33,41 @@ typedef struct APEX_Instruction
     int imm;
 } APEX_Instruction;
 
+/* Function unit types of the out-of-order back end */
+enum
+{
+    FU_INT,
+    FU_MUL,
+    FU_DIV,    /* Not pipelined, one DIV per unit at a time */
+    FU_AGU,    /* Address generation for loads and stores */
+    FU_BRANCH,
+    FU_POINTER, /* Adder beside every address unit for the pointer update of LOADP and STOREP */
+    FU_NUM_TYPES
+};
+
+/* Micro-ops decode1 cracks LOADP and STOREP into, in program order, and fuses compare and branch pairs into */
+enum
+{
+    UOP_NONE,      /* Instruction that is not cracked */
+    UOP_MEMORY,    /* The LOAD or STORE, addressed by the old base register */
+    UOP_POINTER,   /* ADDL of 4 to the base register, leaves the flags alone */
+    UOP_FUSED      /* Conditional branch that also does the CMP, CML or SUBL before it */
+};
+
+/* Micro-ops one instruction cracks into at most */
+#define MAX_UOPS_PER_INSN 2
+
+/* Slots of a front end group, config.frontend_width instructions after cracking */
+#define MAX_GROUP_SLOTS (MAX_FRONTEND_WIDTH * MAX_UOPS_PER_INSN)
+
+/* Rename state a branch saves, mispredict recovery puts it back in one cycle */
+typedef struct RenameCheckpoint
+{
+    int rename_table[REG_FILE_SIZE + 1]; /* Architectural registers, then the flags */
+    int reg_free_head;
+    int cc_free_head;
+} RenameCheckpoint;
+
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
@@ -41,17 +87,52 @@ typedef struct CPU_Stage
     int btb_hit;
     int predicted_decision;
     int btb_probe_index;
+    APEX_BpredInfo bp_info;        /* Histories the direction prediction used */
     int no_forward;
     int src1_valid;
     int src2_valid;
     int arch_reg;
-    int increment_reg_for_storep_loadp;
-    int arch_reg_for_loadp;
-    int prev_rs1_for_loadp;
+    int uop;                       /* UOP_* */
+    int cracked_from;              /* LOADP or STOREP, for the micro-op that retires it */
+    int fused_with;                /* CMP, CML or SUBL of a fused branch */
+    int fused_imm;                 /* Literal of that CML or SUBL */
     int cc;
     int cc_value;
+    int prev;                      /* Mapping replaced by rename, freed at commit */
+    int prev_cc;
+    RenameCheckpoint checkpoint;   /* Branches only, taken right after they were renamed */
+    int dispatch_time;             /* Age of the instruction in a function unit */
+    int bq_index;                  /* BQ entry of the branch in a branch unit */
 } CPU_Stage;
 
+/* Prediction the branch prediction unit made for one instruction of a fetch block */
+typedef struct FetchPrediction
+{
+    int btb_hit;
+    int btb_probe_index;
+    int predicted_decision;
+    APEX_BpredInfo bp_info;
+} FetchPrediction;
+
+/* Fetch target queue entry, a run of sequential instructions ending at a predicted taken branch */
+typedef struct FTQEntry
+{
+    int pc;                        /* First instruction of the block */
+    int count;                     /* Instructions in the block */
+    int fetched;                   /* Of those, instructions fetch has taken already */
+    int ready_cycle;               /* First cycle fetch may read the block */
+    FetchPrediction slot[MAX_FRONTEND_WIDTH];
+} FTQEntry;
+
+/* Micro-op cache entry, the micro-ops decode1 made of one instruction */
+typedef struct UopCacheEntry
+{
+    int valid;
+    int pc;
+    int count;
+    CPU_Stage uop[MAX_UOPS_PER_INSN];
+} UopCacheEntry;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -77,21 +158,85 @@ typedef struct APEX_CPU
     int rs2_updated;
     int stall;
     int dirty;
-    
+    APEX_Config config;            /* Run-time configuration */
+    APEX_Stats stats;              /* Counters for the statistics dump */
+    APEX_StatsInterval interval;   /* Per-interval time series */
+    long long fu_issued[FU_NUM_TYPES];      /* Instructions issued per unit type */
+    long long fu_busy_cycles[FU_NUM_TYPES]; /* Busy units summed over all cycles */
+    long long issue_width_limited;          /* Cycles issue_width left ready work behind */
+    long long recoveries;                   /* Mispredicted branches that restored their checkpoint */
+    long long squashed;                     /* Instructions removed by those recoveries */
+    long long static_predictions;           /* Branches decode predicted after a BTB miss */
+    long long static_taken;                 /* Those predicted taken, they go backward */
+    long long ftq_blocks;                   /* Fetch blocks the branch prediction unit queued */
+    long long ftq_full_cycles;              /* Cycles it waited for a free queue entry */
+    long long ftq_empty_cycles;             /* Cycles fetch found no block ready */
+    long long loop_locks;                   /* Loops the loop buffer started to replay */
+    long long loop_replayed;                /* Instructions it sent to decode2 */
+    long long loop_gated_cycles;            /* Cycles fetch and decode1 were off while it replayed */
+    long long uop_lookups;                  /* Instructions fetched with the micro-op cache in use */
+    long long uop_hits;                     /* Of those, instructions it sent to decode2 */
+    long long uop_fills;                    /* Instructions decode1 wrote to it */
+    long long cracked;                      /* LOADPs and STOREPs renamed as two micro-ops */
+    long long fused;                        /* Compare and branch pairs renamed as one micro-op */
+    long long fusion_held;                  /* Compares held back from a group to fuse with the branch starting the next */
+    int pointer_base;                       /* Base register the last memory micro-op read */
+    APEX_CacheHierarchy caches;             /* Data caches in front of data_memory */
+    APEX_BranchPredictor bpred;             /* Direction predictor, unless config picks the BTB counters */
+
+
+    /* Branch prediction unit, runs ahead of fetch through the fetch target
+     * queue. cpu->pc is the next address it predicts from */
+    CPU_Stage bpu;
+    FTQEntry ftq[MAX_FTQ_SIZE];
+    int ftq_head;
+    int ftq_count;
 
+    /* Loop buffer, decode1 captures a short loop closed by a backward
+     * branch predicted taken, then replays it into decode2 */
+    CPU_Stage loop_buffer[MAX_LOOP_BUFFER_SIZE];
+    int loop_start;                /* First instruction of the loop tracked, -1 if none */
+    int loop_branch_pc;            /* Backward branch closing it */
+    int loop_count;                /* Instructions captured of the current iteration */
+    int loop_iterations;           /* Iterations in a row captured so far */
+    int loop_length;               /* Instructions replayed per iteration */
+    int loop_next;                 /* Next buffer entry to replay */
+    int loop_streaming;            /* Fetch and decode1 are off, decode2 gets the loop */
+
+    /* Micro-op cache, direct mapped by PC. A fetch group that starts
+     * with a hit skips decode1 */
+    UopCacheEntry uop_cache[MAX_UOP_CACHE_SIZE];
 
     /* Pipeline stages */
     CPU_Stage fetch;
     CPU_Stage decode1;
     CPU_Stage decode2;
     CPU_Stage iq;
+
+    /* Front end groups of config.frontend_width instructions, one latch per
+     * micro-op. Each stage walks its group in program order through the stage
+     * latch above */
+    CPU_Stage decode1_group[MAX_GROUP_SLOTS];
+    CPU_Stage decode2_group[MAX_GROUP_SLOTS];
+    CPU_Stage iq_group[MAX_GROUP_SLOTS];
+    CPU_Stage fusion_hold;         /* Compare that ended a group, held to fuse with the branch starting the next */
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
-    CPU_Stage intFU;
-    CPU_Stage mulFU;
-    CPU_Stage afu;
-    CPU_Stage bfu;
+
+    /* Function unit pools, config sets how many units of each are in use */
+    CPU_Stage intFU[MAX_FU_UNITS];
+    CPU_Stage mulFU[MAX_FU_UNITS];
+    CPU_Stage divFU[MAX_FU_UNITS];
+    CPU_Stage afu[MAX_FU_UNITS];
+    CPU_Stage bfu[MAX_FU_UNITS];
+    CPU_Stage pfu[MAX_FU_UNITS];          /* One per address unit */
+
+    /* Stages of every multiplier, the op in the last one broadcasts */
+    CPU_Stage mul_pipe[MAX_FU_UNITS][MAX_MUL_LATENCY];
+
+    /* Cycles every divider still needs for its DIV, 0 once it broadcast */
+    int div_cycles_left[MAX_FU_UNITS];
 } APEX_CPU;
 
 typedef struct BTBEntry
@@ -100,6 +245,7 @@ typedef struct BTBEntry
     int prev_outcome[2];
     int target_address;
     int valid;
+    int resolved;                  /* A branch at inst_address has resolved since allocation */
 } BTBEntry;
 
 typedef struct BQ
@@ -108,11 +254,29 @@ typedef struct BQ
     int prev_outcome[2];
     int target_address;
     int valid;
-    int tag;
+    int tag;                       /* Flag register read, for a fused branch the one it writes or -1 */
     int value;
     int elapsed_clock;
     int dest_physical;
     int saved_ret_addr;
+    int pc;
+    int predicted_decision;
+    int btb_probe_index;
+    APEX_BpredInfo bp_info;
+    int issued;
+    int uop;                       /* UOP_FUSED if the branch waits for register sources, not for the flags */
+    int fused_with;
+    int literal;
+    int src1_valid_bit;
+    int src1_tag;
+    int src1_value;
+    int src2_valid_bit;
+    int src2_tag;
+    int src2_value;
+    RenameCheckpoint checkpoint;
+    int rob_index;//ROB entry of the branch, younger instructions follow it
+    int lq_tail;//LQ and SQ tails at dispatch, younger loads and stores start there
+    int sq_tail;
 } BQ;
 
 typedef struct IQ
@@ -132,23 +296,29 @@ typedef struct IQ
     int dispatch_time;
     int cc;
     int opcode;
+    int pc;
+    int predicted_decision;
+    int btb_probe_index;
+    int uop;                       /* UOP_* */
 }IQ;
 
 typedef struct ROB
 {
     int entry_bit;
     char* instr_type;
+    int opcode;
     int prev;
     int prev_cc;
     int pc_value;
     int dest_physical;
     int dest_arch;
-    int lsq_index;
-    int rs1_arch_for_loadp;
-    int rs1_physical_for_loadp;
-    int rs1_prev;
+    int lsq_index;//LQ index of a load, SQ index of a store
+    int uop;                       /* UOP_*, only the last micro-op counts as retired */
+    int fused_with;                /* Compare a fused branch retires with */
     int cc;
+    int cc_value;                  /* Flags a fused branch computed, it has no flag register */
     char* err_code; //only for LOAD/STORE
+    int resolved;//only for branches, set once the branch unit has run it
 }ROB;
 
 typedef struct LSQ
@@ -162,8 +332,23 @@ typedef struct LSQ
     int src_tag;
     int src_value;
     int rob_index;
+    int load_addr_ready;//address computed, only for LOAD
+    int load_issued;//sent to the data cache, only for LOAD
+    int data_ready_cycle;//cycle the loaded value is broadcast, only for LOAD
+    int forwarded;//value taken from an older store, only for LOAD
+    int forward_value;//value of that store, only for LOAD
+    int forward_store;//ROB index of that store, only for LOAD
+    int set_wait;//held back by its store set, only for LOAD
+    int pc;//instruction address, for the store set table
 }LSQ;
 
+typedef struct StoreBufferEntry
+{
+    int line;//address / line bytes of the retired stores it holds
+    unsigned long long words;//one bit per word of the line written
+    int pc;//of the store that allocated it, the prefetcher learns from its writes
+}StoreBufferEntry;
+
 typedef struct REG
 {
     int valid;
@@ -194,50 +379,25 @@ typedef struct bus
 #define BTB_SIZE 8
 #define IQ_SIZE 24
 #define BQ_SIZE 16
-#define LSQ_SIZE 16
 #define ROB_SIZE 32
 #define AR_SIZE 25
 #define Rename_Table_SIZE 17
 #define Free_List_SIZE 25
 #define CC_PSize 16
 
-static struct BTBEntry btb[BTB_SIZE];
-static struct BQ bq[BQ_SIZE];
-static  int rename_table[Rename_Table_SIZE];
-static struct PRF physical_reg_file[Free_List_SIZE];
-static struct REG physical_reg[Free_List_SIZE];
-static struct REG cc_reg[CC_PSize];
-static int reg_free_list[Free_List_SIZE];
-static int cc_free_list[CC_PSize];
-static IQ issue_queue[IQ_SIZE];
-static int dispatch_counter =0;
-static int ready_for_intFU_issue = -1;
-static int ready_for_mulFU_issue = -1;
-static int ready_for_afu_issue = -1;
-static struct bus forwarding_bus[100];
-static struct bus cc_forwarding_bus[100];
-static struct PRF prf_file[25];
-static struct ROB rob[ROB_SIZE];
-static struct LSQ lsq[LSQ_SIZE];
-static int rob_head = 0;
-static int rob_tail = 0;
-static int prev;
-static int prev_cc = -1;
-static int free_physical_reg_index;
-static int free_cc_physical_reg_index;
-static struct ARF arf;
-static int mul_counter = 0;
-static int mau_counter = 0;
-static int stop_simulator = FALSE;
-static int lsq_tail =0;
-static int lsq_head = 0;
-static int rename_head = 0;
-static int rename_tail = Free_List_SIZE -1;
-static int cc_rename_tail = Free_List_SIZE -1;
-static int ready_for_bfu_issue = -1;
+/* Registers added per extra slot of front end width when phys_regs/flag_regs are unset */
+#define PHYS_REGS_PER_SLOT 9
+#define FLAG_REGS_PER_SLOT 8
+
+/* Register every architectural register and the flags map to at reset, never reallocated */
+#define RESET_PHYSICAL_REG 0
+
+/* Flags mapping while the latest flag producer is a fused branch, which keeps them in its ROB entry
+ * until a branch reading them gives it a flag register */
+#define CC_FUSED -2
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+APEX_CPU *APEX_cpu_init(const char *filename, const char *config_file);
 void APEX_cpu_run(APEX_CPU *cpu, int command);
 void APEX_cpu_stop(APEX_CPU *cpu);
 void set_condition_codes(APEX_CPU *cpu);
@@ -247,7 +407,7 @@ void data_forwarding(APEX_CPU *cpu);
 void check_forwarding_for_LOADP_and_STOREP(APEX_CPU *cpu);
 void init_btb();
 int predict_branch(APEX_CPU *cpu);
-void update_btb_entry(APEX_CPU *cpu, char pred);
+void update_btb_entry(APEX_CPU *cpu, int btb_index, char pred);
 void create_btb_entry(APEX_CPU *cpu);
 int is_btb_hit(APEX_CPU *cpu);
 void branch_updation(APEX_CPU *cpu, char actual_decision);
@@ -258,12 +418,15 @@ void register_renaming(APEX_CPU *cpu);
 void update_rename_table_entry(APEX_CPU* cpu, int physical_reg);
 int get_free_pr_index();
 int get_free_cc_index();
+void release_physical_reg(int reg);
+void release_cc_reg(int cc);
 void register_renaming(APEX_CPU *cpu);
 void create_iq_entry(APEX_CPU *cpu, char* fu_type, int physical_reg);
 void create_rob_entry(APEX_CPU* cpu);
 void wakeup_iq(APEX_CPU *cpu);
 void rob_commit();
 void pull_value_from_bus();
+void write_bus_to_prf();
 void create_lsq_entry(APEX_CPU* cpu, char* lsq_type);
 void create_bq_entry(APEX_CPU *cpu);
 #endif
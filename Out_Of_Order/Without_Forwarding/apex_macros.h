@@ -46,6 +46,9 @@
 #define OPCODE_JUMP 0x18
 #define OPCODE_JALR 0x19
 
+/* Number of opcodes, keep in sync with the last OPCODE_* above */
+#define OPCODE_COUNT 0x1a
+
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
 
@@ -0,0 +1,280 @@
+/*
+ * apex_stats.c
+ * Contains functions to collect and dump APEX simulator statistics
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_stats.h"
+
+/* Indexed by numeric opcode, see apex_macros.h */
+static const char *opcode_names[OPCODE_COUNT] = {
+    "add", "sub", "mul", "div", "and", "or", "xor", "movc", "load",
+    "store", "bz", "bnz", "halt", "addl", "subl", "cml", "cmp", "storep",
+    "loadp", "nop", "bp", "bnp", "bn", "bnn", "jump", "jalr"};
+
+static const char *stall_names[STALL_NUM_CAUSES] = {
+    "data_hazard", "branch_redirect", "branch_unresolved", "rename_full",
+    "dispatch_full", "structural", "memory", "icache"};
+
+static const char *structure_names[OCC_NUM_STRUCTURES] = {
+    "rob", "iq", "lsq", "bq", "lq", "sq", "store_buffer"};
+
+static long long
+total_retired(const APEX_Stats *stats)
+{
+    long long retired = 0;
+
+    for (int i = 0; i < OPCODE_COUNT; i++)
+    {
+        retired += stats->retired[i];
+    }
+    return retired;
+}
+
+void
+APEX_stats_sample_occupancy(APEX_Stats *stats, int structure, int occupancy)
+{
+    stats->occupancy_sum[structure] += occupancy;
+    if (occupancy > stats->occupancy_max[structure])
+    {
+        stats->occupancy_max[structure] = occupancy;
+    }
+}
+
+/*
+ * Opens the statistics file named in the configuration and writes the
+ * schema header
+ *
+ * Returns FALSE if dumping is disabled or the file cannot be created.
+ */
+int
+APEX_stats_open(APEX_StatsWriter *writer, const APEX_Config *config, const char *model)
+{
+    memset(writer, 0, sizeof(APEX_StatsWriter));
+    if (config->stats_file[0] == '\0')
+    {
+        return FALSE;
+    }
+
+    writer->fp = fopen(config->stats_file, "w");
+    if (!writer->fp)
+    {
+        fprintf(stderr, "APEX_Stats: Unable to create %s\n", config->stats_file);
+        return FALSE;
+    }
+
+    writer->csv = (strcmp(config->stats_format, "csv") == 0);
+    if (writer->csv)
+    {
+        fprintf(writer->fp, "name,value\n");
+        fprintf(writer->fp, "schema,%s\n", STATS_SCHEMA_NAME);
+        fprintf(writer->fp, "schema_version,%d\n", STATS_SCHEMA_VERSION);
+        fprintf(writer->fp, "model,%s\n", model);
+    }
+    else
+    {
+        fprintf(writer->fp, "{\n");
+        fprintf(writer->fp, "  \"schema\": \"%s\",\n", STATS_SCHEMA_NAME);
+        fprintf(writer->fp, "  \"schema_version\": %d,\n", STATS_SCHEMA_VERSION);
+        fprintf(writer->fp, "  \"model\": \"%s\",\n", model);
+        fprintf(writer->fp, "  \"counters\": {");
+    }
+    return TRUE;
+}
+
+void
+APEX_stats_put(APEX_StatsWriter *writer, const char *name, long long value)
+{
+    if (!writer->fp)
+    {
+        return;
+    }
+
+    if (writer->csv)
+    {
+        fprintf(writer->fp, "%s,%lld\n", name, value);
+    }
+    else
+    {
+        fprintf(writer->fp, "%s\n    \"%s\": %lld", writer->count ? "," : "", name, value);
+    }
+    writer->count++;
+}
+
+/*
+ * Writes the counters shared by all the models
+ */
+void
+APEX_stats_put_common(APEX_StatsWriter *writer, const APEX_Stats *stats)
+{
+    char name[64];
+
+    for (int i = 0; i < OPCODE_COUNT; i++)
+    {
+        snprintf(name, sizeof(name), "retired.%s", opcode_names[i]);
+        APEX_stats_put(writer, name, stats->retired[i]);
+    }
+    APEX_stats_put(writer, "retired.total", total_retired(stats));
+
+    for (int i = 0; i < STALL_NUM_CAUSES; i++)
+    {
+        snprintf(name, sizeof(name), "stall.%s", stall_names[i]);
+        APEX_stats_put(writer, name, stats->stall_cycles[i]);
+    }
+
+    for (int i = 0; i < OCC_NUM_STRUCTURES; i++)
+    {
+        if (!stats->occupancy_capacity[i])
+        {
+            continue;
+        }
+        snprintf(name, sizeof(name), "occupancy.%s.capacity", structure_names[i]);
+        APEX_stats_put(writer, name, stats->occupancy_capacity[i]);
+        snprintf(name, sizeof(name), "occupancy.%s.sum", structure_names[i]);
+        APEX_stats_put(writer, name, stats->occupancy_sum[i]);
+        snprintf(name, sizeof(name), "occupancy.%s.max", structure_names[i]);
+        APEX_stats_put(writer, name, stats->occupancy_max[i]);
+    }
+
+    APEX_stats_put(writer, "bp.lookups", stats->bp_lookups);
+    APEX_stats_put(writer, "bp.hits", stats->bp_hits);
+    APEX_stats_put(writer, "bp.predicted_taken", stats->bp_predicted_taken);
+    APEX_stats_put(writer, "bp.mispredicts", stats->bp_mispredicts);
+    APEX_stats_put(writer, "branch.resolved", stats->branches);
+    APEX_stats_put(writer, "branch.taken", stats->branches_taken);
+    APEX_stats_put(writer, "mem.reads", stats->mem_reads);
+    APEX_stats_put(writer, "mem.writes", stats->mem_writes);
+    APEX_stats_put(writer, "mem.forwarded_loads", stats->mem_forwarded_loads);
+    APEX_stats_put(writer, "memdep.violations", stats->memdep_violations);
+    APEX_stats_put(writer, "memdep.replays", stats->memdep_replays);
+    APEX_stats_put(writer, "memdep.false_dependences", stats->memdep_false_deps);
+    APEX_stats_put(writer, "store_buffer.coalesced", stats->store_buffer_coalesced);
+    APEX_stats_put(writer, "store_buffer.forwarded_loads", stats->store_buffer_forwarded_loads);
+    APEX_stats_put(writer, "store_buffer.drains", stats->store_buffer_drains);
+    APEX_stats_put(writer, "store_buffer.full_cycles", stats->store_buffer_full_cycles);
+    APEX_stats_put(writer, "div.ops", stats->div_ops);
+    APEX_stats_put(writer, "div.early_outs", stats->div_early_outs);
+    APEX_stats_put(writer, "div.busy_cycles", stats->div_busy_cycles);
+}
+
+void
+APEX_stats_close(APEX_StatsWriter *writer)
+{
+    if (!writer->fp)
+    {
+        return;
+    }
+
+    if (!writer->csv)
+    {
+        fprintf(writer->fp, "\n  }\n}\n");
+    }
+    fclose(writer->fp);
+    writer->fp = NULL;
+}
+
+/* Remembers the current totals as the start of a new interval */
+static void
+interval_restart(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles)
+{
+    interval->start_cycle = cycles;
+    interval->retired = total_retired(stats);
+    interval->bp_mispredicts = stats->bp_mispredicts;
+    interval->mem_reads = stats->mem_reads;
+    interval->mem_writes = stats->mem_writes;
+    memcpy(interval->occupancy_sum, stats->occupancy_sum, sizeof(interval->occupancy_sum));
+}
+
+/*
+ * Opens the interval file and writes its CSV header
+ *
+ * Returns FALSE if intervals are disabled or the file cannot be created.
+ */
+int
+APEX_stats_interval_open(APEX_StatsInterval *interval, const APEX_Config *config,
+                         const APEX_Stats *stats)
+{
+    memset(interval, 0, sizeof(APEX_StatsInterval));
+    if (config->interval_cycles == 0 || config->interval_file[0] == '\0')
+    {
+        return FALSE;
+    }
+
+    interval->fp = fopen(config->interval_file, "w");
+    if (!interval->fp)
+    {
+        fprintf(stderr, "APEX_Stats: Unable to create %s\n", config->interval_file);
+        return FALSE;
+    }
+
+    interval->length = config->interval_cycles;
+    fprintf(interval->fp, "start_cycle,cycles,retired,ipc,bp_mispredicts");
+    for (int i = 0; i < OCC_NUM_STRUCTURES; i++)
+    {
+        if (stats->occupancy_capacity[i])
+        {
+            fprintf(interval->fp, ",%s_occupancy", structure_names[i]);
+        }
+    }
+    fprintf(interval->fp, ",mem_reads,mem_writes\n");
+
+    interval_restart(interval, stats, 0);
+    return TRUE;
+}
+
+/* Writes one row for the cycles since the start of the interval */
+static void
+interval_write(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles)
+{
+    int length = cycles - interval->start_cycle;
+    long long retired = total_retired(stats) - interval->retired;
+
+    fprintf(interval->fp, "%d,%d,%lld,%.3f,%lld", interval->start_cycle, length, retired,
+            (double)retired / length, stats->bp_mispredicts - interval->bp_mispredicts);
+    for (int i = 0; i < OCC_NUM_STRUCTURES; i++)
+    {
+        if (stats->occupancy_capacity[i])
+        {
+            fprintf(interval->fp, ",%.2f",
+                    (double)(stats->occupancy_sum[i] - interval->occupancy_sum[i]) / length);
+        }
+    }
+    fprintf(interval->fp, ",%lld,%lld\n", stats->mem_reads - interval->mem_reads,
+            stats->mem_writes - interval->mem_writes);
+
+    interval_restart(interval, stats, cycles);
+}
+
+/*
+ * Called once per simulated cycle with the cycles elapsed so far, emits a
+ * row whenever a full interval has passed
+ */
+void
+APEX_stats_interval_tick(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles)
+{
+    if (!interval->fp || cycles - interval->start_cycle < interval->length)
+    {
+        return;
+    }
+    interval_write(interval, stats, cycles);
+}
+
+/*
+ * Emits the last, possibly partial, interval and closes the file
+ */
+void
+APEX_stats_interval_close(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles)
+{
+    if (!interval->fp)
+    {
+        return;
+    }
+
+    if (cycles > interval->start_cycle)
+    {
+        interval_write(interval, stats, cycles);
+    }
+    fclose(interval->fp);
+    interval->fp = NULL;
+}
@@ -0,0 +1,111 @@
+/*
+ * apex_stats.h
+ * Contains APEX simulator statistics declarations
+ *
+ * At the end of a run every counter is written as a flat map of dotted
+ * names to integers, either as JSON or as "name,value" CSV. Names are only
+ * ever added within a schema version, never renamed or removed.
+ */
+#ifndef _APEX_STATS_H_
+#define _APEX_STATS_H_
+
+#include <stdio.h>
+
+#include "apex_config.h"
+#include "apex_macros.h"
+
+#define STATS_SCHEMA_NAME "apex-stats"
+#define STATS_SCHEMA_VERSION 1
+
+/* Reasons a pipeline stage could not make progress in a cycle */
+enum
+{
+    STALL_DATA_HAZARD,       /* Decode held on an operand dependency */
+    STALL_BRANCH_REDIRECT,   /* Fetch bubble after a redirect */
+    STALL_BRANCH_UNRESOLVED, /* Front end frozen until a branch resolves */
+    STALL_RENAME_FULL,       /* Not enough free physical registers to rename */
+    STALL_DISPATCH_FULL,     /* No free IQ, ROB or LSQ entry to dispatch into */
+    STALL_STRUCTURAL,        /* Front end held behind a busy non-pipelined unit */
+    STALL_MEMORY,            /* Data accesses waiting on the caches beyond one cycle */
+    STALL_ICACHE,            /* Fetch waiting on an instruction cache fill */
+    STALL_NUM_CAUSES
+};
+
+/* Buffering structures whose occupancy is sampled every cycle */
+enum
+{
+    OCC_ROB,
+    OCC_IQ,
+    OCC_LSQ,
+    OCC_BQ,
+    OCC_LQ,                  /* Loads and stores of OCC_LSQ, if the model splits them */
+    OCC_SQ,
+    OCC_STORE_BUFFER,
+    OCC_NUM_STRUCTURES
+};
+
+/* Counters kept by every APEX model */
+typedef struct APEX_Stats
+{
+    long long retired[OPCODE_COUNT];           /* Retired instructions per opcode */
+    long long stall_cycles[STALL_NUM_CAUSES];  /* Cycles lost per stall cause */
+    long long occupancy_sum[OCC_NUM_STRUCTURES];
+    int occupancy_max[OCC_NUM_STRUCTURES];
+    int occupancy_capacity[OCC_NUM_STRUCTURES]; /* 0 if the model has no such structure */
+    long long bp_lookups;                      /* BTB probes at fetch */
+    long long bp_hits;                         /* Probes that found an entry */
+    long long bp_predicted_taken;
+    long long branches;                        /* Conditional branches resolved */
+    long long branches_taken;
+    long long bp_mispredicts;                  /* Resolved branches that redirected fetch */
+    long long mem_reads;                       /* Data memory reads */
+    long long mem_writes;                      /* Data memory writes */
+    long long mem_forwarded_loads;             /* Loads that took their value from an older store */
+    long long memdep_violations;               /* Loads that read before an older store to their address */
+    long long memdep_replays;                  /* Loads re-issued after a violation */
+    long long memdep_false_deps;               /* Loads held for store set stores to other addresses */
+    long long store_buffer_coalesced;          /* Retired stores merged into a buffered line */
+    long long store_buffer_forwarded_loads;    /* Loads that took their value from the store buffer */
+    long long store_buffer_drains;             /* Buffered lines written to the data cache */
+    long long store_buffer_full_cycles;        /* Cycles a store waited at the ROB head for a buffer entry */
+    long long div_ops;                         /* DIVs run on the divider */
+    long long div_early_outs;                  /* DIVs that finished before the full latency */
+    long long div_busy_cycles;                 /* Cycles a divider held a DIV */
+} APEX_Stats;
+
+/* Output stream for one statistics dump */
+typedef struct APEX_StatsWriter
+{
+    FILE *fp;
+    int csv;
+    int count;
+} APEX_StatsWriter;
+
+/*
+ * Time series of counters over fixed length intervals
+ *
+ * Holds the totals seen at the start of the current interval, each row of
+ * the CSV output is the difference to the totals at its end.
+ */
+typedef struct APEX_StatsInterval
+{
+    FILE *fp;
+    int length;                                /* Cycles per interval, 0 if disabled */
+    int start_cycle;
+    long long retired;
+    long long bp_mispredicts;
+    long long mem_reads;
+    long long mem_writes;
+    long long occupancy_sum[OCC_NUM_STRUCTURES];
+} APEX_StatsInterval;
+
+void APEX_stats_sample_occupancy(APEX_Stats *stats, int structure, int occupancy);
+int APEX_stats_open(APEX_StatsWriter *writer, const APEX_Config *config, const char *model);
+void APEX_stats_put(APEX_StatsWriter *writer, const char *name, long long value);
+void APEX_stats_put_common(APEX_StatsWriter *writer, const APEX_Stats *stats);
+void APEX_stats_close(APEX_StatsWriter *writer);
+int APEX_stats_interval_open(APEX_StatsInterval *interval, const APEX_Config *config,
+                             const APEX_Stats *stats);
+void APEX_stats_interval_tick(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles);
+void APEX_stats_interval_close(APEX_StatsInterval *interval, const APEX_Stats *stats, int cycles);
+#endif